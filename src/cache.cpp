@@ -41,6 +41,8 @@
 
 CrcManager crc_manager;
 
+#define CRC_FILE_SIZES 0x53495a45   // 'SIZE', marks the size list in NET_CRC_FILENAME
+
 int past_startup=0;
 
 int crc_man_write_crc_file(char const *filename)
@@ -60,12 +62,14 @@ int CrcManager::write_crc_file(char const *filename)  // return 0 on failure
     int failed=0;
     get_crc(i,failed);
 
-    if (failed)
+    if (failed || get_size(i)<0)
     {
       jFILE *fp=new jFILE(get_filename(i),"rb");
       if (!fp->open_failure())
       {
-    set_crc(i,crc_file(fp));
+    if (failed)
+      set_crc(i,crc_file(fp));
+    set_size(i,fp->file_size());
     total++;
       }
       delete fp;
@@ -97,6 +101,17 @@ int CrcManager::write_crc_file(char const *filename)  // return 0 on failure
       total++;
     }
   }
+
+  // file sizes follow in the same order, older clients stop reading
+  // before them
+  fp->write_uint32(CRC_FILE_SIZES);
+  for (i=0; i<total_files; i++)
+  {
+    int failed=0;
+    get_crc(i,failed);
+    if (!failed)
+      fp->write_uint32(get_size(i));
+  }
   delete fp;
   return 1;
 }
@@ -112,14 +127,23 @@ int CrcManager::load_crc_file(char const *filename)
   {
     short total=fp->read_uint16();
     int i;
+    int *number=(int *)malloc(sizeof(int)*Max(1,(int)total));
     for (i=0; i<total; i++)
     {
       char name[256];
       uint32_t crc=fp->read_uint32();
       uint8_t len=fp->read_uint8();
       fp->read(name,len);
-      set_crc(get_filenumber(name),crc);
+      number[i]=get_filenumber(name);
+      set_crc(number[i],crc);
     }
+
+    // servers that predate the size list just end here
+    if (fp->tell()+4*(total+1)<=fp->file_size() &&
+        fp->read_uint32()==CRC_FILE_SIZES)
+      for (i=0; i<total; i++)
+        set_size(number[i],fp->read_uint32());
+    free(number);
     delete fp;
   }
   return 1;
@@ -144,6 +168,7 @@ CrcedFile::CrcedFile(char const *name)
 {
   filename = strdup(name);
   crc_calculated=0;
+  size=-1;
 }
 
 CrcManager::CrcManager()
@@ -180,6 +205,18 @@ uint32_t CrcManager::get_crc(int filenumber, int &failed)
   return 0;
 }
 
+int32_t CrcManager::get_size(int filenumber)
+{
+  CHECK(filenumber>=0 && filenumber<total_files);
+  return files[filenumber]->size;
+}
+
+void CrcManager::set_size(int filenumber, int32_t size)
+{
+  CHECK(filenumber>=0 && filenumber<total_files);
+  files[filenumber]->size=size;
+}
+
 void CrcManager::set_crc(int filenumber, uint32_t crc)
 {
   CHECK(filenumber>=0 && filenumber<total_files);
@@ -440,6 +477,8 @@ void CacheList::preload_cache(level *lev)
   uint16_t *fg_line;
   for (j=0; j<lev->foreground_height(); j++)
   {
+    if (!lev->fg_ready(j))      // don't decode a whole v2 map for a guess
+      continue;
     fg_line=lev->get_fgline(j);
     for (i=0; i<lev->foreground_width(); i++,fg_line++)
     {
@@ -456,6 +495,8 @@ void CacheList::preload_cache(level *lev)
   uint16_t *bg_line;
   for (j=0; j<lev->background_height(); j++)
   {
+    if (!lev->bg_ready(j))
+      continue;
     bg_line=lev->get_bgline(j);
     for (i=0; i<lev->background_width(); i++,bg_line++)
     {
@@ -32,6 +32,7 @@ protected:
 
     int crc_calculated;
     uint32_t crc;
+    int32_t size;       // -1 until known
     char *filename;
 } ;
 
@@ -48,6 +49,8 @@ public:
     int get_filenumber(char const *filename);
     uint32_t get_crc(int filenumber, int &failed);
     void set_crc(int filenumber, uint32_t crc);
+    int32_t get_size(int filenumber);           // -1 if unknown
+    void set_size(int filenumber, int32_t size);
     char *get_filename(int filenumber);
     void clean_up();
     int total_filenames() { return total_files; }
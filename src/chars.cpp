@@ -316,6 +316,8 @@ character_type::character_type(void *args, void *name)
   LSymbol *l_vars =   LSymbol::FindOrCreate("vars");
 
   memset(fun_table,0,sizeof(fun_table));     // destory all hopes of fun
+  native_ai=NULL;
+  native_mover=NULL;
   fields=NULL;
   cflags=0;
   morph_mask=-1;
@@ -97,6 +97,8 @@ public :
   int add_state(void *symbol);              // returns index into seq to use
   int abil[TOTAL_ABILITIES];
   void *fun_table[TOTAL_OFUNS];             // pointers to lisp function for this object
+  void *(*native_ai)();                     // C++ replacements for the ai and move
+  void *(*native_mover)(int, int, int);     // functions, see nativeai.h
   int logo,morph_mask,morph_power;
   long rangex,rangey,draw_rangex,draw_rangey;             // range off screen before character is skipped
 
@@ -37,6 +37,7 @@
 #include "chat.h"
 #include "jdir.h"
 #include "netcfg.h"
+#include "nativeai.h"
 
 #define ENGINE_MAJOR 1
 #define ENGINE_MINOR 20
@@ -566,6 +567,7 @@ void clisp_init()                            // call by lisp_init, defines symbo
   add_lisp_function("show_kills",0,0,           62);
   add_lisp_function("mkptr",1,1,                63);
   add_lisp_function("seq",3,3,                  64);
+  add_lisp_function("bind_native",2,3,          65);  // type ofun name
 }
 
 
@@ -586,6 +588,8 @@ void *l_caller(long number, void *args)
            "Are you calling from move function (not mover)?\n");
     exit(0);
       }
+      if (figures[current_object->otype]->native_ai)
+        return figures[current_object->otype]->native_ai();
       return ((LSymbol *)ai)->EvalFunction(NULL);
     } break;
     case 1 :
@@ -1038,6 +1042,29 @@ void *l_caller(long number, void *args)
       }
       return ret;
     }
+    case 65 :
+    {
+      long type=lnumber_value(CAR(args)->Eval());  args=CDR(args);
+      LSymbol *fun=(LSymbol *)CAR(args)->Eval();  args=CDR(args);
+      LObject *name=args ? CAR(args)->Eval() : NULL;
+      int ofun=-1;
+      if (item_type(fun)==L_SYMBOL)
+      {
+        char const *s=lstring_value(fun->GetName());
+        if (!strcmp(s,ofun_names[OFUN_AI]))
+          ofun=OFUN_AI;
+        else if (!strcmp(s,ofun_names[OFUN_MOVER]))
+          ofun=OFUN_MOVER;
+      }
+      if (ofun<0)
+      {
+        lbreak("bind_native : expecting ai_fun or move_fun\n");
+        return NULL;
+      }
+      if (native_bind(type,ofun,NILP(name) ? NULL : lstring_value(name)))
+        return true_symbol;
+      return NULL;
+    }
   }
   return NULL;
 }
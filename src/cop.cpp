@@ -193,7 +193,9 @@ void *top_ai()
     if (o->lvars[fire_delay1])
       o->lvars[fire_delay1]--;
 
+    int old_type=o->otype;
     o->otype=weapon_types[v->current_weapon];  // switch to correct top part
+    current_level->active_type_changed(o,old_type);
       }
     }
   }
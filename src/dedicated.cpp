@@ -0,0 +1,159 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#include "common.h"
+
+#include "game.h"
+#include "view.h"
+#include "level.h"
+#include "nfserver.h"
+#include "sock.h"
+#include "dedicated.h"
+
+#define DEDICATED_TICK_MS    (1000.0f / 15)
+#define DEDICATED_STATS_SECS 10
+
+extern char req_name[100];
+extern int req_end;
+extern void net_send(int force = 0);
+extern void net_receive();
+
+static int dedicated = 0;
+static volatile sig_atomic_t dedicated_stop = 0;
+
+static void dedicated_signal(int sig)
+{
+    dedicated_stop = 1;
+}
+
+void dedicated_start(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+        if (!strcmp(argv[i], "-dedicated"))
+            dedicated = 1;
+
+    if (!dedicated)
+        return;
+
+#if !defined __CELLOS_LV2__
+    // SDL still wants a video mode, give it one that never reaches a display
+    setenv("SDL_VIDEODRIVER", "dummy", 1);
+#endif
+}
+
+int dedicated_active()
+{
+    return dedicated;
+}
+
+static int count_players()
+{
+    int n = 0;
+    for (view *v = player_list; v; v = v->next)
+        n++;
+    return n;
+}
+
+void dedicated_run(Game *g)
+{
+    // SDL installs its own handlers when the video starts, take them back
+    signal(SIGINT, dedicated_signal);
+    signal(SIGTERM, dedicated_signal);
+
+    printf("Dedicated: serving %s, %.0f ticks/sec\n",
+           current_level ? current_level->name() : "no level",
+           1000.0f / DEDICATED_TICK_MS);
+    fflush(stdout);
+
+    Timer tick_timer, stats_timer;
+    int ticks = 0;
+    float step_total = 0.0f, step_max = 0.0f;
+    float busy_total = 0.0f, busy_max = 0.0f;
+    int64_t last_in = net_bytes_in, last_out = net_bytes_out;
+
+    while (!g->done())
+    {
+        if (dedicated_stop)
+        {
+            printf("Dedicated: shutting down\n");
+            g->end_session();
+            break;
+        }
+
+        if (req_end)
+        {
+            // the end game sequence is drawn, there is nobody to show it to
+            printf("Dedicated: game over\n");
+            g->end_session();
+            break;
+        }
+
+        net_receive();
+
+        // same as the main loop, level loads are not followed by a redraw
+        if (req_name[0])
+        {
+            g->load_level(req_name);
+            req_name[0] = 0;
+        }
+
+        // no keyboard here, this only drains the event queue
+        g->get_input();
+        net_send();
+        service_net_request();
+
+        Timer step_timer;
+        g->step();
+        server_check();
+        float step_ms = step_timer.GetMs();
+
+        // time spent waiting for the clients is counted in the tick time,
+        // so a slow client shows up here as well
+        float busy_ms = tick_timer.PollMs();
+        tick_timer.WaitMs(DEDICATED_TICK_MS);
+        tick_timer.GetMs();
+
+        ticks++;
+        step_total += step_ms;
+        step_max = Max(step_max, step_ms);
+        busy_total += busy_ms;
+        busy_max = Max(busy_max, busy_ms);
+
+        float elapsed = stats_timer.PollMs();
+        if (elapsed >= DEDICATED_STATS_SECS * 1000.0f)
+        {
+            stats_timer.GetMs();
+            float secs = elapsed / 1000.0f;
+            printf("Dedicated: tick %u, %.1f ticks/sec, step %.2f/%.2f ms, "
+                   "tick %.2f/%.2f ms (avg/max), %d players, "
+                   "in %.1f KB/s, out %.1f KB/s\n",
+                   current_level ? current_level->tick_counter() : 0,
+                   ticks / secs, step_total / ticks, step_max,
+                   busy_total / ticks, busy_max, count_players(),
+                   (net_bytes_in - last_in) / 1024.0f / secs,
+                   (net_bytes_out - last_out) / 1024.0f / secs);
+            fflush(stdout);
+
+            ticks = 0;
+            step_total = step_max = busy_total = busy_max = 0.0f;
+            last_in = net_bytes_in;
+            last_out = net_bytes_out;
+        }
+    }
+}
@@ -0,0 +1,29 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __DEDICATED_H__
+#define __DEDICATED_H__
+
+class Game;
+
+// Headless network server, used with:
+//   abuse -dedicated [-server <name>] [-port N] [-min_players N] [-f level]
+// The game server, the level and the file server run as usual but no
+// window is opened, no sound is loaded and nothing is drawn. Every few
+// seconds a stats line with the tick time, the number of players and the
+// network traffic is printed on stdout.
+
+// Called early in main(), before the video is set up
+void dedicated_start(int argc, char **argv);
+int dedicated_active();
+// Replaces the main loop, returns when the game ends or on SIGINT/SIGTERM
+void dedicated_run(Game *g);
+
+#endif // __DEDICATED_H__
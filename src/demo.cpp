@@ -12,6 +12,8 @@
 #   include "config.h"
 #endif
 
+#include <unistd.h>
+
 #include "common.h"
 
 #include "game.h"
@@ -25,6 +27,7 @@
 #include "lisp.h"
 #include "clisp.h"
 #include "netface.h"
+#include "nfserver.h"
 
 
 demo_manager demo_man;
@@ -37,13 +40,28 @@ extern void net_send(int force);
 extern void fade_in(image *im, int steps);
 extern void fade_out(int steps);
 
+// version 3 record types
+enum { DEMO_REPEAT,      // 1 byte count, last packet is repeated count times
+       DEMO_DELTA,       // 2 byte size, then (same count, new count, new bytes) runs
+       DEMO_KEYFRAME,    // 4 byte tick, 4 byte size, savegame
+       DEMO_INDEX        // 4 byte total, then (tick, offset) for each keyframe
+     };
+
+#define DEMO_INDEX_MAGIC "DIDX"          // trails the index offset at end of file
+#define DEMO_KEYFRAME_FILE "demokey.spe" // scratch savegame for keyframes
+
 void get_event(event &ev)
 { wm->get_event(ev);
   switch (ev.type)
   {
     case EV_KEY :
     {
-      if (demo_man.state==demo_manager::PLAYING)
+      if (demo_man.state==demo_manager::PLAYING && ev.key==JK_PAGEDOWN)
+        demo_man.request_seek(demo_man.current_tick()+DEMO_KEYFRAME_TICKS);
+      else if (demo_man.state==demo_manager::PLAYING && ev.key==JK_PAGEUP)
+        demo_man.request_seek(demo_man.current_tick()>DEMO_KEYFRAME_TICKS ?
+                              demo_man.current_tick()-DEMO_KEYFRAME_TICKS : 0);
+      else if (demo_man.state==demo_manager::PLAYING)
         demo_man.set_state(demo_manager::NORMAL);
       else if (ev.key==JK_ENTER && demo_man.state==demo_manager::RECORDING)
       {
@@ -74,7 +92,8 @@ int demo_manager::start_recording(char *filename)
   strcpy(name,current_level->name());
 
   the_game->load_level(name);
-  record_file->write((void *)"DEMO,VERSION:2",14);
+  current_level->load_all_regions();
+  record_file->write("DEMO,VERSION:3",14);
   record_file->write_uint8(strlen(name)+1);
   record_file->write(name,strlen(name)+1);
 
@@ -87,6 +106,11 @@ int demo_manager::start_recording(char *filename)
     else record_file->write_uint8(3);
   } else record_file->write_uint8(3);
 
+  version=3;
+  last_size=0;
+  packet_on=0;
+  repeat_count=0;
+  clear_index();
 
   state=RECORDING;
 
@@ -109,12 +133,22 @@ void demo_manager::do_inputs()
 
       base->packet.write_uint8(SCMD_SYNC);
       base->packet.write_uint16(make_sync());
+      if (!sync64_disabled)
+        write_sync64(&base->packet,client_number());
       demo_man.save_packet(base->packet.packet_data(),base->packet.packet_size());
       process_packet_commands(base->packet.packet_data(),base->packet.packet_size());
 
     } break;
     case PLAYING :
     {
+      if (seek_request>=0)
+      {
+        uint32_t tick=seek_request;
+        seek_request=-1;
+        if (!seek(tick) || state!=PLAYING)
+          return ;
+      }
+
       uint8_t buf[1500];
       int size;
       if (get_packet(buf,size))              // get starting inputs
@@ -156,12 +190,22 @@ int demo_manager::start_playing(char *filename)
   if (record_file->open_failure()) { delete record_file; return 0; }
   char name[100],nsize,diff;
   if (record_file->read(sig,14)!=14        ||
-      memcmp(sig,"DEMO,VERSION:2",14)!=0   ||
+      (memcmp(sig,"DEMO,VERSION:2",14)!=0 &&
+       memcmp(sig,"DEMO,VERSION:3",14)!=0) ||
       record_file->read(&nsize,1)!=1       ||
       record_file->read(name,nsize)!=nsize ||
       record_file->read(&diff,1)!=1)
   { delete record_file; return 0; }
 
+  version=sig[13]-'0';
+  last_size=0;
+  packet_on=0;
+  repeat_count=0;
+  seek_request=-1;
+  clear_index();
+  if (version>=3)
+    read_index();    // a demo without an index still plays, it just can't seek
+
   char tname[100],*c;
   strcpy(tname,name);
   c=tname;
@@ -172,6 +216,7 @@ int demo_manager::start_playing(char *filename)
   delete probe;
 
   the_game->load_level(tname);
+  current_level->load_all_regions();
   initial_difficulty = l_difficulty;
 
   switch (diff)
@@ -190,6 +235,197 @@ int demo_manager::start_playing(char *filename)
   return 1;
 }
 
+void demo_manager::clear_index()
+{
+  free(index_tick);
+  free(index_offset);
+  index_tick=index_offset=NULL;
+  index_total=0;
+}
+
+// the index is found through the offset stored just before the
+// trailing magic, the file position is restored afterwards
+int demo_manager::read_index()
+{
+  int32_t data_start=record_file->tell(),size=record_file->file_size();
+  uint8_t magic[4];
+
+  if (size<data_start+8)
+    return 0;
+  record_file->seek(8,SEEK_END);
+  int32_t offset=record_file->read_uint32();
+  if (record_file->read(magic,4)!=4 || memcmp(magic,DEMO_INDEX_MAGIC,4)!=0 ||
+      offset<data_start || offset>size-13)
+  {
+    record_file->seek(data_start,SEEK_SET);
+    return 0;
+  }
+
+  record_file->seek(offset,SEEK_SET);
+  if (record_file->read_uint8()==DEMO_INDEX)
+  {
+    // the entries have to fit between the index header and the offset
+    int32_t total=record_file->read_uint32();
+    if (total<0 || total>(size-offset-13)/8)
+    {
+      record_file->seek(data_start,SEEK_SET);
+      return 0;
+    }
+    index_tick=(int32_t *)malloc(sizeof(int32_t)*total);
+    index_offset=(int32_t *)malloc(sizeof(int32_t)*total);
+    if (total && (!index_tick || !index_offset))
+    {
+      clear_index();
+      record_file->seek(data_start,SEEK_SET);
+      return 0;
+    }
+    for (index_total=0; index_total<total; index_total++)
+    {
+      index_tick[index_total]=record_file->read_uint32();
+      index_offset[index_total]=record_file->read_uint32();
+    }
+  }
+
+  record_file->seek(data_start,SEEK_SET);
+  return index_total;
+}
+
+// saves the current level as a savegame and embeds it in the demo, seeking
+// to a tick resumes from the closest keyframe before it
+int demo_manager::write_keyframe()
+{
+  if (!flush_repeats())
+    return 0;
+
+  if (!current_level->save(DEMO_KEYFRAME_FILE,1))
+    return 0;
+
+  char name[255];
+  sprintf(name,"%s%s",get_save_filename_prefix(),DEMO_KEYFRAME_FILE);
+  bFILE *fp=open_file(name,"rb");
+  if (fp->open_failure())
+  {
+    delete fp;
+    return 0;
+  }
+
+  index_tick=(int32_t *)realloc(index_tick,sizeof(int32_t)*(index_total+1));
+  index_offset=(int32_t *)realloc(index_offset,sizeof(int32_t)*(index_total+1));
+  index_tick[index_total]=packet_on;
+  index_offset[index_total]=record_file->tell();
+  index_total++;
+
+  int32_t size=fp->file_size();
+  record_file->write_uint8(DEMO_KEYFRAME);
+  record_file->write_uint32(packet_on);
+  record_file->write_uint32(size);
+
+  uint8_t buf[0x1000];
+  int ret=1;
+  while (size && ret)
+  {
+    int tr=fp->read(buf,size<0x1000 ? size : 0x1000);
+    if (tr<=0 || record_file->write(buf,tr)!=tr)
+      ret=0;
+    size-=tr;
+  }
+  delete fp;
+  unlink(name);
+
+  last_size=0;    // the next packet is stored against an empty one
+  return ret;
+}
+
+int demo_manager::flush_repeats()
+{
+  if (!repeat_count)
+    return 1;
+
+  uint8_t rec[2]={ DEMO_REPEAT, (uint8_t)repeat_count };
+  repeat_count=0;
+  return record_file->write(rec,2)==2;
+}
+
+// loads the keyframe at the current file position
+int demo_manager::load_keyframe()
+{
+  if (record_file->read_uint8()!=DEMO_KEYFRAME)
+    return 0;
+  uint32_t tick=record_file->read_uint32();
+  int32_t size=record_file->read_uint32();
+
+  char name[255];
+  sprintf(name,"%s%s",get_save_filename_prefix(),DEMO_KEYFRAME_FILE);
+  bFILE *fp=open_file(name,"wb");
+  if (fp->open_failure())
+  {
+    delete fp;
+    return 0;
+  }
+
+  uint8_t buf[0x1000];
+  int ret=1;
+  while (size && ret)
+  {
+    int tr=record_file->read(buf,size<0x1000 ? size : 0x1000);
+    if (tr<=0 || fp->write(buf,tr)!=tr)
+      ret=0;
+    size-=tr;
+  }
+  delete fp;
+
+  if (ret)
+  {
+    char *level_name=strdup(current_level->name());
+    the_game->load_level(name);
+    current_level->set_name(level_name);
+    free(level_name);
+
+    packet_on=tick;
+    last_size=0;
+    repeat_count=0;
+  }
+  unlink(name);
+  return ret;
+}
+
+int demo_manager::seek(uint32_t tick)
+{
+  if (state!=PLAYING || !index_total)
+    return 0;
+
+  int k=-1;
+  for (int i=0; i<index_total; i++)
+    if ((uint32_t)index_tick[i]<=tick)
+      k=i;
+  if (k<0)
+    return 0;
+
+  // only reload if going back or if a keyframe is closer than we are
+  if (tick<packet_on || (uint32_t)index_tick[k]>packet_on)
+  {
+    record_file->seek(index_offset[k],SEEK_SET);
+    if (!load_keyframe())
+    {
+      set_state(NORMAL);
+      return 0;
+    }
+  }
+
+  // run the remaining ticks without sound or drawing
+  int old_sound=sound_avail;
+  sound_avail&=~SFX_INITIALIZED;
+  while (packet_on<tick && state==PLAYING)
+  {
+    do_inputs();
+    if (state==PLAYING)
+      the_game->step();
+  }
+  sound_avail=old_sound;
+
+  return state==PLAYING;
+}
+
 int demo_manager::set_state(demo_state new_state, char *filename)
 {
   if (new_state==state) return 1;
@@ -197,7 +433,22 @@ int demo_manager::set_state(demo_state new_state, char *filename)
   switch (state)
   {
     case RECORDING :
-    { delete record_file; } break;
+    {
+      // write the keyframe index and the trailer pointing to it
+      flush_repeats();
+      int32_t offset=record_file->tell();
+      record_file->write_uint8(DEMO_INDEX);
+      record_file->write_uint32(index_total);
+      for (int i=0; i<index_total; i++)
+      {
+        record_file->write_uint32(index_tick[i]);
+        record_file->write_uint32(index_offset[i]);
+      }
+      record_file->write_uint32(offset);
+      record_file->write(DEMO_INDEX_MAGIC,4);
+      delete record_file;
+      clear_index();
+    } break;
     case PLAYING :
     {
 /*
@@ -206,6 +457,7 @@ int demo_manager::set_state(demo_state new_state, char *filename)
       fade_out(8);
 */
       delete record_file;
+      clear_index();
       l_difficulty = initial_difficulty;
       the_game->set_state(MENU_STATE);
       wm->push_event(new event(ID_NULL,NULL));
@@ -241,9 +493,53 @@ int demo_manager::save_packet(void *packet, int packet_size)   // returns non 0
 {
   if (state==RECORDING)
   {
-    uint16_t ps=lstl(packet_size);
-    if (record_file->write(&ps,2)!=2 ||
-    record_file->write(packet,packet_size)!=packet_size)
+    uint8_t *pk=(uint8_t *)packet;
+
+    if (packet_on%DEMO_KEYFRAME_TICKS==0 && !write_keyframe())
+    {
+      set_state(NORMAL);
+      return 0;
+    }
+    packet_on++;
+
+    if (packet_size==last_size && !memcmp(pk,last_packet,packet_size))
+    {
+      if (repeat_count==255 && !flush_repeats())
+      {
+        set_state(NORMAL);
+        return 0;
+      }
+      repeat_count++;
+      return 1;
+    }
+
+    // encode as runs of unchanged bytes followed by runs of new bytes,
+    // bytes past the end of the last packet compare against zero
+    uint8_t rec[3+PACKET_MAX_SIZE*2],*r=rec;
+    *(r++)=DEMO_DELTA;
+    *(r++)=packet_size&0xff;
+    *(r++)=packet_size>>8;
+    int i=0;
+    while (i<packet_size)
+    {
+      int same=0,diff=0;
+      while (i<packet_size && same<255 &&
+             pk[i]==(i<last_size ? last_packet[i] : 0))
+      { same++; i++; }
+      while (i+diff<packet_size && diff<255 &&
+             pk[i+diff]!=(i+diff<last_size ? last_packet[i+diff] : 0))
+        diff++;
+      *(r++)=same;
+      *(r++)=diff;
+      memcpy(r,pk+i,diff);
+      r+=diff;
+      i+=diff;
+    }
+
+    memcpy(last_packet,pk,packet_size);
+    last_size=packet_size;
+
+    if (!flush_repeats() || record_file->write(rec,r-rec)!=r-rec)
     {
       set_state(NORMAL);
       return 0;
@@ -254,7 +550,7 @@ int demo_manager::save_packet(void *packet, int packet_size)   // returns non 0
 
 int demo_manager::get_packet(void *packet, int &packet_size)   // returns non 0 if actually loaded
 {
-  if (state==PLAYING)
+  if (state==PLAYING && version<3)
   {
     uint16_t ps;
     if (record_file->read(&ps,2)!=2)
@@ -271,8 +567,62 @@ int demo_manager::get_packet(void *packet, int &packet_size)   // returns non 0
     }
 
     packet_size=ps;
+    packet_on++;
+    return 1;
+  }
+  else if (state==PLAYING)
+  {
+    while (!repeat_count)
+    {
+      uint8_t type;
+      if (record_file->read(&type,1)!=1)
+        break;
+
+      if (type==DEMO_REPEAT)
+        repeat_count=record_file->read_uint8();
+      else if (type==DEMO_KEYFRAME)
+      {
+        // only needed when seeking
+        record_file->read_uint32();
+        int32_t size=record_file->read_uint32();
+        record_file->seek(size,SEEK_CUR);
+        last_size=0;
+      }
+      else if (type==DEMO_DELTA)
+      {
+        int size=record_file->read_uint16(),i=0;
+        if (size>PACKET_MAX_SIZE)
+          break;
+        if (size>last_size)
+          memset(last_packet+last_size,0,size-last_size);
+        while (i<size)
+        {
+          int same=record_file->read_uint8();
+          int diff=record_file->read_uint8();
+          i+=same;
+          if (i+diff>size || record_file->read(last_packet+i,diff)!=diff)
+            break;
+          i+=diff;
+        }
+        if (i!=size)
+          break;
+        last_size=size;
+        repeat_count=1;
+      }
+      else break;    // DEMO_INDEX marks the end of the recording
+    }
+
+    if (!repeat_count)
+    {
+      set_state(NORMAL);
+      return 0;
+    }
+
+    repeat_count--;
+    memcpy(packet,last_packet,last_size);
+    packet_size=last_size;
+    packet_on++;
     return 1;
   }
   return 0;
 }
-
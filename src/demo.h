@@ -13,6 +13,13 @@
 
 #include "lisp.h"
 #include "jwindow.h"
+#include "netface.h"
+
+// Version 3 demos store each tick's input packet as a delta against the
+// previous one (with runs of identical packets collapsed), embed a full
+// savegame every DEMO_KEYFRAME_TICKS ticks and end with a tick->offset
+// index of those keyframes so that playback can seek.
+#define DEMO_KEYFRAME_TICKS 450
 
 class demo_manager
 {
@@ -20,6 +27,21 @@ class demo_manager
   bFILE *record_file;
   int skip_next;
 
+  int version;                           // 2 = raw packets, 3 = delta packets
+  uint8_t last_packet[PACKET_MAX_SIZE];  // previous packet, deltas apply to it
+  int last_size;
+  uint32_t packet_on;                    // packets saved or loaded so far
+  int repeat_count;                      // identical packets not yet written/read
+  int32_t *index_tick,*index_offset;     // keyframe index
+  int index_total;
+  int32_t seek_request;                  // tick to seek to on next input, or -1
+
+  int write_keyframe();
+  int load_keyframe();
+  int flush_repeats();
+  int read_index();
+  void clear_index();
+
   public :
   enum demo_state { NORMAL,
             RECORDING,
@@ -28,12 +50,17 @@ class demo_manager
   demo_state current_state() { return state; }
   int save_packet(void *packet, int packet_size);   // returns non 0 if actually saved
   int get_packet(void *packet, int &packet_size);   // returns non 0 if actually loaded
+  int seek(uint32_t tick);                          // returns non 0 if playback is now at tick
+  void request_seek(uint32_t tick) { seek_request=tick; }
+  uint32_t current_tick() { return packet_on; }
 
   int start_playing(char *filename);
   int start_recording(char *filename);
   void reset_game();
   int demo_skip() { if (skip_next) { skip_next--; return 1; } else return 0; }
-  demo_manager() { state=NORMAL; skip_next=0; }
+  demo_manager() { state=NORMAL; skip_next=0; version=3; last_size=0; packet_on=0;
+                   repeat_count=0; index_tick=index_offset=NULL; index_total=0;
+                   seek_request=-1; }
   void do_inputs();
 } ;
 
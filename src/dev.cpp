@@ -37,6 +37,8 @@
 #include "sbar.h"
 #include "compiled.h"
 #include "chat.h"
+#include "pixpool.h"
+#include "nativeai.h"
 
 #define make_above_tile(x) ((x)|0x4000)
 char backw_on=0,forew_on=0,show_menu_on=0,ledit_on=0,pmenu_on=0,omenu_on=0,commandw_on=0,tbw_on=0,
@@ -874,6 +876,14 @@ void dev_init(int argc, char **argv)
       start_doubled=1;
     else if (!strcmp(argv[i],"-demo"))
       demo_start=1;
+    else if (!strcmp(argv[i],"-levelv2"))
+      level_save_v2=1;
+    else if (!strcmp(argv[i],"-loadtimes"))
+      level_load_times=1;
+    else if (!strcmp(argv[i],"-raycheck"))
+      raycast_check=1;
+    else if (!strcmp(argv[i],"-aicheck"))
+      native_ai_check=1;
 
   }
 
@@ -1879,16 +1889,14 @@ void dev_controll::handle_event(event &ev)
           the_game->ftile_on(last_demo_mx,last_demo_my,xs,ys);
           if (xs>=0 && ys>=0 && xs<current_level->foreground_width() &&
           ys<current_level->foreground_height())
-          current_level->put_fg(xs,ys,raise_all ? make_above_tile(cur_fg) : cur_fg);
-          the_game->need_refresh();
+          the_game->put_fg(xs,ys,raise_all ? make_above_tile(cur_fg) : cur_fg);
         } else if (ev.mouse_button==1 && !selected_object && !selected_light)
         {
           int32_t xs,ys;
           the_game->btile_on(last_demo_mx,last_demo_my,xs,ys);
           if (xs>=0 && ys>=0 && xs<current_level->background_width() &&
           ys<current_level->background_height())
-          current_level->put_bg(xs,ys,cur_fg);
-          the_game->need_refresh();
+          the_game->put_bg(xs,ys,cur_fg);
         }
       } else if (edit_mode==ID_DMODE_AREA)
         area_handle_input(ev);
@@ -3220,15 +3228,27 @@ int dev_controll::is_pal_win(Jwindow *win)
 }
 
 
-class fill_rec
+// Seeds waiting to be filled by fg_fill(), kept from one fill to the next
+struct fill_seed
 {
-public :
   short x,y;
-  fill_rec *last;
-  fill_rec(short X, short Y, fill_rec *Last)
-  { x=X; y=Y; last=Last; }
 } ;
 
+static fill_seed *fill_stack=NULL;
+static int fill_top=0,fill_size=0;
+
+static inline void push_fill(int x, int y)
+{
+  if (fill_top==fill_size)
+  {
+    fill_size=fill_size ? fill_size*2 : 1024;
+    fill_stack=(fill_seed *)realloc(fill_stack,sizeof(fill_seed)*fill_size);
+  }
+  fill_stack[fill_top].x=x;
+  fill_stack[fill_top].y=y;
+  fill_top++;
+}
+
 static int get_color(int color, int x, int y, pal_win *p)
 {
   if (p)
@@ -3243,83 +3263,85 @@ static int get_color(int color, int x, int y, pal_win *p)
 void dev_controll::fg_fill(int color, int x, int y, pal_win *p)
 {
   unsigned short *sl,*above,*below;
-  fill_rec *recs=NULL,*r;
   unsigned short fcolor;
   sl=current_level->get_fgline(y);
   fcolor=fgvalue(sl[x]);
   int startx=x,starty=y;
   if (fcolor==color) return ;
+
+  Timer fill_timer;
+  int fw=current_level->foreground_width(),fh=current_level->foreground_height();
+  int x1=x,y1=y,x2=x,y2=y,tiles=0;
+  if (fill_size<fw*2)
+  {
+    fill_size=fw*2;
+    fill_stack=(fill_seed *)realloc(fill_stack,sizeof(fill_seed)*fill_size);
+  }
+  fill_top=0;
+
   do
   {
-    if (recs)
-    { r=recs;
-      recs=recs->last;
-      x=r->x; y=r->y;
-      delete r;
+    if (fill_top)
+    {
+      fill_top--;
+      x=fill_stack[fill_top].x; y=fill_stack[fill_top].y;
     }
     sl=current_level->get_fgline(y);
     if (fgvalue(sl[x])==fcolor)
     {
       while (x>0 && fgvalue(sl[x])==fcolor) x--;
-      if (fgvalue(sl[x])!=fgvalue(fcolor) && x<current_level->foreground_width()-1) x++;
+      if (fgvalue(sl[x])!=fgvalue(fcolor) && x<fw-1) x++;
       if (y>0)
       {
         above=current_level->get_fgline(y-1);
         if (fgvalue(above[x])==fcolor)
-        { r=new fill_rec(x,y-1,recs);
-          recs=r;
-        }
+          push_fill(x,y-1);
       }
-      if (y<current_level->foreground_height()-1)
+      if (y<fh-1)
       {
         above=current_level->get_fgline(y+1);
         if (above[x]==fcolor)
-        { r=new fill_rec(x,y+1,recs);
-          recs=r;
-        }
+          push_fill(x,y+1);
       }
 
-
+      x1=Min(x1,x); y1=Min(y1,y); y2=Max(y2,y);
 
       do
       {
-        sl[x]=get_color(color,x-startx,y-starty,p);
+        // put_fg() so the raycast memos see the change
+        current_level->put_fg(x,y,get_color(color,x-startx,y-starty,p));
+        tiles++;
         if (y>0)
         { above=current_level->get_fgline(y-1);
           if (x>0 && fgvalue(above[x-1])!=fgvalue(fcolor) && fgvalue(above[x])==fgvalue(fcolor))
-          { r=new fill_rec(x,y-1,recs);
-            recs=r;
-          }
+            push_fill(x,y-1);
         }
-        if (y<current_level->foreground_height()-1)
+        if (y<fh-1)
         { below=current_level->get_fgline(y+1);
           if (x>0 && fgvalue(below[x-1])!=fgvalue(fcolor) && fgvalue(below[x])==fgvalue(fcolor))
-          { r=new fill_rec(x,y+1,recs);
-            recs=r;
-          }
+            push_fill(x,y+1);
         }
         x++;
-      } while (fgvalue(sl[x])==fgvalue(fcolor) && x<current_level->foreground_width());
+      } while (fgvalue(sl[x])==fgvalue(fcolor) && x<fw);
       x--;
+      x2=Max(x2,x);
       if (y>0)
       {
         above=current_level->get_fgline(y-1);
         if (fgvalue(above[x])==fgvalue(fcolor))
-        { r=new fill_rec(x,y-1,recs);
-          recs=r;
-        }
+          push_fill(x,y-1);
       }
-      if (y<current_level->foreground_height()-1)
+      if (y<fh-1)
       {
         above=current_level->get_fgline(y+1);
         if (fgvalue(above[x])==fgvalue(fcolor))
-        { r=new fill_rec(x,y+1,recs);
-          recs=r;
-        }
+          push_fill(x,y+1);
       }
     }
-  } while (recs);
-  the_game->need_refresh();
+  } while (fill_top);
+
+  the_game->note_fill_time(fill_timer.GetMs());
+  the_game->mark_fg_edit(x1,y1,x2,y2,tiles);
 }
 
 static int get_char_mem(int type, int print)
@@ -3394,6 +3416,13 @@ void dev_controll::show_mem()
   }
   dprintf("%d character=%d bytes\n",t,s);
 
+  dprintf("%d images\n",image_count());
+  pixel_pool_report();
+
+  pool_stats const &p=pool_counts();
+  dprintf("objects: %d live, %d at most, %d of %d allocations from pools\n",
+          p.live,p.peak,p.blocks-p.mallocs,p.blocks);
+
 }
 
 
@@ -58,7 +58,7 @@ void simple_object::add_light(light_source *ls)
   ls->known=1;
   for (int i=0; i<tlights; i++) if (lights[i]==ls) return;
   tlights++;
-  lights=(light_source **)realloc(lights,sizeof(light_source *)*tlights);
+  lights=(light_source **)pool_resize_array(lights,sizeof(light_source *)*tlights);
   lights[tlights-1]=ls;
 }
 
@@ -72,7 +72,7 @@ void simple_object::add_object(game_object *o)
   if(_tint != -1)
     o->set_tint(_tint);
   tobjs++;
-  objs=(game_object **)realloc(objs,sizeof(game_object *)*tobjs);
+  objs=(game_object **)pool_resize_array(objs,sizeof(game_object *)*tobjs);
   objs[tobjs-1]=o;
 }
 
@@ -86,7 +86,7 @@ void simple_object::remove_light(light_source *ls)
       tlights--;
       for (int j=i; j<tlights; j++)     // don't even think about it :)
         lights[j]=lights[j+1];
-      lights=(light_source **)realloc(lights,sizeof(light_source *)*tlights);
+      lights=(light_source **)pool_resize_array(lights,sizeof(light_source *)*tlights);
       return ;
     }
   }
@@ -101,7 +101,7 @@ void simple_object::remove_object(game_object *o)
       tobjs--;
       for (int j=i; j<tobjs; j++)     // don't even think about it :)
         objs[j]=objs[j+1];
-      objs=(game_object **)realloc(objs,sizeof(game_object *)*tobjs);
+      objs=(game_object **)pool_resize_array(objs,sizeof(game_object *)*tobjs);
       return ;
     }
   }
@@ -129,14 +129,19 @@ simple_object::simple_object()
   mc=NULL;
   Controller=NULL;
 
-  Flags=0;
-  Xvel=Yvel=Xacel=Yacel=0;
-  Fx=Fy=Fxvel=Fyvel=Fxacel=Fyacel=Aitype=0;
+#if defined HAVE_SOA
+  hot_slot=hot_slot_get();
+#endif
+  HOT(flags, Flags)=0;
+  HOT(xvel, Xvel)=HOT(yvel, Yvel)=HOT(xacel, Xacel)=HOT(yacel, Yacel)=0;
+  HOT(fx, Fx)=HOT(fy, Fy)=HOT(fxvel, Fxvel)=HOT(fyvel, Fyvel)=0;
+  HOT(fxacel, Fxacel)=HOT(fyacel, Fyacel)=0;
+  Aitype=0;
   Aistate=Aistate_time=0;
   Hp=Mp=Fmp=0;
   _tint = -1;
   _team = -1;
-  grav_on=1;
+  HOT(grav, grav_on)=1;
   targetable_on=1;
 }
 
@@ -149,8 +154,11 @@ void simple_object::set_morph_status(morph_char *Mc)
 
 void simple_object::clean_up()
 {
-  if (tlights) free(lights);
-  if (tobjs)   free(objs);
+  pool_put_array(lights);
+  pool_put_array(objs);
+#if defined HAVE_SOA
+  hot_slot_put(hot_slot);
+#endif
   if (Controller)
     Controller->focus=NULL;
 }
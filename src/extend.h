@@ -22,6 +22,7 @@
 
 #include "morpher.h"
 #include "chars.h"
+#include "hotstate.h"
 
 
 class view;
@@ -33,9 +34,14 @@ class simple_object
 public:
   int8_t Fade_dir;
   uint8_t Fade_count,Fade_max;
-  uint8_t Flags,grav_on,targetable_on;
+  uint8_t targetable_on;
+#if defined HAVE_SOA
+  int hot_slot;                    // index in the hot_store arrays
+#else
+  uint8_t Flags,grav_on;
   int32_t Xvel,Yvel,Xacel,Yacel;
   uint8_t Fx,Fy,Fxvel,Fyvel,Fxacel,Fyacel;
+#endif
   uint8_t Aitype;
   uint16_t Aistate,Aistate_time;
   uint16_t Hp,Mp,Fmp;
@@ -64,29 +70,29 @@ public:
   short current_frame;
 
   int targetable()           { return targetable_on; }
-  int gravity()              { return grav_on; }
+  int gravity()              { return HOT(grav, grav_on); }
   int floating()             { return flags()&FLOATING_FLAG; }
 
   int keep_ai_info()         { return 1; }
-  uint8_t flags()            { return Flags; }
-  int32_t xvel()             { return Xvel; }
-  int32_t yvel()             { return Yvel; }
-  int32_t xacel()            { return Xacel; }
-  int32_t yacel()            { return Yacel; }
-
-  uint8_t fx()               { return Fx; }
-  uint8_t fy()               { return Fy; }
-  uint8_t fxvel()            { return Fxvel; }
-  uint8_t fyvel()            { return Fyvel; }
-  uint8_t fxacel()           { return Fxacel; }
-  uint8_t fyacel()           { return Fyacel; }
-
-  uint8_t sfx()              { return Fx; }  // x & y should always be positive
-  uint8_t sfy()              { return Fy; }
-  uint8_t sfxvel()           { if (Xvel>=0) return Fxvel; else return -Fxvel; }
-  uint8_t sfyvel()           { if (Yvel>=0) return Fyvel; else return -Fyvel; }
-  uint8_t sfxacel()          { if (Xacel>=0) return Fxacel; else return -Fxacel; }
-  uint8_t sfyacel()          { if (Yacel>=0) return Fyacel; else return -Fyacel; }
+  uint8_t flags()            { return HOT(flags, Flags); }
+  int32_t xvel()             { return HOT(xvel, Xvel); }
+  int32_t yvel()             { return HOT(yvel, Yvel); }
+  int32_t xacel()            { return HOT(xacel, Xacel); }
+  int32_t yacel()            { return HOT(yacel, Yacel); }
+
+  uint8_t fx()               { return HOT(fx, Fx); }
+  uint8_t fy()               { return HOT(fy, Fy); }
+  uint8_t fxvel()            { return HOT(fxvel, Fxvel); }
+  uint8_t fyvel()            { return HOT(fyvel, Fyvel); }
+  uint8_t fxacel()           { return HOT(fxacel, Fxacel); }
+  uint8_t fyacel()           { return HOT(fyacel, Fyacel); }
+
+  uint8_t sfx()              { return HOT(fx, Fx); }  // x & y should always be positive
+  uint8_t sfy()              { return HOT(fy, Fy); }
+  uint8_t sfxvel()           { if (HOT(xvel, Xvel)>=0) return HOT(fxvel, Fxvel); else return -HOT(fxvel, Fxvel); }
+  uint8_t sfyvel()           { if (HOT(yvel, Yvel)>=0) return HOT(fyvel, Fyvel); else return -HOT(fyvel, Fyvel); }
+  uint8_t sfxacel()          { if (HOT(xacel, Xacel)>=0) return HOT(fxacel, Fxacel); else return -HOT(fxacel, Fxacel); }
+  uint8_t sfyacel()          { if (HOT(yacel, Yacel)>=0) return HOT(fyacel, Fyacel); else return -HOT(fyacel, Fyacel); }
 
   uint8_t aitype()           { return Aitype; }
   uint16_t aistate()         { return Aistate; }
@@ -109,17 +115,17 @@ public:
   view *controller()             { return Controller; }
 
   void set_targetable(uint8_t x)  { targetable_on=x; }
-  void set_flags(uint8_t f)       { Flags=f; }
-  void set_xvel(int32_t xv)       { Xvel=xv; }
-  void set_yvel(int32_t yv)       { Yvel=yv; }
-  void set_xacel(int32_t xa)      { Xacel=xa; }
-  void set_yacel(int32_t ya)      { Yacel=ya; }
-  void set_fx(uint8_t x)          { Fx=x; }
-  void set_fy(uint8_t y)          { Fy=y; }
-  void set_fxvel(uint8_t xv)      { Fxvel=abs(xv); }
-  void set_fyvel(uint8_t yv)      { Fyvel=abs(yv); }
-  void set_fxacel(uint8_t xa)     { Fxacel=abs(xa); }
-  void set_fyacel(uint8_t ya)     { Fyacel=abs(ya); }
+  void set_flags(uint8_t f)       { HOT(flags, Flags)=f; }
+  void set_xvel(int32_t xv)       { HOT(xvel, Xvel)=xv; }
+  void set_yvel(int32_t yv)       { HOT(yvel, Yvel)=yv; }
+  void set_xacel(int32_t xa)      { HOT(xacel, Xacel)=xa; }
+  void set_yacel(int32_t ya)      { HOT(yacel, Yacel)=ya; }
+  void set_fx(uint8_t x)          { HOT(fx, Fx)=x; }
+  void set_fy(uint8_t y)          { HOT(fy, Fy)=y; }
+  void set_fxvel(uint8_t xv)      { HOT(fxvel, Fxvel)=abs(xv); }
+  void set_fyvel(uint8_t yv)      { HOT(fyvel, Fyvel)=abs(yv); }
+  void set_fxacel(uint8_t xa)     { HOT(fxacel, Fxacel)=abs(xa); }
+  void set_fyacel(uint8_t ya)     { HOT(fyacel, Fyacel)=abs(ya); }
   void set_aitype(uint8_t t)      { Aitype=t; }
   void set_aistate(uint16_t s)      { Aistate=s; }
   void set_aistate_time(uint16_t t) { Aistate_time=t; }
@@ -142,7 +148,7 @@ public:
   void set_morph_status(morph_char *mc);
   void set_controller(view *v)          { Controller=v; }
 
-  void set_gravity(int x)               { grav_on=x; }
+  void set_gravity(int x)               { HOT(grav, grav_on)=x; }
   void set_floating(int x)
   { if (x)
       set_flags(flags()|FLOATING_FLAG);
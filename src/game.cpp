@@ -58,6 +58,8 @@
 #include "chat.h"
 #include "demo.h"
 #include "netcfg.h"
+#include "replay.h"
+#include "dedicated.h"
 
 #define SHIFT_RIGHT_DEFAULT 0
 #define SHIFT_DOWN_DEFAULT 30
@@ -705,7 +707,7 @@ static void post_render()
   }
 }
 
-void Game::draw_map(view *v, int interpolate)
+void Game::draw_map(view *v, int interpolate, int32_t const *area)
 {
   backtile *bt;
   int x1, y1, x2, y2, x, y, xo, yo, nxoff, nyoff;
@@ -734,7 +736,9 @@ void Game::draw_map(view *v, int interpolate)
   // save the dirty rect routines some work by markinging evrything in the
   // view area dirty alreadt
 
-  if(small_render)
+  if(area)
+    screen->AddDirty(area[0], area[1], area[2] + 1, area[3] + 1);
+  else if(small_render)
     screen->AddDirty(v->cx1, v->cy1, (v->cx2 - v->cx1 + 1)*2 + v->cx1 + 1, v->cy1+(v->cy2 - v->cy1 + 1)*2 + 1);
   else
     screen->AddDirty(v->cx1, v->cy1, v->cx2 + 1, v->cy2 + 1);
@@ -787,7 +791,10 @@ void Game::draw_map(view *v, int interpolate)
   current_vxadd = xoff - v->cx1;
   current_vyadd = yoff - v->cy1;
 
-  screen->SetClip(v->cx1, v->cy1, v->cx2 + 1, v->cy2 + 1);
+  if(area)
+    screen->SetClip(area[0], area[1], area[2] + 1, area[3] + 1);
+  else
+    screen->SetClip(v->cx1, v->cy1, v->cx2 + 1, v->cy2 + 1);
 
   nxoff = xoff * bg_xmul / bg_xdiv;
   nyoff = yoff * bg_ymul / bg_ydiv;
@@ -1094,9 +1101,16 @@ void Game::draw_map(view *v, int interpolate)
       } else
       {
     screen->dirt_on();
+    // the light is computed from the top left corner of the clip
+    int32_t lx = xoff, ly = yoff;
+    if(area)
+    {
+      lx += area[0] - v->cx1;
+      ly += area[1] - v->cy1;
+    }
     if(xres * yres <= 64000)
-          light_screen(screen, xoff, yoff, white_light, v->ambient);
-    else light_screen(screen, xoff, yoff, white_light, 63);            // no lighting for hi - rez
+          light_screen(screen, lx, ly, white_light, v->ambient);
+    else light_screen(screen, lx, ly, white_light, 63);            // no lighting for hi - rez
       }
 
     } else
@@ -1131,9 +1145,7 @@ void Game::put_fg(int x, int y, int type)
   if(current_level->get_fg(x, y)!=type)
   {
     current_level->put_fg(x, y, type);
-    for(view *f = first_view; f; f = f->next)
-      if(f->drawable())
-        draw_map(f);
+    mark_fg_edit(x, y, x, y);
   }
 }
 
@@ -1142,10 +1154,113 @@ void Game::put_bg(int x, int y, int type)
   if(current_level->get_bg(x, y)!=type)
   {
     current_level->put_bg(x, y, type);
-    for(view *f = first_view; f; f = f->next)
-      if(f->drawable())
-        draw_map(f);
+    mark_bg_edit(x, y, x, y);
+  }
+}
+
+static void grow_rect(int32_t *r, int x1, int y1, int x2, int y2)
+{
+  if(r[0] > r[2])
+  {
+    r[0] = x1; r[1] = y1; r[2] = x2; r[3] = y2;
+    return;
+  }
+  r[0] = Min(r[0], (int32_t)x1); r[1] = Min(r[1], (int32_t)y1);
+  r[2] = Max(r[2], (int32_t)x2); r[3] = Max(r[3], (int32_t)y2);
+}
+
+void Game::mark_fg_edit(int x1, int y1, int x2, int y2, int tiles)
+{
+  grow_rect(edit_fg, x1, y1, x2, y2);
+  edit_tiles += tiles;
+}
+
+void Game::mark_bg_edit(int x1, int y1, int x2, int y2, int tiles)
+{
+  grow_rect(edit_bg, x1, y1, x2, y2);
+  edit_tiles += tiles;
+}
+
+// Redraws the part of a view covered by the pending tile changes
+void Game::draw_edits(view *v)
+{
+  int32_t r[4] = { 1, 0, 0, 0 };
+  int32_t xoff = v->xoff(), yoff = v->yoff();
+
+  if(edit_fg[0] <= edit_fg[2])
+    grow_rect(r, v->cx1 + edit_fg[0] * ftile_width() - xoff,
+              v->cy1 + edit_fg[1] * ftile_height() - yoff,
+              v->cx1 + (edit_fg[2] + 1) * ftile_width() - xoff - 1,
+              v->cy1 + (edit_fg[3] + 1) * ftile_height() - yoff - 1);
+  if(edit_bg[0] <= edit_bg[2])
+  {
+    int32_t nxoff = xoff * bg_xmul / bg_xdiv, nyoff = yoff * bg_ymul / bg_ydiv;
+    grow_rect(r, v->cx1 + edit_bg[0] * btile_width() - nxoff,
+              v->cy1 + edit_bg[1] * btile_height() - nyoff,
+              v->cx1 + (edit_bg[2] + 1) * btile_width() - nxoff - 1,
+              v->cy1 + (edit_bg[3] + 1) * btile_height() - nyoff - 1);
+  }
+
+  // one more pixel around, the crosses on above tiles overhang them
+  r[0] = Max(r[0] - 1, v->cx1); r[1] = Max(r[1] - 1, v->cy1);
+  r[2] = Min(r[2] + 1, v->cx2); r[3] = Min(r[3] + 1, v->cy2);
+  if(r[0] > r[2] || r[1] > r[3])
+    return;
+
+  if(small_render || (dev & MAP_MODE) || v->draw_solid != -1
+      || ((dev & DRAW_LIGHTS) && light_detail != MEDIUM_DETAIL))
+  {
+    draw_map(v);
+    return;
+  }
+
+  // light_screen() works on 8x4 blocks lined up with the world horizontally
+  // and with the view vertically, keep them where a full redraw puts them.
+  // The block cut by the right edge depends on the left edge, so an area
+  // touching it is widened to the whole view width.
+  int32_t w = v->cx2 - v->cx1 + 1, h = v->cy2 - v->cy1 + 1;
+  int32_t x1 = r[0] - v->cx1, x2 = r[2] + 1 - v->cx1;
+  x1 -= (xoff + x1) & 7;
+  x2 += (8 - ((xoff + x2) & 7)) & 7;
+  if(x1 < 0)
+    x1 = 0;
+  if(x2 > w)
+  {
+    x1 = 0;
+    x2 = w;
   }
+  int32_t y1 = (r[1] - v->cy1) & ~3, y2 = Min((r[3] + 1 - v->cy1 + 3) & ~3, h);
+
+  int32_t area[4] = { v->cx1 + x1, v->cy1 + y1, v->cx1 + x2 - 1, v->cy1 + y2 - 1 };
+  draw_map(v, 0, area);
+}
+
+// Called once per frame in edit mode, drops the pending changes and shows
+// how long painting took once the editor has been idle for a moment
+void Game::finish_edits()
+{
+  if(edit_fg[0] <= edit_fg[2] || edit_bg[0] <= edit_bg[2])
+  {
+    edit_fg[0] = edit_bg[0] = 1;
+    edit_fg[2] = edit_bg[2] = 0;
+    edit_idle = 0;
+    return;
+  }
+
+  if(!edit_tiles || ++edit_idle < 8)
+    return;
+
+  char msg[100];
+  float each = edit_draw_ms / Max(1, edit_frames);
+  if(edit_fill_ms > 0.0f)
+    sprintf(msg, "%d tiles, fill %.2f ms, %d redraws %.2f ms each",
+            edit_tiles, edit_fill_ms, edit_frames, each);
+  else
+    sprintf(msg, "%d tiles, %d redraws %.2f ms each",
+            edit_tiles, edit_frames, each);
+  show_help(msg);
+  edit_tiles = edit_frames = edit_idle = 0;
+  edit_fill_ms = edit_draw_ms = 0.0f;
 }
 
 int Game::in_area(event &ev, int x1, int y1, int x2, int y2)
@@ -1179,7 +1294,7 @@ template<int N> static void Fade(image *im, int steps)
     {
         Timer frame;
         uint8_t *sl1 = (uint8_t *)pal->addr();
-        uint8_t *sl2 = (uint8_t *)old_pal->addr();
+        uint8_t const *sl2 = (uint8_t const *)old_pal->colors();
         int i = (int)(total.PollMs() / duration);
         int v = (N ? i + 1 : steps - i) * 256 / steps;
 
@@ -1346,6 +1461,11 @@ Game::Game(int argc, char **argv)
   old_view = first_view = NULL;
   nplayers = 1;
 
+  edit_fg[0] = edit_bg[0] = 1;
+  edit_fg[2] = edit_bg[2] = 0;
+  edit_tiles = edit_frames = edit_idle = 0;
+  edit_fill_ms = edit_draw_ms = 0.0f;
+
   help_text_frames = 0;
   strcpy(help_text, "");
 
@@ -1522,12 +1642,35 @@ void Game::show_time()
     if (!first_view || !fps_on)
         return;
 
-    char str[16];
+    char str[32];
     sprintf(str, "%ld", (long)(10000.0f / avg_ms));
     console_font->put_string(screen, first_view->cx1, first_view->cy1, str);
 
     sprintf(str, "%d", total_active);
     console_font->put_string(screen, first_view->cx1, first_view->cy1 + 10, str);
+
+    if (sound_avail & SFX_INITIALIZED)
+    {
+        // Voices played/culled/stolen during the last tick
+        sound_stats const &st = sound_get_stats();
+        sprintf(str, "%d/%d/%d", st.played, st.culled, st.stolen);
+        console_font->put_string(screen, first_view->cx1, first_view->cy1 + 20, str);
+    }
+
+    if (current_level)
+    {
+        // Lisp area/angle object queries during the last tick, and the
+        // objects they looked at
+        query_stats const &q = current_level->query_counts();
+        sprintf(str, "%d/%d", (int)q.calls, (int)q.examined);
+        console_font->put_string(screen, first_view->cx1, first_view->cy1 + 30, str);
+    }
+
+    // Lisp objects allocated during the last tick, and the numbers and
+    // characters that did not need to be
+    lisp_alloc_stats const &a = lisp_alloc_counts();
+    sprintf(str, "%d/%d", (int)a.allocs, (int)a.immediates);
+    console_font->put_string(screen, first_view->cx1, first_view->cy1 + 40, str);
 }
 
 void Game::update_screen()
@@ -1536,8 +1679,11 @@ void Game::update_screen()
     draw_help();
   else if(current_level)
   {
-    if(!(dev & EDIT_MODE) || refresh)
+    // in edit mode the views are only redrawn when something changed
+    int partial = (dev & EDIT_MODE) && !refresh;
+    if(!partial || edit_fg[0] <= edit_fg[2] || edit_bg[0] <= edit_bg[2])
     {
+      Timer edit_timer;
       view *f = first_view;
       current_level->clear_active_list();
       for(; f; f = f->next)
@@ -1557,7 +1703,9 @@ void Game::update_screen()
 
       for(f = first_view; f; f = f->next)
       {
-        if(f->drawable())
+        if(f->drawable() && partial)
+          draw_edits(f);
+        else if(f->drawable())
     {
       if(interpolate_draw)
       {
@@ -1569,7 +1717,15 @@ void Game::update_screen()
       }
       if(current_automap)
       current_automap->draw();
+
+      if(partial)
+      {
+        edit_draw_ms += edit_timer.GetMs();
+        edit_frames++;
+      }
     }
+    if(dev & EDIT_MODE)
+      finish_edits();
     if(state == PAUSE_STATE)
     {
       for(view *f = first_view; f; f = f->next)
@@ -1943,6 +2099,8 @@ void net_send(int force = 0)
 
       base->packet.write_uint8(SCMD_SYNC);
       base->packet.write_uint16(make_sync());
+      if(net_sync64())
+        write_sync64(&base->packet, client_number());
 
       if(base->join_list)
       base->packet.write_uint8(SCMD_RELOAD);
@@ -1983,6 +2141,7 @@ void net_receive()
 
 void Game::step()
 {
+  sound_frame();
   clear_tmp();
   if(current_level)
   {
@@ -2278,6 +2437,12 @@ void check_for_lisp(int argc, char **argv)
 {
     for(int i = 1; i < argc; i++)
     {
+        if(!strcmp(argv[i], "-lispbench"))
+        {
+            lisp_init();
+            lisp_benchmark();
+            exit(0);
+        }
         if(!strcmp(argv[i], "-lisp"))
         {
             lisp_init();
@@ -2424,11 +2589,23 @@ int main(int argc, char *argv[])
     set_dgetter(game_getter);
     set_no_space_handler(handle_no_space);
 
+#if !defined __CELLOS_LV2__
+    if (get_option("-nfsbench"))
+        nfs_benchmark(argc, argv);
+#endif
+
+    // Only the batch replay workers return from here
+    if (get_option("-demobatch"))
+        replay_batch_start(argc, argv);
+
+    dedicated_start(argc, argv);
+
     setup(argc, argv);
 
     show_startup();
 
-    start_sound(argc, argv);
+    if (!replay_batch_active() && !dedicated_active())
+        start_sound(argc, argv);
 
     stat_man = new text_status_manager();
 
@@ -2468,19 +2645,79 @@ int main(int argc, char *argv[])
 
         g->get_input(); // prime the net
 
+        if (get_option("-palbench"))
+        {
+            palette_benchmark(pal);
+            close_graphics();
+            exit(0);
+        }
+
+        if (get_option("-trigbench"))
+        {
+            trig_benchmark();
+            close_graphics();
+            exit(0);
+        }
+
+        for (int i = 1; i < argc; i++)
+        {
+            if (strcmp(argv[i], "-movebench"))
+                continue;
+            int count = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+            if (!current_level)
+                g->load_level(level_file);
+            mover_benchmark(count > 0 ? count : 2000, 60);
+            close_graphics();
+            exit(0);
+        }
+
+        for (int i = 1; i < argc; i++)
+        {
+            if (strcmp(argv[i], "-raytest"))
+                continue;
+            int count = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+            if (!current_level)
+                g->load_level(level_file);
+            int differ = current_level->check_raycasts(count > 0 ? count
+                                                                 : 100000);
+            close_graphics();
+            exit(Min(differ, 255));
+        }
+
+        for (int i = 1; i < argc; i++)
+        {
+            if (strcmp(argv[i], "-tickbench"))
+                continue;
+            if (!current_level)
+                g->load_level(level_file);
+            tick_benchmark(60);
+            close_graphics();
+            exit(0);
+        }
+
+        if (replay_batch_active())
+        {
+            int failed = replay_batch_run(g);
+            close_graphics();
+            exit(Min(failed, 255));
+        }
+
 #if !defined __CELLOS_LV2__
+        char server_name[] = "Abuse dedicated server";
+        char *become = dedicated_active() ? server_name : NULL;
         for (int i = 1; i + 1 < argc; i++)
         {
             if (!strcmp(argv[i], "-server"))
             {
-                if (!become_server(argv[i + 1]))
-                {
-                    dprintf("unable to become a server\n");
-                    exit(0);
-                }
+                become = argv[i + 1];
                 break;
             }
         }
+        if (become && !become_server(become))
+        {
+            dprintf("unable to become a server\n");
+            exit(0);
+        }
 
         if (main_net_cfg)
             wait_min_players();
@@ -2492,6 +2729,9 @@ int main(int argc, char *argv[])
             g->calc_speed();
             g->update_screen(); // redraw the screen with any changes
         }
+
+        if (dedicated_active())
+            dedicated_run(g);
 #endif
 
         while (!g->done())
@@ -2570,10 +2810,7 @@ int main(int argc, char *argv[])
 
         compiled_uninit();
         delete_all_lights();
-        free(white_light_initial);
-
-        for (int i = 0; i < TTINTS; i++)
-            free(tints[i]);
+        free_light_table();
 
         dev_cleanup();
         delete dev_cont; dev_cont = NULL;
@@ -79,6 +79,14 @@ private:
   JCFont *game_font;
   uint8_t keymap[512/8];
 
+  // editor tile changes not drawn yet, x1>x2 if there are none
+  int32_t edit_fg[4],edit_bg[4];
+  int edit_tiles,edit_frames,edit_idle;
+  float edit_fill_ms,edit_draw_ms;
+
+  void draw_edits(view *v);
+  void finish_edits();
+
 public :
   int key_down(int key) { return keymap[key/8]&(1<<(key%8)); }
   void set_key_down(int key, int x) { if (x) keymap[key/8]|=(1<<(key%8)); else keymap[key/8]&=~(1<<(key%8)); }
@@ -125,7 +133,12 @@ public :
 
   void put_fg(int x, int y, int type);
   void put_bg(int x, int y, int type);
-  void draw_map(view *v, int interpolate=0);
+  // Changed tiles are collected and the views redrawn around them once per
+  // frame, callers writing the map directly report what they touched here
+  void mark_fg_edit(int x1, int y1, int x2, int y2, int tiles=1);
+  void mark_bg_edit(int x1, int y1, int x2, int y2, int tiles=1);
+  void note_fill_time(float ms) { edit_fill_ms+=ms; }
+  void draw_map(view *v, int interpolate=0, int32_t const *area=NULL);
   void dev_scroll();
   void put_block_fg(int x, int y, TransImage *im);
   void put_block_bg(int x, int y, image *im);
@@ -0,0 +1,54 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#include "common.h"
+
+#include "hotstate.h"
+
+#if defined HAVE_SOA
+hot_store hot;
+
+template<typename T> static void grow(T *&array, int size)
+{
+    array = (T *)realloc(array, size * sizeof(T));
+}
+
+// Freed slots are reused before the arrays grow, so they stay as small
+// as the most objects ever alive at once
+int hot_slot_get()
+{
+    if (hot.total_free)
+        return hot.free_slots[--hot.total_free];
+
+    if (hot.used == hot.size)
+    {
+        hot.size = hot.size ? hot.size * 2 : 1024;
+        grow(hot.xvel, hot.size); grow(hot.yvel, hot.size);
+        grow(hot.xacel, hot.size); grow(hot.yacel, hot.size);
+        grow(hot.fx, hot.size); grow(hot.fy, hot.size);
+        grow(hot.fxvel, hot.size); grow(hot.fyvel, hot.size);
+        grow(hot.fxacel, hot.size); grow(hot.fyacel, hot.size);
+        grow(hot.flags, hot.size); grow(hot.grav, hot.size);
+        grow(hot.free_slots, hot.size);
+    }
+    return hot.used++;
+}
+
+void hot_slot_put(int slot)
+{
+    hot.free_slots[hot.total_free++] = slot;
+}
+#endif
@@ -0,0 +1,40 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __HOTSTATE_H__
+#define __HOTSTATE_H__
+
+// With --enable-soa, the fields that game_object::tick() and the movers
+// read on every object each tick (velocities, accelerations, their
+// fractions, flags and gravity) are kept in one array per field, indexed
+// by a slot each object holds, rather than spread over the large object.
+// Only the simple_object accessors in extend.h know where they are.
+
+#if defined HAVE_SOA
+struct hot_store
+{
+    int32_t *xvel, *yvel, *xacel, *yacel;
+    uint8_t *fx, *fy, *fxvel, *fyvel, *fxacel, *fyacel;
+    uint8_t *flags, *grav;
+    int32_t *free_slots;
+    int size, used, total_free;
+};
+
+extern hot_store hot;
+
+int hot_slot_get();
+void hot_slot_put(int slot);
+
+#   define HOT(array, field) hot.array[hot_slot]
+#else
+#   define HOT(array, field) field
+#endif
+
+#endif // __HOTSTATE_H__
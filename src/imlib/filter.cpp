@@ -16,6 +16,7 @@
 
 #include "image.h"
 #include "filter.h"
+#include "nearest.h"
 
 Filter::Filter(int colors)
 {
@@ -32,15 +33,16 @@ Filter::Filter(palette *from, palette *to)
     m_table = (uint8_t *)malloc(m_size);
 
     uint8_t *dst = m_table;
-    uint8_t *src = (uint8_t *)from->addr();
+    uint8_t const *src = (uint8_t const *)from->colors();
     int dk = to->darkest(1);
+    NearestColor nearest(to);
 
     for (int i = 0; i < m_size; i++)
     {
        int r = *src++;
        int g = *src++;
        int b = *src++;
-       int color = to->find_closest(r, g, b);
+       int color = nearest.Find(r, g, b);
 
        // Make sure non-blacks don't get remapped to the transparency
        if ((r || g || b) && to->red(color) == 0
@@ -123,35 +125,17 @@ void Filter::PutImage(image *screen, image *im, vec2i pos)
 
 ColorFilter::ColorFilter(palette *pal, int color_bits)
 {
-    int max = pal->pal_size();
+    NearestColor nearest(pal, 0, pal->pal_size());
     int mul = 1 << (8 - color_bits);
     m_size = 1 << color_bits;
     m_table = (uint8_t *)malloc(m_size * m_size * m_size);
 
     /* For each colour in the RGB cube, find the nearest palette element. */
+    uint8_t *dst = m_table;
     for (int r = 0; r < m_size; r++)
     for (int g = 0; g < m_size; g++)
     for (int b = 0; b < m_size; b++)
-    {
-        int best = 256 * 256 * 3;
-        int color = 0;
-        uint8_t *pp = (uint8_t *)pal->addr();
-
-        for (int i = 0; i < max; i++)
-        {
-            int rd = *pp++ - r * mul,
-                gd = *pp++ - g * mul,
-                bd = *pp++ - b * mul;
-
-            int dist = rd * rd + bd * bd + gd * gd;
-            if (dist < best)
-            {
-                best = dist;
-                color = i;
-            }
-        }
-        m_table[(r * m_size + g) * m_size + b] = color;
-    }
+        *dst++ = nearest.Find(r * mul, g * mul, b * mul);
 }
 
 ColorFilter::ColorFilter(spec_entry *e, bFILE *fp)
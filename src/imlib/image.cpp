@@ -18,8 +18,15 @@
 #include "common.h"
 
 #include "image.h"
+#include "pixpool.h"
 
 linked_list image_list; // FIXME: only jwindow.cpp needs this
+static int image_live = 0;
+
+int image_count()
+{
+    return image_live;
+}
 
 image_descriptor::image_descriptor(vec2i size,
                                    int keep_dirties, int static_memory)
@@ -29,6 +36,16 @@ image_descriptor::image_descriptor(vec2i size,
     m_clipx2 = m_l; m_clipy2 = m_h;
     keep_dirt = keep_dirties;
     static_mem = static_memory;
+    m_dirty = NULL;
+    m_dirty_pitch = m_dirty_top = m_dirty_bottom = m_holes = 0;
+    m_hole = NULL;
+    m_hole_size = 0;
+}
+
+image_descriptor::~image_descriptor()
+{
+    free(m_dirty);
+    free(m_hole);
 }
 
 void image::SetSize(vec2i new_size, uint8_t *page)
@@ -40,13 +57,14 @@ void image::SetSize(vec2i new_size, uint8_t *page)
 
 void image::MakePage(vec2i size, uint8_t *page_buffer)
 {
-    m_data = page_buffer ? page_buffer : (uint8_t *)malloc(size.x * size.y);
+    m_data = page_buffer ? page_buffer
+                         : (uint8_t *)pixel_alloc(size.x * size.y);
 }
 
 void image::DeletePage()
 {
     if(!m_special || !m_special->static_mem)
-        free(m_data);
+        pixel_free(m_data);
 }
 
 image::~image()
@@ -57,7 +75,8 @@ image::~image()
         Unlock();
     }
 
-    image_list.unlink(this);
+    image_list.remove(this);
+    image_live--;
     DeletePage();
     delete m_special;
 }
@@ -92,6 +111,7 @@ image::image(vec2i size, uint8_t *page_buffer, int create_descriptor)
                                          (page_buffer != NULL));
     MakePage(size, page_buffer);
     image_list.add_end(this);
+    image_live++;
     m_locked = false;
 }
 
@@ -106,6 +126,7 @@ image::image(bFILE *fp, spec_entry *e /* = NULL */)
     for (int i = 0; i < m_size.y; i++)
         fp->read(scan_line(i), m_size.x);
     image_list.add_end(this);
+    image_live++;
     m_locked = false;
 }
 
@@ -132,7 +153,7 @@ void image_uninit()
     while (image_list.first())
     {
         image *im = (image *)image_list.first();
-        image_list.unlink(im);
+        image_list.remove(im);
         delete im;
     }
 }
@@ -682,33 +703,45 @@ void image::InClip(int x1, int y1, int x2, int y2)
     SetClip(x1, y1, x2, y2);
 }
 
-//
-// reduce the number of dirty rectanges to 1 by finding the minmum area that
-// can contain all the rectangles and making this the new dirty area
-//
-void image_descriptor::ReduceDirties()
+// bits a..b of a dirty bitmap row: set, clear, or test that all are set
+static void set_dirty_bits(uint32_t *row, int a, int b)
 {
-    dirty_rect *p = (dirty_rect *)dirties.first();
-    int x1 = 6000, y1 = 6000, x2 = -1, y2 = -1;
+    for (; a <= b; a = (a | 31) + 1)
+    {
+        int last = Min(b, a | 31);
+        uint32_t mask = (last % 32 == 31 ? ~0u : (2u << (last % 32)) - 1)
+                          & ~((1u << (a % 32)) - 1);
+        row[a / 32] |= mask;
+    }
+}
 
-    for (int i = dirties.Count(); i--; )
+static void clear_dirty_bits(uint32_t *row, int a, int b)
+{
+    for (; a <= b; a = (a | 31) + 1)
     {
-        x1 = Min(x1, p->dx1); y1 = Min(y1, p->dy1);
-        x2 = Max(x1, p->dx1); y2 = Max(y1, p->dy1);
-        dirty_rect *tmp = (dirty_rect *)p->Next();
-        dirties.unlink(p);
-        delete p;
-        p = tmp;
+        int last = Min(b, a | 31);
+        uint32_t mask = (last % 32 == 31 ? ~0u : (2u << (last % 32)) - 1)
+                          & ~((1u << (a % 32)) - 1);
+        row[a / 32] &= ~mask;
     }
-    dirties.add_front(new dirty_rect(x1, y1, x2, y2));
 }
 
-void image_descriptor::delete_dirty(int x1, int y1, int x2, int y2)
+static int all_dirty_bits(uint32_t *row, int a, int b)
 {
-    int ax1, ay1, ax2, ay2;
-    dirty_rect *p, *next;
+    for (; a <= b; a = (a | 31) + 1)
+    {
+        int last = Min(b, a | 31);
+        uint32_t mask = (last % 32 == 31 ? ~0u : (2u << (last % 32)) - 1)
+                          & ~((1u << (a % 32)) - 1);
+        if ((row[a / 32] & mask) != mask)
+            return 0;
+    }
+    return 1;
+}
 
-    if (!keep_dirt)
+void image_descriptor::delete_dirty(int x1, int y1, int x2, int y2)
+{
+    if (!keep_dirt || !m_dirty || m_dirty_top == m_dirty_bottom)
         return;
 
     x1 = Max(0, x1); x2 = Min(m_l, x2);
@@ -717,96 +750,39 @@ void image_descriptor::delete_dirty(int x1, int y1, int x2, int y2)
     if (x1 >= x2 || y1 >= y2)
         return;
 
-    int i = dirties.Count();
-    if (!i)
-        return;
-
-    for (p = (dirty_rect *)dirties.first(); i; i--, p = next)
+    // cells the area covers completely are simply no longer dirty, a cell
+    // at the right or bottom edge of the image counts as covered if the
+    // area reaches the edge
+    int cx1 = (x1 + DIRTY_CELL - 1) >> DIRTY_SHIFT;
+    int cy1 = (y1 + DIRTY_CELL - 1) >> DIRTY_SHIFT;
+    int cx2 = x2 == m_l ? ((m_l - 1) >> DIRTY_SHIFT) : (x2 >> DIRTY_SHIFT) - 1;
+    int cy2 = y2 == m_h ? ((m_h - 1) >> DIRTY_SHIFT) : (y2 >> DIRTY_SHIFT) - 1;
+
+    if (cx1 <= cx2)
+        for (int cy = Max(cy1, m_dirty_top); cy <= cy2 && cy < m_dirty_bottom; cy++)
+            clear_dirty_bits(m_dirty + cy * m_dirty_pitch, cx1, cx2);
+
+    // the rest is remembered so the flush can go around it, dropping it
+    // would draw over whatever covers it
+    if (cx1 << DIRTY_SHIFT != x1 || cy1 << DIRTY_SHIFT != y1 ||
+        Min((cx2 + 1) << DIRTY_SHIFT, m_l) != x2 ||
+        Min((cy2 + 1) << DIRTY_SHIFT, m_h) != y2)
     {
-        next = (dirty_rect *)p->Next();
-
-        // are the two touching?
-        if (x2 <= p->dx1 || y2 <= p->dy1 || x1 > p->dx2 || y1 > p->dy2)
-            continue;
-
-        // does it take a x slice off? (across)
-        if (x2 >= p->dx2 + 1 && x1 <= p->dx1)
+        if (m_holes == m_hole_size)
         {
-            if (y2 >= p->dy2 + 1 && y1 <= p->dy1)
-            {
-                dirties.unlink(p);
-                delete p;
-            }
-            else if (y2 >= p->dy2 + 1)
-                p->dy2 = y1 - 1;
-            else if (y1 <= p->dy1)
-                p->dy1 = y2;
-            else
-            {
-                dirties.add_front(new dirty_rect(p->dx1, p->dy1, p->dx2, y1-1));
-                p->dy1 = y2;
-            }
-        }
-        // does it take a y slice off (down)
-        else if (y2 - 1>=p->dy2 && y1<=p->dy1)
-        {
-            if (x2 - 1>=p->dx2)
-                p->dx2=x1-1;
-            else if (x1<=p->dx1)
-                p->dx1=x2;
-            else
-            {
-                dirties.add_front(new dirty_rect(p->dx1, p->dy1, x1-1, p->dy2));
-                p->dx1=x2;
-            }
-        }
-        // otherwise it just takes a little chunk off
-        else
-        {
-            if (x2 - 1>=p->dx2)      { ax1=p->dx1; ax2=x1; }
-            else if (x1<=p->dx1) { ax1=x2; ax2=p->dx2+1; }
-            else                { ax1=p->dx1; ax2=x1; }
-            if (y2 - 1>=p->dy2)      { ay1=y1; ay2=p->dy2+1; }
-            else if (y1<=p->dy1) { ay1=p->dy1; ay2=y2; }
-            else                { ay1=y1; ay2=y2; }
-            dirties.add_front(new dirty_rect(ax1, ay1, ax2-1, ay2-1));
-
-            if (x2 - 1>=p->dx2 || x1<=p->dx1)  { ax1=p->dx1; ax2=p->dx2+1; }
-            else                         { ax1=x2; ax2=p->dx2+1; }
-
-            if (y2 - 1>=p->dy2)
-            { if (ax1==p->dx1) { ay1=p->dy1; ay2=y1; }
-                          else { ay1=y1; ay2=p->dy2+1;   } }
-            else if (y1<=p->dy1) { if (ax1==p->dx1) { ay1=y2; ay2=p->dy2+1; }
-                                             else  { ay1=p->dy1; ay2=y2; } }
-            else           { if (ax1==p->dx1) { ay1=p->dy1; ay2=y1; }
-                             else { ay1=y1; ay2=y2; } }
-            dirties.add_front(new dirty_rect(ax1, ay1, ax2 - 1, ay2 - 1));
-
-            if (x1>p->dx1 && x2 - 1<p->dx2)
-            {
-                if (y1>p->dy1 && y2 - 1<p->dy2)
-                {
-                    dirties.add_front(new dirty_rect(p->dx1, p->dy1, p->dx2, y1-1));
-                    dirties.add_front(new dirty_rect(p->dx1, y2, p->dx2, p->dy2));
-                }
-                else if (y1<=p->dy1)
-                    dirties.add_front(new dirty_rect(p->dx1, y2, p->dx2, p->dy2));
-                else
-                    dirties.add_front(new dirty_rect(p->dx1, p->dy1, p->dx2, y1-1));
-            }
-            else if (y1>p->dy1 && y2 - 1<p->dy2)
-                dirties.add_front(new dirty_rect(p->dx1, y2, p->dx2, p->dy2));
-            dirties.unlink(p);
-            delete p;
+            m_hole_size = m_hole_size ? m_hole_size * 2 : DIRTY_HOLES;
+            m_hole = (int16_t (*)[4])realloc(m_hole,
+                                             m_hole_size * sizeof(*m_hole));
         }
+        m_hole[m_holes][0] = x1; m_hole[m_holes][1] = y1;
+        m_hole[m_holes][2] = x2; m_hole[m_holes][3] = y2;
+        m_holes++;
     }
 }
 
 // specifies that an area is a dirty
 void image_descriptor::AddDirty(int x1, int y1, int x2, int y2)
 {
-    dirty_rect *p;
     if (!keep_dirt)
         return;
 
@@ -816,65 +792,68 @@ void image_descriptor::AddDirty(int x1, int y1, int x2, int y2)
     if (x1 >= x2 || y1 >= y2)
         return;
 
-    int i = dirties.Count();
-    if (!i)
-        dirties.add_front(new dirty_rect(x1, y1, x2 - 1, y2 - 1));
-    else if (i >= MAX_DIRTY)
+    if (!m_dirty)
     {
-        dirties.add_front(new dirty_rect(x1, y1, x2 - 1, y2 - 1));
-        ReduceDirties();  // reduce to one dirty rectangle, we have to many
+        m_dirty_pitch = (((m_l + DIRTY_CELL - 1) >> DIRTY_SHIFT) + 31) / 32;
+        int rows = (m_h + DIRTY_CELL - 1) >> DIRTY_SHIFT;
+        m_dirty = (uint32_t *)calloc(m_dirty_pitch * rows, sizeof(uint32_t));
+    }
+
+    int cx1 = x1 >> DIRTY_SHIFT, cx2 = (x2 - 1) >> DIRTY_SHIFT;
+    int cy1 = y1 >> DIRTY_SHIFT, cy2 = (y2 - 1) >> DIRTY_SHIFT;
+    for (int cy = cy1; cy <= cy2; cy++)
+        set_dirty_bits(m_dirty + cy * m_dirty_pitch, cx1, cx2);
+
+    if (m_dirty_top == m_dirty_bottom)
+    {
+        m_dirty_top = cy1;
+        m_dirty_bottom = cy2 + 1;
     }
     else
     {
-      for (p=(dirty_rect *)dirties.first(); i>0; i--)
-      {
+        m_dirty_top = Min(m_dirty_top, cy1);
+        m_dirty_bottom = Max(m_dirty_bottom, cy2 + 1);
+    }
+}
+
+int image_descriptor::NextDirty(int &x1, int &y1, int &x2, int &y2)
+{
+    int cols = (m_l + DIRTY_CELL - 1) >> DIRTY_SHIFT;
 
-        // check to see if this new rectangle completly encloses the check rectangle
-        if (x1<=p->dx1 && y1<=p->dy1 && x2>=p->dx2+1 && y2>=p->dy2+1)
+    for ( ; m_dirty && m_dirty_top < m_dirty_bottom; m_dirty_top++)
+    {
+        uint32_t *row = m_dirty + m_dirty_top * m_dirty_pitch;
+        for (int w = 0; w < m_dirty_pitch; w++)
         {
-          dirty_rect *tmp=(dirty_rect*) p->Next();
-          dirties.unlink(p);
-          delete p;
-          if (!dirties.first())
-              i=0;
-          else p=tmp;
+            if (!row[w])
+                continue;
+
+            // the first run of dirty cells on this row...
+            int a = w * 32;
+            while (!(row[a / 32] & (1u << (a % 32))))
+                a++;
+            int b = a;
+            while (b + 1 < cols && (row[(b + 1) / 32] & (1u << ((b + 1) % 32))))
+                b++;
+
+            // ...grown down over the rows that have the same cells dirty
+            int bottom = m_dirty_top + 1;
+            while (bottom < m_dirty_bottom
+                    && all_dirty_bits(m_dirty + bottom * m_dirty_pitch, a, b))
+                bottom++;
+            for (int cy = m_dirty_top; cy < bottom; cy++)
+                clear_dirty_bits(m_dirty + cy * m_dirty_pitch, a, b);
+
+            x1 = a << DIRTY_SHIFT; x2 = Min((b + 1) << DIRTY_SHIFT, m_l);
+            y1 = m_dirty_top << DIRTY_SHIFT;
+            y2 = Min(bottom << DIRTY_SHIFT, m_h);
+            return 1;
         }
-        else if (!(x2 - 1 <p->dx1 || y2 - 1 <p->dy1 || x1>p->dx2 || y1>p->dy2))
-        {
-
-
-
-/*          if (x1<=p->dx1) { a+=p->dx1-x1; ax1=x1; } else ax1=p->dx1;
-          if (y1<=p->dy1) { a+=p->dy1-y1; ay1=y1; } else ay1=p->dy1;
-          if (x2 - 1 >=p->dx2) { a+=x2 - 1 -p->dx2; ax2=x2 - 1; } else ax2=p->dx2;
-          if (y2 - 1 >=p->dy2) { a+=y2 - 1 -p->dy2; ay2=y2 - 1; } else ay2=p->dy2;
-
-      if (a<50)
-      { p->dx1=ax1;                         // then expand the dirty
-        p->dy1=ay1;
-        p->dx2=ax2;
-        p->dy2=ay2;
-        return ;
-      }
-      else */
-            {
-              if (x1<p->dx1)
-                AddDirty(x1, Max(y1, p->dy1), p->dx1, Min(y2, p->dy2 + 1));
-              if (x2>p->dx2+1)
-                AddDirty(p->dx2+1, Max(y1, p->dy1), x2, Min(y2, p->dy2 + 1));
-              if (y1<p->dy1)
-                AddDirty(x1, y1, x2, p->dy1);
-              if (y2 - 1>p->dy2)
-                AddDirty(x1, p->dy2+1, x2, y2);
-              return ;
-            }
-            p=(dirty_rect *)p->Next();
-          } else p=(dirty_rect *)p->Next();
-
-      }
-      CHECK(x1 < x2 && y1 < y2);
-      dirties.add_end(new dirty_rect(x1, y1, x2 - 1, y2 - 1));
     }
+
+    m_dirty_top = m_dirty_bottom = 0;
+    m_holes = 0;
+    return 0;
 }
 
 void image::bar      (int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint8_t color)
@@ -980,13 +959,11 @@ void image::dither(palette *pal)
 
 void image_descriptor::ClearDirties()
 {
-    dirty_rect *dr = (dirty_rect *)dirties.first();
-    while (dr)
-    {
-        dirties.unlink(dr);
-        delete dr;
-        dr = (dirty_rect *)dirties.first();
-    }
+    if (m_dirty)
+        memset(m_dirty, 0, m_dirty_pitch * ((m_h + DIRTY_CELL - 1) >> DIRTY_SHIFT)
+                             * sizeof(uint32_t));
+    m_dirty_top = m_dirty_bottom = 0;
+    m_holes = 0;
 }
 
 void image::Scale(vec2i new_size)
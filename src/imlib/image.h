@@ -15,39 +15,40 @@
 #include "linked.h"
 #include "palette.h"
 #include "specs.h"
-#define MAX_DIRTY 200
+
+// Dirty areas are kept as a bitmap of DIRTY_CELL x DIRTY_CELL pixel cells,
+// so marking costs the same however many areas there are and flushing
+// merges neighbouring cells into as few rectangles as it can.
+#define DIRTY_SHIFT 4
+#define DIRTY_CELL (1 << DIRTY_SHIFT)
+#define DIRTY_HOLES 32 // room for this many holes at first, grown as needed
 
 void image_init();
 void image_uninit();
+int image_count(); // images currently allocated
 extern linked_list image_list;
 
-class dirty_rect : public linked_node
-{
-public :
-  int16_t dx1,dy1,dx2,dy2;
-  dirty_rect(int16_t x1, int16_t y1, int16_t x2, int16_t y2)
-  { dx1=x1; dy1=y1; dx2=x2; dy2=y2;
-    if(x2<x1 || y2<y1)
-      printf("add incorrect dirty\n");
-  }
-  virtual int16_t compare(void *n1, int16_t field)
-  { return((dirty_rect *)n1)->dy1>dy1; }
-} ;
-
 class image_descriptor
 {
 private:
     int m_l, m_h;
     int m_clipx1, m_clipy1, m_clipx2, m_clipy2;
 
+    uint32_t *m_dirty; // one bit per cell, m_dirty_pitch words per row
+    int m_dirty_pitch, m_dirty_top, m_dirty_bottom; // rows that may be dirty
+    // areas delete_dirty took out of cells it only covered in part, they
+    // are skipped when flushing
+    int m_holes, m_hole_size;
+    int16_t (*m_hole)[4];
+
 public:
     uint8_t keep_dirt,
             static_mem; // if set, don't free memory on exit
 
-    linked_list dirties;
     void *extended_descriptor;
 
     image_descriptor(vec2i size, int keep_dirties = 1, int static_memory = 0);
+    ~image_descriptor();
     int bound_x1(int x1) { return x1 < m_clipx1 ? m_clipx1 : x1; }
     int bound_y1(int y1) { return y1 < m_clipy1 ? m_clipy1 : y1; }
     int bound_x2(int x2) { return x2 > m_clipx2 ? m_clipx2 : x2; }
@@ -68,13 +69,24 @@ public:
         m_clipx1 = Max(x1, 0); m_clipy1 = Max(y1, 0);
         m_clipx2 = Min(x2, m_l); m_clipy2 = Min(y2, m_h);
     }
-    void ReduceDirties();
     void AddDirty(int x1, int y1, int x2, int y2);
     void delete_dirty(int x1, int y1, int x2, int y2);
+    // takes the next dirty rectangle off the bitmap, returns 0 once it is
+    // empty; x2 and y2 are exclusive
+    int NextDirty(int &x1, int &y1, int &x2, int &y2);
+    int HoleCount() { return m_holes; }
+    void GetHole(int n, int &x1, int &y1, int &x2, int &y2)
+    {
+        x1 = m_hole[n][0]; y1 = m_hole[n][1];
+        x2 = m_hole[n][2]; y2 = m_hole[n][3];
+    }
     void Resize(vec2i size)
     {
         m_l = size.x; m_h = size.y;
         m_clipx1 = 0; m_clipy1 = 0; m_clipx2 = m_l; m_clipy2 = m_h;
+        free(m_dirty);  // reallocated at the new size when needed
+        m_dirty = NULL;
+        m_dirty_top = m_dirty_bottom = m_holes = 0;
     }
 };
 
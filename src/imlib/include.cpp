@@ -42,7 +42,7 @@ void write_include(image *im, palette *pal, char *filename, char *name)
     if (!append)
     {
       fprintf(fp,"unsigned char %s_palette[256*3] = {\n    ",tmp_name);
-      unsigned char *p=(unsigned char *)pal->addr();
+      unsigned char const *p=(unsigned char const *)pal->colors();
       for (i=0; i<768; i++,p++)
       {
     fprintf(fp,"%d",(int)*p);
@@ -436,7 +436,7 @@ Jwindow::Jwindow(int X, int Y, int L, int H, ifield *f, char const *name)
     screen = new image(vec2i(l, h), NULL, 2);
     screen->clear(backg);
     // Keep this from getting destroyed when image list is cleared
-    image_list.unlink(screen);
+    image_list.remove(screen);
     inm->screen = screen;
 
     next = NULL;
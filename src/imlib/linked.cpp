@@ -71,6 +71,31 @@ int linked_list::unlink(linked_node *p)
     return 1;
 }
 
+//
+// Take a node out of the list without searching for it; the node's links
+// are cleared so removing it twice is harmless
+//
+int linked_list::remove(linked_node *p)
+{
+    if (!m_count || !p->Next())
+        return 0;
+
+    if (p->Next() == p)
+        m_first = NULL;
+    else
+    {
+        p->Prev()->SetNext(p->Next());
+        p->Next()->SetPrev(p->Prev());
+        if (p == m_first)
+            m_first = p->Next();
+    }
+    p->SetNext(NULL);
+    p->SetPrev(NULL);
+
+    m_count--;
+    return 1;
+}
+
 //
 // Add a node to the end of a linked_list
 //
@@ -42,7 +42,8 @@ private:
 // for example shape is an class derived from linked_node. to add a shape to
 // linked list I have to say mylist.add_end(myshape_pointer);
 // unlink removes a node from the list via pointers but does not deallocate
-// it from the heap
+// it from the heap, it searches the list first; remove does the same in
+// constant time when the caller knows where the node is
 // the destructor for linked_list will get dispose of all the nodes as
 // well, so if you don't want something deleted then you must unlink
 // it from the list before the destructor is called
@@ -56,6 +57,9 @@ public:
     void add_front(class linked_node *p);
     void add_end(class linked_node *p);
     int unlink(linked_node *p);
+    // constant time unlink for a node that is known to be in this list or
+    // to have been taken out with remove() already
+    int remove(linked_node *p);
 
     inline class linked_node *first() { return m_first; }
     inline class linked_node *prev() { return m_first->Prev(); }
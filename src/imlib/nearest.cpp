@@ -0,0 +1,103 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <string.h>
+
+#include "common.h"
+
+#include "nearest.h"
+
+NearestColor::NearestColor(palette *pal, int first, int count)
+{
+    m_first = first;
+    m_count = Max(0, Min(count, Min(256, pal->pal_size()) - first));
+    memcpy(m_rgb, (uint8_t const *)pal->colors() + first * 3, m_count * 3);
+
+    // insertion sort by green, equal greens stay in palette order
+    int n = 0;
+    for (int i = 0; i < m_count; i++)
+    {
+        uint8_t g = m_rgb[i * 3 + 1];
+        int j = n++;
+        for ( ; j > 0 && m_g[j - 1] > g; j--)
+        {
+            m_r[j] = m_r[j - 1]; m_g[j] = m_g[j - 1];
+            m_b[j] = m_b[j - 1]; m_index[j] = m_index[j - 1];
+        }
+        m_r[j] = m_rgb[i * 3];
+        m_g[j] = g;
+        m_b[j] = m_rgb[i * 3 + 2];
+        m_index[j] = first + i;
+    }
+
+    for (int g = 0, j = 0; g <= 256; g++)
+    {
+        while (j < m_count && m_g[j] < g)
+            j++;
+        m_start[g] = j;
+    }
+}
+
+int NearestColor::Find(int r, int g, int b) const
+{
+    int best = 0x7fffffff, color = m_first;
+    int up = m_start[Max(0, Min(g, 256))], down = up - 1;
+
+    // entries whose green alone is further than the best match cannot
+    // win; equal distances still can since the lower index wins ties
+    while (up < m_count || down >= 0)
+    {
+        if (up < m_count)
+        {
+            int gd = m_g[up] - g;
+            if (gd * gd > best)
+                up = m_count;
+            else
+            {
+                int rd = m_r[up] - r, bd = m_b[up] - b;
+                int dist = rd * rd + gd * gd + bd * bd;
+                if (dist < best || (dist == best && m_index[up] < color))
+                {
+                    best = dist;
+                    color = m_index[up];
+                }
+                up++;
+            }
+        }
+        if (down >= 0)
+        {
+            int gd = m_g[down] - g;
+            if (gd * gd > best)
+                down = -1;
+            else
+            {
+                int rd = m_r[down] - r, bd = m_b[down] - b;
+                int dist = rd * rd + gd * gd + bd * bd;
+                if (dist < best || (dist == best && m_index[down] < color))
+                {
+                    best = dist;
+                    color = m_index[down];
+                }
+                down--;
+            }
+        }
+    }
+    return color;
+}
+
+int NearestColor::Matches(palette *pal) const
+{
+    return Min(256, pal->pal_size()) - m_first >= m_count
+            && !memcmp(m_rgb, (uint8_t const *)pal->colors() + m_first * 3, m_count * 3);
+}
@@ -0,0 +1,41 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __NEAREST_H__
+#define __NEAREST_H__
+
+#include "palette.h"
+
+//
+// Nearest palette entry search. The entries are sorted by green and the
+// search walks outwards from the query's green value, stopping as soon as
+// the green distance alone is worse than the best match. It returns the
+// same index as a linear search over the palette, including picking the
+// lowest index when several entries are equally close.
+//
+class NearestColor
+{
+public:
+    // searches entries first..first+count-1 of pal
+    NearestColor(palette *pal, int first = 0, int count = 256);
+
+    int Find(int r, int g, int b) const;
+
+    // whether pal still has the colours this search was built from
+    int Matches(palette *pal) const;
+
+private:
+    int m_first, m_count;
+    uint8_t m_rgb[256 * 3];   // copy of the searched entries
+    uint8_t m_r[256], m_g[256], m_b[256], m_index[256]; // sorted by green
+    uint16_t m_start[257];    // first sorted entry with green >= g
+};
+
+#endif // __NEAREST_H__
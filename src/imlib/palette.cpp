@@ -20,6 +20,7 @@
 #include "image.h"
 #include "video.h"
 #include "filter.h"
+#include "nearest.h"
 
 palette *lastl=NULL;
 
@@ -31,6 +32,8 @@ palette::palette(bFILE *fp)
   set_all_unused();
   fp->read(pal,sizeof(color)*ncolors);
   bg=0;
+  gen=0;
+  closest=closest_non0=NULL;
 }
 
 palette::palette(spec_entry *e, bFILE *fp)
@@ -42,6 +45,8 @@ palette::palette(spec_entry *e, bFILE *fp)
   set_all_unused();
   fp->read(pal,sizeof(color)*ncolors);
   bg=0;
+  gen=0;
+  closest=closest_non0=NULL;
 }
 
 int palette::size()
@@ -55,35 +60,35 @@ int palette::write(bFILE *fp)
   return fp->write(pal,sizeof(color)*ncolors)==ncolors;
 }
 
+// The colours are only compared again after something could have written
+// them, and the search only rebuilt if they really changed
 int palette::find_closest(unsigned char r, unsigned char g, unsigned char b)
 {
-   unsigned char *cl=(unsigned char *)addr();
-   int c=0,d=0x100000,i,nd;
-   for (i=0; i<256; i++)
-   {
-     nd=((int)r-(int)(*cl))*((int)r-(int)(*cl)); cl++;
-     nd+=((int)g-(int)(*cl))*((int)g-(int)(*cl)); cl++;
-     nd+=((int)b-(int)(*cl))*((int)b-(int)(*cl)); cl++;
-     if (nd<d)
-     { c=i; d=nd; }
-   }
-   return c;
+  if (!closest || closest_gen!=gen)
+  {
+    if (!closest || !closest->Matches(this))
+    {
+      delete closest;
+      closest=new NearestColor(this);
+    }
+    closest_gen=gen;
+  }
+  return closest->Find(r,g,b);
 }
 
 
 int palette::find_closest_non0(unsigned char r, unsigned char g, unsigned char b)
 {
-   unsigned char *cl=(unsigned char *)addr()+3;
-   int c=1,d=0x7fffffff,i,nd;
-   for (i=1; i<256; i++)
-   {
-     nd=((int)r-(int)(*cl))*((int)r-(int)(*cl)); cl++;
-     nd+=((int)g-(int)(*cl))*((int)g-(int)(*cl)); cl++;
-     nd+=((int)b-(int)(*cl))*((int)b-(int)(*cl)); cl++;
-     if (nd<d)
-     { c=i; d=nd; }
-   }
-   return c;
+  if (!closest_non0 || closest_non0_gen!=gen)
+  {
+    if (!closest_non0 || !closest_non0->Matches(this))
+    {
+      delete closest_non0;
+      closest_non0=new NearestColor(this,1,255);
+    }
+    closest_non0_gen=gen;
+  }
+  return closest_non0->Find(r,g,b);
 }
 
 
@@ -230,7 +235,8 @@ int palette::add_color(unsigned int r, int unsigned g, int unsigned b, int close
   if (f<0)
   {
     if (u>=0)
-    { pal[u].red=r;
+    { gen++;
+      pal[u].red=r;
       pal[u].green=g;
       pal[u].blue=b;
       set_used(u);
@@ -274,6 +280,7 @@ void palette::shift(int amount)
 {
   int i;
   unsigned char m;
+  gen++;
   if (amount<0)
   {
 
@@ -296,6 +303,7 @@ void palette::set(int x, unsigned char red, char unsigned green, char unsigned b
   CONDITION((int)red<=ncolors && (int)green<=ncolors && (int)blue<=ncolors,
         "pallette::set color values bigger than palette");
   pal[x].red=red; pal[x].green=green; pal[x].blue=blue;
+  gen++;
 }
 
 void palette::get(int x, unsigned char &red, unsigned char &green, unsigned char &blue)
@@ -305,6 +313,8 @@ void palette::get(int x, unsigned char &red, unsigned char &green, unsigned char
 palette::~palette()
 { if (pal) free(pal);
   if (usd) free(usd);
+  delete closest;
+  delete closest_non0;
 }
 
 palette::palette(int number_colors)
@@ -314,6 +324,8 @@ palette::palette(int number_colors)
   bg=0;
   pal=(color *)malloc(ncolors*3);
   usd=(unsigned char *)malloc(ncolors/8+1);
+  gen=0;
+  closest=closest_non0=NULL;
   defaults();
 }
 
@@ -20,6 +20,8 @@
 #define BLUE2(x) (unsigned char) ((x&3)*(int)255/(int)3)
 
 
+class NearestColor;
+
 struct color
 {
   unsigned char red,green,blue;
@@ -31,6 +33,9 @@ class palette : public linked_node
   unsigned char *usd;           // bit array
   short ncolors;
   int bg;
+  int gen;                              // bumped whenever the colours may change
+  NearestColor *closest,*closest_non0;  // built on first use, rebuilt when the colours change
+  int closest_gen,closest_non0_gen;     // gen they were last checked at
 public :
   palette(int number_colors=256);
   palette(spec_entry *e, bFILE *fp);
@@ -41,7 +46,8 @@ public :
   unsigned int red(int x) { return pal[x].red; }
   unsigned int green(int x) { return pal[x].green; }
   unsigned int blue(int x) { return pal[x].blue; }
-  void *addr() { return (void *) pal; }
+  void *addr() { gen++; return (void *) pal; }  // the caller may write
+  color const *colors() const { return pal; }
   void shift(int amount);
   void load();
   void load_nice();
@@ -199,7 +199,7 @@ void write_PCX(image *im, palette *pal, char const *filename)
     }
   }
   fputc(12,fp);  // note that there is a palette attached
-  fwrite(pal->addr(),1,256*3,fp);
+  fwrite(pal->colors(),1,256*3,fp);
   fclose(fp);
 }
 
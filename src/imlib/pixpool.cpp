@@ -0,0 +1,139 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#include "common.h"
+
+#include "pixpool.h"
+#include "dprint.h"
+
+// two classes per power of two, 64 bytes to 64 kilobytes
+#define POOL_CLASSES 21
+#define POOL_LARGE   POOL_CLASSES
+#define SLAB_SIZE    (256 * 1024)
+
+static size_t const class_size[POOL_CLASSES] =
+{
+    64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072,
+    4096, 6144, 8192, 12288, 16384, 24576, 32768, 49152, 65536
+};
+
+// every block starts with this, it keeps the data 8-byte aligned
+struct pool_header
+{
+    uint32_t size_class;
+    uint32_t size;
+};
+
+struct pool_free
+{
+    pool_free *next;
+};
+
+static pool_free *free_list[POOL_CLASSES];
+
+static struct pool_stat
+{
+    int live, slabs;
+    size_t bytes;
+} stats[POOL_CLASSES + 1];
+
+static void new_slab(int n)
+{
+    size_t stride = sizeof(pool_header) + class_size[n];
+    int count = Max(SLAB_SIZE / (int)stride, 4);
+    uint8_t *slab = (uint8_t *)malloc(stride * count);
+    if (!slab)
+        return;
+
+    for (int i = count; i--; )
+    {
+        pool_free *f = (pool_free *)(slab + i * stride + sizeof(pool_header));
+        f->next = free_list[n];
+        free_list[n] = f;
+    }
+    stats[n].slabs++;
+}
+
+void *pixel_alloc(size_t size)
+{
+    int n = 0;
+    while (n < POOL_CLASSES && class_size[n] < size)
+        n++;
+
+    pool_header *h;
+    if (n == POOL_LARGE)
+        h = (pool_header *)malloc(sizeof(pool_header) + size);
+    else
+    {
+        if (!free_list[n])
+            new_slab(n);
+        if (!free_list[n])
+            return NULL;
+        pool_free *f = free_list[n];
+        free_list[n] = f->next;
+        h = (pool_header *)f - 1;
+    }
+    if (!h)
+        return NULL;
+
+    h->size_class = n;
+    h->size = size;
+    stats[n].live++;
+    stats[n].bytes += size;
+    return h + 1;
+}
+
+void pixel_free(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    pool_header *h = (pool_header *)ptr - 1;
+    int n = h->size_class;
+    stats[n].live--;
+    stats[n].bytes -= h->size;
+
+    if (n == POOL_LARGE)
+        free(h);
+    else
+    {
+        pool_free *f = (pool_free *)ptr;
+        f->next = free_list[n];
+        free_list[n] = f;
+    }
+}
+
+void pixel_pool_report()
+{
+    int live = 0;
+    size_t bytes = 0;
+    for (int n = 0; n <= POOL_CLASSES; n++)
+    {
+        live += stats[n].live;
+        bytes += stats[n].bytes;
+        if (!stats[n].live && !stats[n].slabs)
+            continue;
+        if (n == POOL_LARGE)
+            dprintf("pixels > %d: %d live, %d bytes\n",
+                    (int)class_size[POOL_CLASSES - 1], stats[n].live,
+                    (int)stats[n].bytes);
+        else
+            dprintf("pixels <= %d: %d live, %d bytes, %d slabs\n",
+                    (int)class_size[n], stats[n].live, (int)stats[n].bytes,
+                    stats[n].slabs);
+    }
+    dprintf("pixels total: %d live, %d bytes\n", live, (int)bytes);
+}
@@ -0,0 +1,27 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __PIXPOOL_H__
+#define __PIXPOOL_H__
+
+//
+// Size-class pool for pixel memory (image pages and TransImage data).
+// Blocks come out of large slabs and go back to a free list for their
+// class, so loading and evicting sprites neither walks the heap nor
+// fragments it. Requests bigger than the largest class use malloc.
+//
+
+void *pixel_alloc(size_t size);
+void pixel_free(void *ptr);
+
+// prints live blocks and bytes per size class with dprintf
+void pixel_pool_report();
+
+#endif // __PIXPOOL_H__
@@ -260,6 +260,7 @@ int bFILE::tell()
 
 int bFILE::allow_read_buffering() { return 1; }
 int bFILE::allow_write_buffering() { return 1; }
+int bFILE::read_at(void *buf, size_t count, long offset) { return -1; }
 
 void set_spec_main_file(char const *filename, int Search_order)
 {
@@ -465,6 +466,16 @@ int jFILE::unbuffered_read(void *buf, size_t count)
     return len;
 }
 
+int jFILE::read_at(void *buf, size_t count, long offset)
+{
+    if (fd < 0 || offset < 0 || offset > file_length)
+        return -1;
+    if (offset + (long)count > file_length)
+        count = file_length - offset;
+    // pread() leaves spec_main_offset valid for files inside the main file
+    return pread(fd, buf, count, start_offset + offset);
+}
+
 int jFILE::unbuffered_write(void const *buf, size_t count)
 {
   long ret = ::write(fd,(char*)buf,count);
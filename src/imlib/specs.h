@@ -113,6 +113,9 @@ class bFILE     // base file type which other files should be derived from (jFIL
   int seek(long offset, int whence);        // whence=SEEK_SET, SEEK_CUR, SEEK_END, ret=0=success
   int tell();
   virtual int file_size() = 0;
+  // reads at an offset without moving the file position, so several
+  // threads may use it at once; returns -1 where this is not supported
+  virtual int read_at(void *buf, size_t count, long offset);
 
   virtual ~bFILE();
 
@@ -152,6 +155,7 @@ public :
                                                              // SEEK_END, ret=0=success
   virtual int unbuffered_tell();
   virtual int file_size() { return file_length; }
+  virtual int read_at(void *buf, size_t count, long offset);
   virtual ~jFILE();
 } ;
 
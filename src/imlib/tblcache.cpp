@@ -0,0 +1,208 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined HAVE_SYS_MMAN_H
+#   include <sys/mman.h>
+#endif
+
+#include "common.h"
+
+#include "tblcache.h"
+#include "specs.h"
+#include "dprint.h"
+
+#define TABLE_VERSION 1
+
+// Written in native byte order, the cache never leaves the machine
+struct table_header
+{
+    char magic[4];
+    uint32_t version, param, size;
+    char kind[16];
+    uint8_t colors[256 * 3];
+    uint32_t check[2];          // hash of the table data
+};
+
+// Tables handed out by table_load() that live in a file mapping
+struct table_mapping
+{
+    uint8_t *base;
+    size_t length;
+    table_mapping *next;
+};
+
+static table_mapping *mappings = NULL;
+
+// 64-bit FNV-1a
+static uint64_t hash_bytes(uint64_t h, void const *buf, size_t len)
+{
+    uint8_t const *p = (uint8_t const *)buf;
+    while (len--)
+    {
+        h ^= *p++;
+        h *= (uint64_t)0x100000001b3ULL;
+    }
+    return h;
+}
+
+static void make_header(table_header *h, char const *kind, int param,
+                        palette *pal, uint8_t const *data, int size)
+{
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, "ATBL", 4);
+    h->version = TABLE_VERSION;
+    h->param = param;
+    h->size = size;
+    strncpy(h->kind, kind, sizeof(h->kind) - 1);
+    memcpy(h->colors, pal->colors(), Min(256, pal->pal_size()) * 3);
+    if (data)
+    {
+        uint64_t x = hash_bytes(0xcbf29ce484222325ULL, data, size);
+        h->check[0] = (uint32_t)x;
+        h->check[1] = (uint32_t)(x >> 32);
+    }
+}
+
+static void table_path(char *buf, char const *kind, int param, palette *pal)
+{
+    table_header h;
+    make_header(&h, kind, param, pal, NULL, 0);
+    uint64_t x = hash_bytes(0xcbf29ce484222325ULL, &h, sizeof(h));
+    sprintf(buf, "%s%.15s-%08x%08x.tbl", get_save_filename_prefix(), kind,
+            (unsigned int)(x >> 32), (unsigned int)x);
+}
+
+uint8_t *table_load(char const *kind, int param, palette *pal, int size)
+{
+    char path[1024];
+    table_path(path, kind, param, pal);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    size_t length = sizeof(table_header) + size;
+    if (fstat(fd, &st) || (size_t)st.st_size != length)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    uint8_t *base;
+#if defined HAVE_SYS_MMAN_H
+    // a private mapping, callers may patch their copy of the table
+    base = (uint8_t *)mmap(NULL, length, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE, fd, 0);
+    if (base == (uint8_t *)MAP_FAILED)
+        base = NULL;
+#else
+    base = (uint8_t *)malloc(length);
+    if (base && read(fd, base, length) != (ssize_t)length)
+    {
+        free(base);
+        base = NULL;
+    }
+#endif
+    close(fd);
+    if (!base)
+        return NULL;
+
+    table_header want;
+    make_header(&want, kind, param, pal, base + sizeof(table_header), size);
+    if (memcmp(&want, base, sizeof(want)))
+    {
+        dprintf("table cache: %s is stale, rebuilding\n", path);
+#if defined HAVE_SYS_MMAN_H
+        munmap(base, length);
+#else
+        free(base);
+#endif
+        return NULL;
+    }
+
+#if defined HAVE_SYS_MMAN_H
+    table_mapping *m = (table_mapping *)malloc(sizeof(table_mapping));
+    m->base = base;
+    m->length = length;
+    m->next = mappings;
+    mappings = m;
+    return base + sizeof(table_header);
+#else
+    // keep table_release() simple: hand out a block free() can take
+    memmove(base, base + sizeof(table_header), size);
+    return base;
+#endif
+}
+
+void table_store(char const *kind, int param, palette *pal,
+                 uint8_t const *data, int size)
+{
+    char path[1024], tmp[1040];
+    table_path(path, kind, param, pal);
+    sprintf(tmp, "%s.tmp", path);
+
+    table_header h;
+    make_header(&h, kind, param, pal, data, size);
+
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp)
+    {
+        dprintf("table cache: unable to open %s for writing\n", tmp);
+        return;
+    }
+    int ok = fwrite(&h, sizeof(h), 1, fp) == 1
+              && fwrite(data, size, 1, fp) == 1;
+    ok = !fclose(fp) && ok;
+
+    // write then rename, a crash never leaves a half written table
+    if (ok && rename(tmp, path))
+    {
+        remove(path);
+        ok = !rename(tmp, path);
+    }
+    if (!ok)
+    {
+        dprintf("table cache: unable to write %s\n", path);
+        remove(tmp);
+    }
+}
+
+void table_release(uint8_t *data)
+{
+    if (!data)
+        return;
+
+    for (table_mapping **m = &mappings; *m; m = &(*m)->next)
+    {
+        if ((*m)->base + sizeof(table_header) == data)
+        {
+            table_mapping *dead = *m;
+            *m = dead->next;
+#if defined HAVE_SYS_MMAN_H
+            munmap(dead->base, dead->length);
+#endif
+            free(dead);
+            return;
+        }
+    }
+    free(data);
+}
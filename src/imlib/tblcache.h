@@ -0,0 +1,36 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __TBLCACHE_H__
+#define __TBLCACHE_H__
+
+#include "palette.h"
+
+//
+// On-disk cache for tables computed from a palette. Every table gets its
+// own file in the save directory, named after a 64-bit hash of the table
+// kind, its parameter and the palette colours, so the tables for several
+// palettes (gamma settings, addon palettes) are kept side by side. The
+// file header repeats the full key and is checked on load, a hash
+// collision just means a rebuild.
+//
+
+// Returns a writable copy of the cached table, mapped from disk when
+// possible, or NULL if it has to be built. Free it with table_release().
+uint8_t *table_load(char const *kind, int param, palette *pal, int size);
+
+// Saves a freshly built table. Failures are reported but not fatal.
+void table_store(char const *kind, int param, palette *pal,
+                 uint8_t const *data, int size);
+
+// Releases a table from table_load() or a plain malloc() block.
+void table_release(uint8_t *data);
+
+#endif // __TBLCACHE_H__
@@ -18,6 +18,7 @@
 #include "common.h"
 
 #include "transimage.h"
+#include "pixpool.h"
 
 TransImage::TransImage(image *im, char const *name)
 {
@@ -51,7 +52,7 @@ TransImage::TransImage(image *im, char const *name)
         }
     }
 
-    uint8_t *parser = m_data = (uint8_t *)malloc(bytes);
+    uint8_t *parser = m_data = (uint8_t *)pixel_alloc(bytes);
     if (!parser)
     {
         printf("size = %d %d (%ld bytes)\n", m_size.x, m_size.y, (long)bytes);
@@ -94,7 +95,7 @@ TransImage::TransImage(image *im, char const *name)
 
 TransImage::~TransImage()
 {
-    free(m_data);
+    pixel_free(m_data);
 }
 
 image *TransImage::ToImage()
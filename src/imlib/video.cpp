@@ -19,6 +19,34 @@
 #include "image.h"
 #include "video.h"
 
+// puts part of a dirty rectangle, going around the holes from 'hole' on
+static void put_dirty_part(image *im, int xoff, int yoff,
+                           int x1, int y1, int x2, int y2, int hole)
+{
+    image_descriptor *d = im->m_special;
+
+    for ( ; hole < d->HoleCount(); hole++)
+    {
+        int hx1, hy1, hx2, hy2;
+        d->GetHole(hole, hx1, hy1, hx2, hy2);
+        if (hx1 >= x2 || hy1 >= y2 || hx2 <= x1 || hy2 <= y1)
+            continue;
+
+        int cy1 = Max(y1, hy1), cy2 = Min(y2, hy2);
+        if (y1 < hy1)
+            put_dirty_part(im, xoff, yoff, x1, y1, x2, hy1, hole + 1);
+        if (hy2 < y2)
+            put_dirty_part(im, xoff, yoff, x1, hy2, x2, y2, hole + 1);
+        if (x1 < hx1)
+            put_dirty_part(im, xoff, yoff, x1, cy1, hx1, cy2, hole + 1);
+        if (hx2 < x2)
+            put_dirty_part(im, xoff, yoff, hx2, cy1, x2, cy2, hole + 1);
+        return;
+    }
+
+    put_part_image(im, xoff + x1, yoff + y1, x1, y1, x2, y2);
+}
+
 void update_dirty(image *im, int xoff, int yoff)
 {
     // make sure the image has the ability to contain dirty areas
@@ -30,18 +58,9 @@ void update_dirty(image *im, int xoff, int yoff)
     }
     else
     {
-        int count = im->m_special->dirties.Count();
-        dirty_rect *dr = (dirty_rect *)(im->m_special->dirties.first());
-        while(count > 0)
-        {
-            put_part_image(im, xoff + dr->dx1, yoff + dr->dy1,
-                           dr->dx1, dr->dy1, dr->dx2 + 1, dr->dy2 + 1);
-            dirty_rect *tmp = dr;
-            dr = (dirty_rect *)(dr->Next());
-            im->m_special->dirties.unlink(tmp);
-            delete tmp;
-            count--;
-        }
+        int x1, y1, x2, y2;
+        while(im->m_special->NextDirty(x1, y1, x2, y2))
+            put_dirty_part(im, xoff, yoff, x1, y1, x2, y2, 0);
     }
 
     update_window_done();
@@ -13,6 +13,14 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#if defined __linux__ || defined __APPLE__
+#   include <signal.h>
+#   include <sys/types.h>
+#   include <sys/wait.h>
+#endif
 
 #include "common.h"
 
@@ -27,8 +35,11 @@
 
 #include "gserver.h"
 #include "gclient.h"
+#include "netsim.h"
 #include "dprint.h"
 #include "netcfg.h"
+#include "nfserver.h"
+#include "replay.h"
 
 /*
 
@@ -54,6 +65,20 @@ join_struct *join_array=NULL;      // points to an array of possible joining cli
 extern char *get_login();
 extern void set_login(char const *name);
 
+// time spent waiting for other players' input, reported when the net shuts
+// down so transports can be compared under -netloss and -netlag
+static int net_ticks=0,net_stalls=0;
+static double net_stall_time=0.0,net_stall_max=0.0;
+
+static void print_stall_stats()
+{
+  if (net_ticks)
+    fprintf(stderr,"Net: %d ticks, %d stalls, %.0f ms waiting (longest %.0f ms)\n",
+            net_ticks,net_stalls,net_stall_time*1000.0,net_stall_max*1000.0);
+  net_ticks=net_stalls=0;
+  net_stall_time=net_stall_max=0.0;
+}
+
 
 int net_init(int argc, char **argv)
 {
@@ -62,6 +87,10 @@ int net_init(int argc, char **argv)
 
     local_client_number=0;
 
+    for (i=1; i<argc; i++)
+        if (!strcmp(argv[i],"-nosync64"))
+            sync64_disabled=1;
+
     if (!main_net_cfg)
         main_net_cfg=new net_configuration;
 
@@ -107,7 +136,34 @@ int net_init(int argc, char **argv)
                 db_level = x;
             }
         }
-        else if( !strcmp( argv[i], "-server" ) )
+        else if (!strcmp(argv[i],"-netdelay"))
+        {
+            if (i==argc-1 || !sscanf(argv[i+1],"%d",&x) || x<0 || x>BATCH_MAX_DELAY)
+            {
+                fprintf(stderr,"Net: Bad value following -netdelay, use 0..%d\n",BATCH_MAX_DELAY);
+                return 0;
+            }
+            net_batch_delay = x;
+        }
+        else if (!strcmp(argv[i],"-netloss"))
+        {
+            if (i==argc-1 || !sscanf(argv[i+1],"%d",&x) || x<0 || x>100)
+            {
+                fprintf(stderr,"Net: Bad value following -netloss, use 0..100\n");
+                return 0;
+            }
+            net_sim_loss = x;
+        }
+        else if (!strcmp(argv[i],"-netlag"))
+        {
+            if (i==argc-1 || !sscanf(argv[i+1],"%d",&x) || x<0 || x>2000)
+            {
+                fprintf(stderr,"Net: Bad value following -netlag, use 0..2000\n");
+                return 0;
+            }
+            net_sim_lag = x;
+        }
+        else if( !strcmp( argv[i], "-server" ) || !strcmp( argv[i], "-dedicated" ) )
         {
             main_net_cfg->state = net_configuration::SERVER;
         }
@@ -189,6 +245,7 @@ int net_start()  // is the game starting up off the net? (i.e. -net hostname)
 
 int kill_net()
 {
+  print_stall_stats();
   if (game_face) delete game_face;  game_face=NULL;
   if (join_array) free(join_array);  join_array=NULL;
   if (game_sock) { delete game_sock; game_sock=NULL; }
@@ -290,6 +347,7 @@ void service_net_request()
 {
   if (prot)
   {
+    net_sim_flush();
     if (prot->select(0))  // anything happening net-wise?
     {
       if (comm_sock && comm_sock->ready_to_read())  // new connection?
@@ -388,7 +446,7 @@ int request_server_entry()
     if (game_sock) delete game_sock;
     dprintf("Joining game in progress, hang on....\n");
 
-    game_sock=prot->create_listen_socket(main_net_cfg->port+2,net_socket::SOCKET_FAST);     // this is used for fast game packet transmission
+    game_sock=net_sim_wrap(prot->create_listen_socket(main_net_cfg->port+2,net_socket::SOCKET_FAST));     // this is used for fast game packet transmission
     if (!game_sock) { if (comm_sock) delete comm_sock; comm_sock=NULL; prot=NULL; return 0; }
     game_sock->read_selectable();
 
@@ -426,7 +484,8 @@ int request_server_entry()
     if (get_login())
       strcpy(uname,get_login());
     else strcpy(uname,"unknown");
-    uint8_t len=strlen(uname)+1;
+    uint8_t len=strlen(uname)+2;
+    uname[len-1]=NET_CAP_SYNC64|NET_CAP_BATCH;    // old servers stop reading at the NUL
     short nkills;
 
     if (sock->write(&len,1)!=1 ||
@@ -447,6 +506,7 @@ int request_server_entry()
     addr->set_port(port);
 
     delete game_face;
+    net_batch_delay=0;    // the server tells us which transport to use
     game_face=new game_client(sock,addr);
     delete addr;
 
@@ -503,6 +563,7 @@ void net_reload()
 
       delete fp;
       base->current_tick=(current_level->tick_counter()&0xff);
+      netcache_report();
 
       reload_end();
     } else if (current_level)
@@ -596,6 +657,32 @@ void net_reload()
 
 int client_number() { return local_client_number; }
 
+// The per object hashes are only worth their cost when a 64-bit sync is
+// compared: in net games, and in demos recorded for -demobatch to check
+int sync64_hashing()
+{
+  if (sync64_disabled)
+    return 0;
+  if (demo_man.current_state()==demo_manager::RECORDING)
+    return 1;
+  if (demo_man.current_state()==demo_manager::PLAYING)
+    return replay_batch_active();
+  return game_face && game_face->networked();
+}
+
+// 64-bit syncs are only sent when every peer can parse them: the server
+// knows what its clients support and the clients follow its lead
+int net_sync64()
+{
+  if (!sync64_hashing())
+    return 0;
+  if (!prot)
+    return 1;
+  if (local_client_number==0)
+    return game_face->peers_support_sync64();
+  return sync64_server_seen;
+}
+
 
 void send_local_request()
 {
@@ -624,9 +711,11 @@ void kill_slackers()
 
 int get_inputs_from_server(unsigned char *buf)
 {
+  if (prot)
+    net_ticks++;
   if (prot && base->input_state!=INPUT_PROCESSING)      // if input is not here, wait on it
   {
-    time_marker start;
+    time_marker start,stall_start;
 
     int total_retry=0;
     Jwindow *abort=NULL;
@@ -687,6 +776,13 @@ int get_inputs_from_server(unsigned char *buf)
       the_game->reset_keymap();
 
     }
+
+    time_marker now;
+    double wait=now.diff_time(&stall_start);
+    net_stalls++;
+    net_stall_time+=wait;
+    if (wait>net_stall_max)
+      net_stall_max=wait;
   }
 
 
@@ -714,7 +810,7 @@ int become_server(char *name)
         prot->start_notify(0x9090, name, strlen(name));  // should we define a new socket for notifiers?
 
     if (game_sock) delete game_sock;
-    game_sock=prot->create_listen_socket(main_net_cfg->port+1,net_socket::SOCKET_FAST);     // this is used for fast game packet transmission
+    game_sock=net_sim_wrap(prot->create_listen_socket(main_net_cfg->port+1,net_socket::SOCKET_FAST));     // this is used for fast game packet transmission
     if (!game_sock) { if (comm_sock) delete comm_sock; comm_sock=NULL; prot=NULL; return 0; }
     game_sock->read_selectable();
 
@@ -733,3 +829,170 @@ void wait_min_players()
   if (game_face) game_face->game_start_wait();
 }
 
+
+
+#define NFS_BENCH_FILES 20
+#define NFS_BENCH_FILE_SIZE (256*1024)     // 5 MB in total
+#define NFS_BENCH_PORT (DEFAULT_COMM_PORT+100)
+
+static uint8_t nfs_bench_byte(int file, int i)
+{
+  return (uint8_t)((file*131+i*7)^(i>>9));
+}
+
+// fetches the file set like a joining client would, in bFILE sized reads,
+// returns the number of bad bytes
+static int nfs_bench_fetch(int argc, char **argv, int bulk, double &seconds)
+{
+  file_manager fm(argc,argv,prot);
+  fm.set_bulk(bulk);
+  char const *host="127.0.0.1";
+  net_address *addr=prot->get_node_address(host,NFS_BENCH_PORT,1);
+  if (!addr)
+    return -1;
+  fm.set_default_fs(addr);
+  delete addr;
+
+  int bad=0;
+  uint8_t buf[8192];
+  time_marker start;
+  for (int f=0; f<NFS_BENCH_FILES; f++)
+  {
+    char name[20];
+    sprintf(name,"level%02d.spe",f);
+    char const *fn=name;
+    int fd=fm.rf_open_file(fn,"rb");
+    if (fd<0)
+      return -1;
+
+    int32_t size=fm.rf_file_size(fd),done=0;
+    bad+=abs(size-NFS_BENCH_FILE_SIZE);
+    while (done<size)
+    {
+      int ret=fm.rf_read(fd,buf,sizeof(buf));
+      if (ret<=0)
+        break;
+      for (int i=0; i<ret; i++)
+        bad+=buf[i]!=nfs_bench_byte(f,done+i);
+      done+=ret;
+    }
+    bad+=size-done;
+    fm.rf_close(fd);
+  }
+  time_marker end;
+  seconds=end.diff_time(&start);
+  return bad;
+}
+
+// -nfsbench [ms] : serves a 5 MB file set from a child process over the
+// loopback, the server waiting ms before each answer, and times a client
+// fetching it with on demand reads and with bulk transfers
+void nfs_benchmark(int argc, char **argv)
+{
+#if defined __linux__ || defined __APPLE__
+  int rtts[3]={ 0,10,50 },total_rtts=3;
+  for (int i=1; i+1<argc; i++)
+    if (!strcmp(argv[i],"-nfsbench") && argv[i+1][0]>='0' && argv[i+1][0]<='9')
+    {
+      rtts[0]=atoi(argv[i+1]);
+      total_rtts=1;
+    }
+
+  for (prot=net_protocol::first; prot && !prot->installed(); prot=prot->next) ;
+  if (!prot)
+  {
+    printf("-nfsbench: no network protocol installed\n");
+    exit(1);
+  }
+
+  char dir[]="/tmp/abuse-nfsbench-XXXXXX";
+  if (!mkdtemp(dir))
+  {
+    perror("-nfsbench: mkdtemp");
+    exit(1);
+  }
+
+  char path[80];
+  uint8_t *data=(uint8_t *)malloc(NFS_BENCH_FILE_SIZE);
+  for (int f=0; f<NFS_BENCH_FILES; f++)
+  {
+    for (int i=0; i<NFS_BENCH_FILE_SIZE; i++)
+      data[i]=nfs_bench_byte(f,i);
+    sprintf(path,"%s/level%02d.spe",dir,f);
+    FILE *fp=fopen(path,"wb");
+    if (!fp || fwrite(data,NFS_BENCH_FILE_SIZE,1,fp)!=1)
+    {
+      perror("-nfsbench: writing files");
+      exit(1);
+    }
+    fclose(fp);
+  }
+  free(data);
+
+  int failed=0;
+  for (int r=0; r<total_rtts; r++)
+  {
+    // listen before forking so the client can't beat the server to it
+    net_socket *listen_sock=prot->create_listen_socket(NFS_BENCH_PORT,net_socket::SOCKET_SECURE);
+    if (!listen_sock)
+    {
+      printf("-nfsbench: unable to listen on port %d\n",NFS_BENCH_PORT);
+      failed=1;
+      break;
+    }
+
+    fflush(stdout);
+    pid_t pid=fork();
+    if (pid<0)
+    {
+      perror("-nfsbench: fork");
+      exit(1);
+    }
+    if (pid==0)
+    {
+      if (chdir(dir)<0)
+        exit(1);
+      comm_sock=listen_sock;
+      comm_sock->read_selectable();
+      fman=new file_manager(argc,argv,prot);
+      fman->set_sim_rtt(rtts[r]);
+      game_face=new game_handler;
+      for (;;)
+      {
+        prot->select(1);
+        service_net_request();
+      }
+    }
+    delete listen_sock;
+
+    for (int bulk=0; bulk<2; bulk++)
+    {
+      double seconds=0.0;
+      int bad=nfs_bench_fetch(argc,argv,bulk,seconds);
+      if (bad<0)
+        printf("%3d ms  %-9s : transfer failed\n",rtts[r],bulk ? "bulk" : "on demand");
+      else
+        printf("%3d ms  %-9s : %7.2f s  %5.2f MB/s  %d bad bytes\n",
+               rtts[r],bulk ? "bulk" : "on demand",seconds,
+               NFS_BENCH_FILES*NFS_BENCH_FILE_SIZE/1048576.0/seconds,bad);
+      failed|=bad!=0;
+    }
+
+    kill(pid,SIGTERM);
+    waitpid(pid,NULL,0);
+  }
+
+  for (int f=0; f<NFS_BENCH_FILES; f++)
+  {
+    sprintf(path,"%s/level%02d.spe",dir,f);
+    unlink(path);
+  }
+  sprintf(path,"%s/open.log",dir);
+  unlink(path);
+  rmdir(dir);
+  exit(failed);
+#else
+  printf("-nfsbench needs fork()\n");
+  exit(1);
+#endif
+}
@@ -14,6 +14,10 @@
 
 #include <stdlib.h>
 
+#include "common.h"
+
+#include "intsect.h"
+
 void pushback(int32_t x1,int32_t y1,int32_t &x2,int32_t &y2,
              int32_t xp1, int32_t yp1, int32_t xp2, int32_t yp2, int xdir, int ydir, int inside)
 {
@@ -149,6 +153,58 @@ void pushback(int32_t x1,int32_t y1,int32_t &x2,int32_t &y2,
 } */
 
 
+// The second half of setback_intersect(): the line through the moving
+// segment is a1,b1,c1 and the one through the ordered edge a2,b2,c2
+static inline int setback_line(int32_t x1, int32_t y1, int32_t &x2, int32_t &y2,
+                               int32_t a1, int32_t b1, int32_t c1, int rising,
+                               int32_t a2, int32_t b2, int32_t c2, int32_t inside)
+{
+  int32_t r1,r2;
+  r1=x1*a2+y1*b2+c2;
+  r2=x2*a2+y2*b2+c2;
+
+  if ((r1^r2)<=0 || r1==0 || r2==0)
+  {
+    if ( (rising && ((r2^inside)>0)) ||
+         (!rising && ((r2^inside)<0)) ||
+     inside==0 || r2==0)
+    {
+      int32_t ae=a1*b2,bd=b1*a2;
+      if (ae!=bd)         // co-linear returns 0
+      {
+        x2=(b1*c2-b2*c1)/(ae-bd);
+        y2=(a1*c2-a2*c1)/(bd-ae);
+        // push the intersection back one pixel
+        if (y2!=y1)
+        {
+          if (y2>y1)
+            y2--;
+          else y2++;
+        }
+        if (x2!=x1)
+        {
+          if (x2>x1)
+            x2--;
+          else x2++;
+        }
+
+        if (inside)        // check to make sure end point is on the
+        {                  // right side
+          r1=x1*a2+y1*b2+c2;
+          r2=x2*a2+y2*b2+c2;
+          if ((r2!=0 && ((r1^r2)<0)))
+          {
+            x2=x1;
+            y2=y1;
+          }
+        }
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
 int setback_intersect(int32_t x1,int32_t y1,int32_t &x2,int32_t &y2,
               int32_t xp1, int32_t yp1, int32_t xp2, int32_t yp2,
                      int32_t inside)  // which side is inside the polygon? (0 always setback)
@@ -157,7 +213,7 @@ int setback_intersect(int32_t x1,int32_t y1,int32_t &x2,int32_t &y2,
   // x(y2-y1)+y(x1-x2)-x1*y2+x2*y1=0
   //     A        B        C
 
-  int32_t a1,b1,c1,a2,b2,c2,r1,r2;
+  int32_t a1,b1,c1,r1,r2;
 
   a1=y2-y1;
   b1=x1-x2;
@@ -169,78 +225,93 @@ int setback_intersect(int32_t x1,int32_t y1,int32_t &x2,int32_t &y2,
     r1=xp1; xp1=xp2; xp2=r1;
   }
 
-  int32_t xdiff,ydiff;
-/*  int32_t xdiff=abs(xp1-xp2),ydiff=yp1-yp2;
-  if (xdiff>=ydiff)                              // increment the endpoints
-    if (xp2<xp1) { xp2--; xp1++; }
-    else { xp2++; xp1--; }
+  r1=xp1*a1+yp1*b1+c1;
+  r2=xp2*a1+yp2*b1+c1;
+
+  if ((r1^r2)<=0 || r1==0 || r2==0)           // signs must be different to intersect
+    return setback_line(x1,y1,x2,y2,a1,b1,c1,xp1<xp2,
+                        yp2-yp1,xp1-xp2,-xp1*yp2+xp2*yp1,inside);
+  return 0;
+}
 
-  if (xdiff<=ydiff)
+#define remapx(x) (x==0 ? -1 : x==tl-1 ? tl+1 : x)
+#define remapy(y) (y==0 ? -1 : y==th-1 ? th+1 : y)
+
+tile_edges::tile_edges(int points, uint8_t const *data, uint8_t const *ins,
+                       int tl, int th)
+{
+  total=Max(points-1,0);
+  x1=(int32_t *)malloc(total*7*sizeof(int32_t)+total*2+1);
+  y1=x1+total;
+  x2=y1+total;
+  y2=x2+total;
+  a=y2+total;
+  b=a+total;
+  c=b+total;
+  inside=(int8_t *)(c+total);
+  rising=(uint8_t *)(inside+total);
+  minx=miny=0x7fffffff;
+  maxx=maxy=-0x7fffffff;
+
+  for (int j=0; j<total; j++,data+=2)
   {
-    yp1++;
-    yp2--;
-  } */
+    int32_t xp1=remapx(data[0]),yp1=remapy(data[1]),
+            xp2=remapx(data[2]),yp2=remapy(data[3]),t;
+    if (yp1<yp2 || (yp1==yp2 && xp1>xp2))
+    {
+      t=yp1; yp1=yp2; yp2=t;
+      t=xp1; xp1=xp2; xp2=t;
+    }
+    x1[j]=xp1; y1[j]=yp1;
+    x2[j]=xp2; y2[j]=yp2;
+    a[j]=yp2-yp1;
+    b[j]=xp1-xp2;
+    c[j]=-xp1*yp2+xp2*yp1;
+    inside[j]=ins[j] ? 1 : -1;
+    rising[j]=xp1<xp2;
 
+    minx=Min(minx,Min(xp1,xp2)); maxx=Max(maxx,Max(xp1,xp2));
+    miny=Min(miny,Min(yp1,yp2)); maxy=Max(maxy,Max(yp1,yp2));
+  }
+}
 
-  r1=xp1*a1+yp1*b1+c1;
-  r2=xp2*a1+yp2*b1+c1;
+int setback_edges(int32_t x1, int32_t y1, int32_t &x2, int32_t &y2,
+                  tile_edges const *e, int32_t xo, int32_t yo)
+{
+  // the end point only changes where both segments meet
+  if (Max(x1,x2)<xo+e->minx || Min(x1,x2)>xo+e->maxx ||
+      Max(y1,y2)<yo+e->miny || Min(y1,y2)>yo+e->maxy)
+    return 0;
 
-  if ((r1^r2)<=0 || r1==0 || r2==0)           // signs must be different to intersect
+  uint8_t cross[256];
+  int hit=0,j=0;
+  while (j<e->total)
   {
-    a2=yp2-yp1;
-    b2=xp1-xp2;
-    c2=-xp1*yp2+xp2*yp1;
-    r1=x1*a2+y1*b2+c2;
-    r2=x2*a2+y2*b2+c2;
+    int32_t a1=y2-y1,b1=x1-x2,c1=-x1*y2+x2*y1;
 
-    if ((r1^r2)<=0 || r1==0 || r2==0)
-    {
-      if ( ((xp1<xp2) && ((r2^inside)>0)) ||
-           (xp1>=xp2 && ((r2^inside)<0)) ||
-       inside==0 || r2==0)
-      {
-    int32_t ae=a1*b2,bd=b1*a2;
-    if (ae!=bd)         // co-linear returns 0
+    // first test of setback_intersect() for all the edges left
+    for (int k=j; k<e->total; k++)
     {
-      x2=(b1*c2-b2*c1)/(ae-bd);
-      y2=(a1*c2-a2*c1)/(bd-ae);
-      xdiff=abs(x2-x1);
-      ydiff=abs(y2-y1);
-//      if (xdiff<=ydiff)            // push the intersection back one pixel
-//      {
-        if (y2!=y1)
-        {
-            if (y2>y1)
-            y2--;
-          else y2++;
-        }
-//      }
-//      if (xdiff>=ydiff)
-//      {
-        if (x2!=x1)
-        {
-          if (x2>x1)
-            x2--;
-          else x2++;
-        }
-//      }
-
-      if (inside)        // check to make sure end point is on the
-      {                  // right side
-        r1=x1*a2+y1*b2+c2;
-        r2=x2*a2+y2*b2+c2;
-        if ((r2!=0 && ((r1^r2)<0)))
-        {
-          x2=x1;
-          y2=y1;
-        }
-      }
-      return 1;
+      int32_t r1=(xo+e->x1[k])*a1+(yo+e->y1[k])*b1+c1,
+              r2=(xo+e->x2[k])*a1+(yo+e->y2[k])*b1+c1;
+      cross[k]=((r1^r2)<=0) | (r1==0) | (r2==0);
     }
+
+    // the others are left alone until the end point moves
+    for (; j<e->total; j++)
+    {
+      if (!cross[j])
+        continue;
+      int32_t ox2=x2,oy2=y2;
+      setback_line(x1,y1,x2,y2,a1,b1,c1,e->rising[j],e->a[j],e->b[j],
+                   e->c[j]-xo*e->a[j]-yo*e->b[j],e->inside[j]);
+      if (ox2!=x2 || oy2!=y2)
+      {
+        hit=1;
+        j++;
+        break;
       }
     }
   }
-  return 0;
-
+  return hit;
 }
-
@@ -14,6 +14,32 @@
 int setback_intersect(int32_t x1, int32_t y1, int32_t &x2, int32_t &y2,
               int32_t xp1, int32_t yp1, int32_t xp2, int32_t yp2, int32_t inside);
 
+// The boundary of a foretile made ready for setback_edges() when the tile
+// is loaded. Edge end points are remapped to reach one pixel into the next
+// tiles, as the level code always did, and ordered the way
+// setback_intersect() wants them. The line through each edge is given for
+// a tile at 0,0.
+class tile_edges
+{
+public:
+  int total;
+  int32_t *x1,*y1,*x2,*y2;      // y1>=y2
+  int32_t *a,*b,*c;             // a*x+b*y+c=0
+  int8_t *inside;               // 1 or -1, the inside flag of the boundary
+  uint8_t *rising;              // x1<x2
+  int32_t minx,miny,maxx,maxy;
+
+  tile_edges(int points, uint8_t const *data, uint8_t const *inside,
+             int tl, int th);
+  ~tile_edges() { free(x1); }
+} ;
+
+// Clips x1,y1-x2,y2 against every edge of a tile placed at xo,yo, in order,
+// with the same result as calling setback_intersect() for each of them.
+// Returns 1 if the end point moved.
+int setback_edges(int32_t x1, int32_t y1, int32_t &x2, int32_t &y2,
+                  tile_edges const *e, int32_t xo, int32_t yo);
+
 #endif
 
 
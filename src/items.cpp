@@ -270,6 +270,8 @@ foretile::foretile(bFILE *fp)
 
 
   points=new boundary(fp,"foretile boundry");
+  edges=new tile_edges(points->tot,points->data,points->inside,
+                       im->Size().x,im->Size().y);
 
 
 }
@@ -309,7 +311,8 @@ figure::figure(bFILE *fp, int type)
 char_tint::char_tint(bFILE *fp)  // se should be a palette entry
 {
   palette *p=new palette(fp);
-  uint8_t *t=data,*p_addr=(uint8_t *)p->addr();
+  uint8_t *t=data;
+  uint8_t const *p_addr=(uint8_t const *)p->colors();
   for (int i=0; i<256; i++,t++,p_addr+=3)
     *t=pal->find_closest(*p_addr,p_addr[1],p_addr[2]);
 
@@ -14,6 +14,7 @@
 #include "transimage.h"
 #include "specs.h"
 #include "points.h"
+#include "intsect.h"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -49,12 +50,13 @@ public :
   uint8_t ylevel;            // for fast intersections, this is the y level offset for the ground
                            // if ground is not level this is 255
   boundary *points;
+  tile_edges *edges;         // points, ready for setback_edges()
 
   image *micro_image;
 
   foretile(bFILE *fp);
   int32_t size() { return im->Size().x*im->Size().y+4+2+1+points->size(); }
-  ~foretile() { delete im; delete points; delete micro_image; }
+  ~foretile() { delete im; delete points; delete edges; delete micro_image; }
 } ;
 
 class figure
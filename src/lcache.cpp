@@ -147,7 +147,9 @@ LObject *load_block(bFILE *fp)
             return s;
         }
     case L_NUMBER:
-        return LNumber::Create(fp->read_uint32());
+        // numbers are written as 32 bits, keep their sign so the small
+        // ones come back as immediates
+        return LNumber::Create((int32_t)fp->read_uint32());
     case L_SYMBOL:
         {
             uintptr_t ret = 0, mul = 1;
@@ -42,8 +42,143 @@
 #include "cop.h"
 #include "nfserver.h"
 #include "lisp_gc.h"
+#include "levelload.h"
+#include "nativeai.h"
 
 level *current_level;
+int level_save_v2=0;
+int level_load_times=0;
+
+struct object_region
+{
+  int32_t x1,y1,x2,y2;       // bounding box of the object positions
+  int32_t count,size;
+  uint8_t *data;             // NULL once the objects are created
+};
+
+// Format v2 objects that were not created yet, with the remap tables
+// built by load_objects() from the describe_* entries
+class object_regions
+{
+  public :
+  int16_t old_tot;
+  uint16_t *o_remap,*o_backmap;
+  int16_t **s_remap,*s_remap_totals;
+  int16_t **v_remap,*v_remap_totals;
+
+  int nvars;
+  int16_t *var_remap;        // index in object_descriptions or -1
+  uint8_t *var_type;
+  int32_t range;             // largest activation range of any type
+  int total,left;
+  object_region *region;
+
+  object_regions(int16_t old_tot, uint16_t *o_remap, uint16_t *o_backmap,
+                 int16_t **s_remap, int16_t *s_remap_totals,
+                 int16_t **v_remap, int16_t *v_remap_totals)
+    : old_tot(old_tot), o_remap(o_remap), o_backmap(o_backmap),
+      s_remap(s_remap), s_remap_totals(s_remap_totals),
+      v_remap(v_remap), v_remap_totals(v_remap_totals)
+  {
+    nvars=total=left=0;
+    range=0;
+    var_remap=NULL;
+    var_type=NULL;
+    region=NULL;
+  }
+
+  ~object_regions()
+  {
+    for (int k=0; k<old_tot; k++)
+    {
+      if (s_remap_totals[k])
+        free(s_remap[k]);
+      if (v_remap && v_remap_totals[k])
+        free(v_remap[k]);
+    }
+    free(v_remap_totals);
+    free(s_remap_totals);
+    free(o_remap);
+    free(o_backmap);
+    free(s_remap);
+    free(v_remap);
+
+    for (int i=0; i<total; i++)
+      free(region[i].data);
+    free(region);
+    free(var_remap);
+    free(var_type);
+  }
+};
+
+static inline void region_put(uint8_t *&p, uint32_t x, int size)
+{
+  for (int i=0; i<size; i++,x>>=8)
+    *p++=x&0xff;
+}
+
+static inline uint32_t region_get(uint8_t *&p, int size)
+{
+  uint32_t x=0;
+  for (int i=0; i<size; i++)
+    x|=(uint32_t)*p++<<(i*8);
+  return x;
+}
+
+// called on each decoded band of a format v2 map, see the tile check in
+// the level constructor
+static void check_fg_tiles(uint16_t *m, int count, int load_all)
+{
+  for (; count; count--,m++)
+  {
+    if (!load_all)
+      (*m)=(*m)&(~0x8000);    // clear the has-seen bit on the tile
+
+    if (fgvalue(*m)>=nforetiles || foretiles[fgvalue(*m)]<0)
+      *m=0;
+  }
+}
+
+static void check_bg_tiles(uint16_t *m, int count, int unused)
+{
+  for (; count; count--,m++)
+    if ( (bgvalue(*m)>=nbacktiles) || backtiles[bgvalue(*m)]<0)
+       *m=0;
+}
+
+void level::decode_fg(int y)
+{
+  if (!fg_bands->decode(y))
+  {
+    delete fg_bands;
+    fg_bands=NULL;
+  }
+}
+
+void level::decode_bg(int y)
+{
+  if (!bg_bands->decode(y))
+  {
+    delete bg_bands;
+    bg_bands=NULL;
+  }
+}
+
+void level::decode_maps()
+{
+  if (fg_bands)
+  {
+    fg_bands->decode_all();
+    delete fg_bands;
+    fg_bands=NULL;
+  }
+  if (bg_bands)
+  {
+    bg_bands->decode_all();
+    delete bg_bands;
+    bg_bands=NULL;
+  }
+}
 
 game_object *level::attacker(game_object *who)
 {
@@ -83,9 +218,12 @@ void level::load_fail()
 {
   if (map_fg)    free(map_fg);   map_fg=NULL;
   if (map_bg)    free(map_bg);   map_bg=NULL;
+  delete fg_bands;               fg_bands=NULL;
+  delete bg_bands;               bg_bands=NULL;
+  delete regions;                regions=NULL;
   if (Name)      free(Name);     Name=NULL;
 
-  first_active=NULL;
+  clear_active_list();
   view *f=player_list;
   for (; f; f=f->next)
     if (f->focus)
@@ -121,6 +259,24 @@ level::~level()
   if (block_list) free(block_list);
   if (all_block_list) free(all_block_list);
   if (first_name) free(first_name);
+  free(ohash);
+  free(oticked);
+  for (int i=0; i<total_buckets; i++)
+    free(buckets[i].e);
+  free(buckets);
+  free(type_bits);
+  free(query_type);
+  free(query_offsets);
+  if (raycast_check)
+    dprintf("raycast: %d rays, %d tiles tested, %d mismatches\n",rays.calls,
+            rays.tiles,rays.mismatches);
+  if (native_ai_check)
+  {
+    native_stats const &n=native_counts();
+    dprintf("native: %d calls, %d checked, %d mismatches\n",n.calls,
+            n.checks,n.mismatches);
+  }
+  free(ray_memos);
 }
 
 void level::restart()
@@ -180,6 +336,7 @@ void level::next_focus()
 void level::unactivate_all()
 {
   first_active=NULL;
+  buckets_valid=0;
   game_object *o=first;
   attack_total=0;  // reset the attack list
   target_total=0;
@@ -217,6 +374,10 @@ void level::pull_actives(game_object *o, game_object *&last_active, int &t)
 
 int level::add_actives(int32_t x1, int32_t y1, int32_t x2, int32_t y2)
 {
+  if (regions)
+    load_regions(x1,y1,x2,y2);
+  buckets_valid=0;
+
   int t=0;
   game_object *last_active=NULL;
   if (first_active)
@@ -261,6 +422,10 @@ int level::add_actives(int32_t x1, int32_t y1, int32_t x2, int32_t y2)
 
 int level::add_drawables(int32_t x1, int32_t y1, int32_t x2, int32_t y2)
 {
+  if (regions)
+    load_regions(x1,y1,x2,y2);
+  buckets_valid=0;
+
   int t=0,ft=0;
   game_object *last_active=NULL;
   if (first_active)
@@ -581,6 +746,32 @@ game_object *level::all_boundary_setback(game_object *subject, int32_t x1, int32
 
 //bFILE *rcheck=NULL,*rcheck_lp=NULL;
 
+// objects are hashed right after they run, so only the ones which got a
+// chance to change are looked at
+void level::add_tick_hash(game_object *who)
+{
+  if (ohash_total==ohash_size)
+  {
+    ohash_size+=100;
+    ohash=(uint64_t *)realloc(ohash,sizeof(uint64_t)*ohash_size);
+    oticked=(game_object **)realloc(oticked,sizeof(game_object *)*ohash_size);
+  }
+  uint64_t h=who->sync_hash();
+  ohash[ohash_total]=h;
+  oticked[ohash_total]=who;
+  ohash_total++;
+
+  thash=(thash^h)*0x100000001b3ULL;
+}
+
+game_object *level::ticked_object(int x)
+{
+  for (game_object *o=first; o; o=o->next)
+    if (o==oticked[x])
+      return o;
+  return NULL;
+}
+
 void level::interpolate_draw_objects(view *v)
 {
   int32_t old_x,old_y;
@@ -620,6 +811,13 @@ int level::tick()
   if (profiling())
     profile_reset();
 
+  thash=0xcbf29ce484222325ULL;
+  ohash_total=0;
+  int hashing=sync64_hashing();
+  last_queries=queries;
+  queries.calls=queries.examined=0;
+  lisp_alloc_tick();
+
 /*  // test to see if demo is in sync
   if (current_demo_mode()==DEMO_PLAY)
   {
@@ -753,6 +951,8 @@ int level::tick()
       if (cur->hurtable())                    // add to target list if is hurtable
         add_target(cur);
 
+      if (hashing)
+        add_tick_hash(cur);
     }
 
   }
@@ -839,6 +1039,8 @@ void level::set_size(int w, int h)
     return ;
   }
 
+  decode_maps();
+  map_gen++;
   uint16_t *new_fg,*new_bg;
   new_fg=(uint16_t *)malloc(w*h*sizeof(int16_t));
   memset(new_fg,0,w*h*sizeof(int16_t));
@@ -1255,30 +1457,446 @@ void level::load_objects(spec_directory *sd, bFILE *fp)
       }
     }
 
-    int k=0;
-    for (; k<old_tot; k++)
+    // format v2 levels need the remap tables until every region is loaded
+    object_regions *r=new object_regions(old_tot,o_remap,o_backmap,s_remap,
+                                         s_remap_totals,v_remap,v_remap_totals);
+    if (read_regions(sd,fp,r))
+      regions=r;
+    else
+      delete r;
+  }
+
+}
+
+int level::read_regions(spec_directory *sd, bFILE *fp, object_regions *r)
+{
+  spec_entry *se=sd->find("object_regions");
+  if (!se)
+    return 0;
+
+  // every count and size is checked against what is left of the entry
+  // before anything is allocated for it
+  long end=se->offset+se->size;
+  fp->seek(se->offset,0);
+  r->nvars=fp->read_uint16();
+  if (r->nvars*2L>end-fp->tell())      // a length and a type at least
+  {
+    dprintf("level : object regions are damaged\n");
+    r->nvars=0;
+    return 0;
+  }
+  r->var_remap=(int16_t *)malloc(r->nvars*sizeof(int16_t));
+  r->var_type=(uint8_t *)malloc(r->nvars);
+  char name[256];
+  int i,j;
+  for (i=0; i<r->nvars; i++)
+  {
+    int len=fp->read_uint8();
+    fp->read(name,len);
+    name[len ? len-1 : 0]=0;
+    r->var_type[i]=fp->read_uint8();
+    r->var_remap[i]=-1;
+    for (j=0; j<TOTAL_OBJECT_VARS; j++)
+      if (!strcmp(object_descriptions[j].name,name)
+          && object_descriptions[j].type==r->var_type[i])
+        r->var_remap[i]=j;
+    if (r->var_remap[i]<0)
+      dprintf("Warning : load level -> no previous var %s\n",name);
+  }
+
+  r->total=fp->read_uint32();
+  if (r->total<0 || r->total>(end-fp->tell())/24)
+  {
+    dprintf("level : object regions are damaged\n");
+    r->total=0;
+    return 0;
+  }
+  r->region=(object_region *)calloc(r->total,sizeof(object_region));
+  for (i=0; i<r->total; i++)
+  {
+    object_region *g=r->region+i;
+    g->x1=fp->read_uint32();
+    g->y1=fp->read_uint32();
+    g->x2=fp->read_uint32();
+    g->y2=fp->read_uint32();
+    g->count=fp->read_uint32();
+    g->size=fp->read_uint32();
+    // an object takes at least its type and state
+    if (g->size<0 || g->count<0 || g->size>end-fp->tell()
+        || g->count>g->size/4)
     {
-      if (s_remap_totals[k])
-        free(s_remap[k]);
+      dprintf("level : object region %d is damaged\n",i);
+      r->total=i;
+      break;
+    }
+    g->data=(uint8_t *)malloc(g->size);
+    if (fp->read(g->data,g->size)!=g->size)
+    {
+      free(g->data);
+      r->total=i;
+      break;
+    }
+  }
+  r->left=r->total;
+  if (!r->left)
+    return 0;
+
+  // a region is needed as soon as one of its objects could be
+  for (i=0; i<total_objects; i++)
+  {
+    r->range=Max(r->range,(int32_t)Max(figures[i]->rangex,figures[i]->rangey));
+    r->range=Max(r->range,(int32_t)Max(figures[i]->draw_rangex,figures[i]->draw_rangey));
+  }
+  return 1;
+}
+
+void level::load_region(int n)
+{
+  object_regions *r=regions;
+  object_region *g=r->region+n;
+  uint8_t *p=g->data;
+  game_object *added=NULL;
+
+  for (int32_t i=0; i<g->count; i++)
+  {
+    int t=region_get(p,2),st=region_get(p,2);
+    int type=t<r->old_tot ? r->o_remap[t] : 0xffff;
+    game_object *o=NULL;
+    if (type<total_objects)
+    {
+      o=new game_object(type,1);
+      clear_tmp();
+      o->state=stopped;
+      if (st<r->s_remap_totals[t])
+      {
+        character_state s=(character_state)(*(r->s_remap[t]+st));
+        if (o->has_sequence(s))
+          o->state=s;
+      }
+      o->current_frame=0;
     }
 
-    int l=0;
-    for (; l<old_tot; l++)
+    for (int j=0; j<r->nvars; j++)
     {
-      if (v_remap_totals[l])
-        free(v_remap[l]);
+      int32_t v=region_get(p,RC_type_size(r->var_type[j]));
+      if (o && r->var_remap[j]>=0)
+        o->set_var(r->var_remap[j],v);
     }
-    free(v_remap_totals);
-    free(s_remap_totals);
-    free(o_remap);
-    free(o_backmap);
-    free(s_remap);
-    free(v_remap);
+    // same check as load_objects(), the frame may be gone since the save
+    if (o && o->current_frame>=figures[o->otype]->get_sequence(o->state)->length())
+      o->current_frame=0;
+
+    int tv=region_get(p,2);
+    for (int k=0; k<tv; k++)
+    {
+      int32_t v=region_get(p,4);
+      if (o && r->v_remap && k<r->v_remap_totals[t])
+      {
+        int remap=*(r->v_remap[t]+k);
+        if (remap!=-1 && remap<figures[o->otype]->tv)
+          o->lvars[remap]=v;
+      }
+    }
+
+    if (!o)
+      continue;
+    if (o->x<0 || o->y<0)
+    {
+      delete o;
+      continue;
+    }
+
+    // appended, the objects loaded with the level keep their tick order
+    total_objs++;
+    o->next=NULL;
+    if (!first)
+      first=o;
+    else
+      last->next=o;
+    last=o;
+    if (!added)
+      added=o;
+  }
+
+  free(g->data);
+  g->data=NULL;
+  r->left--;
+
+  level *old=current_level;
+  current_level=this;
+  for (game_object *o=added; o; o=o->next)
+    o->reload_notify();
+  current_level=old;
+}
+
+void level::load_regions(int32_t x1, int32_t y1, int32_t x2, int32_t y2)
+{
+  int32_t d=regions->range;
+  for (int i=0; i<regions->total; i++)
+  {
+    object_region *g=regions->region+i;
+    if (g->data && g->x2+d>=x1 && g->x1-d<=x2 && g->y2+d>=y1 && g->y1-d<=y2)
+      load_region(i);
+  }
+
+  if (!regions->left)
+  {
+    delete regions;
+    regions=NULL;
+  }
+}
+
+void level::load_all_regions()
+{
+  if (regions)
+    load_regions(INT_MIN/2,INT_MIN/2,INT_MAX/2,INT_MAX/2);
+}
+
+// Converts the objects of region n, which were never created, to the
+// numbering write_regions() uses. Returns the size they take and sets
+// count, p may be NULL to only get those.
+int32_t level::recode_region(int n, uint8_t *p, int32_t &count)
+{
+  object_regions *r=regions;
+  object_region *g=r->region+n;
+  uint8_t *q=g->data;
+  int32_t size=0,vars[TOTAL_OBJECT_VARS];
+  int j,k;
+  count=0;
+
+  for (int32_t i=0; i<g->count; i++)
+  {
+    int t=region_get(q,2),st=region_get(q,2);
+    int type=t<r->old_tot ? r->o_remap[t] : 0xffff;
+
+    // load_region() leaves the vars missing from the file as they are
+    for (j=0; j<TOTAL_OBJECT_VARS; j++)
+      vars[j]=default_simple.get_var(j);
+    for (j=0; j<r->nvars; j++)
+    {
+      int32_t v=region_get(q,RC_type_size(r->var_type[j]));
+      if (r->var_remap[j]>=0)
+        vars[r->var_remap[j]]=v;
+    }
+    int tv=region_get(q,2);
+    uint8_t *old_lvars=q;
+    q+=tv*4;
+
+    if (type>=total_objects)
+      continue;
+    character_type *c=figures[type];
+    count++;
+    size+=2+2+2+c->tv*4;
+    for (j=0; j<TOTAL_OBJECT_VARS; j++)
+      size+=RC_type_size(object_descriptions[j].type);
+    if (!p)
+      continue;
+
+    int state=stopped;
+    if (st<r->s_remap_totals[t] && c->has_sequence((character_state)r->s_remap[t][st]))
+      state=r->s_remap[t][st];
+    int reduced=0;
+    for (j=0; j<state; j++)
+      if (c->seq[j])
+        reduced++;
+
+    region_put(p,type,2);
+    region_put(p,reduced,2);
+    for (j=0; j<TOTAL_OBJECT_VARS; j++)
+      region_put(p,vars[j],RC_type_size(object_descriptions[j].type));
+    region_put(p,c->tv,2);
+    uint8_t *lvars=p;
+    for (k=0; k<c->tv; k++)
+      region_put(p,0,4);
+    for (k=0; k<tv; k++)
+    {
+      int32_t v=region_get(old_lvars,4);
+      if (r->v_remap && k<r->v_remap_totals[t])
+      {
+        int remap=*(r->v_remap[t]+k);
+        if (remap!=-1 && remap<c->tv)
+        {
+          uint8_t *l=lvars+remap*4;
+          region_put(l,v,4);
+        }
+      }
+    }
+  }
+  return size;
+}
+
+// Splits save_list into the objects written by write_objects(), returned
+// in eager, and an "object_regions" entry for the others. Only the objects
+// far from the starts go in the entry when split is set, the regions that
+// were never loaded always do.
+uint8_t *level::write_regions(object_node *save_list, object_node *players,
+                              int split, object_node *&eager, int32_t &size)
+{
+  int32_t t=0,tl=0,ts=0,i;
+  object_node *o;
+  for (o=save_list; o; o=o->next)
+  {
+    t++;
+    tl+=o->me->total_objects();
+  }
+
+  // objects linked to each other have to stay in the link table
+  game_object **targets=(game_object **)malloc((tl+1)*sizeof(game_object *));
+  for (tl=0,o=save_list; o; o=o->next)
+    for (i=0; i<o->me->total_objects(); i++)
+      targets[tl++]=o->me->get_object(i);
+
+  // the area around the starts is needed right away
+  int32_t *starts=(int32_t *)malloc((t+1)*2*sizeof(int32_t));
+  for (o=save_list; o; o=o->next)
+    if (o->me->otype==start_position_type)
+    {
+      starts[ts*2]=o->me->x;
+      starts[ts*2+1]=o->me->y;
+      ts++;
+    }
+  for (o=players; o; o=o->next)
+  {
+    starts[ts*2]=o->me->x;
+    starts[ts*2+1]=o->me->y;
+    ts++;
   }
 
+  int cw=fg_width*the_game->ftile_width()/LEVEL_REGION_SIZE+1,
+      ch=fg_height*the_game->ftile_height()/LEVEL_REGION_SIZE+1;
+  object_node **cells=(object_node **)calloc(cw*ch,sizeof(object_node *));
+  object_node *eager_last=NULL;
+  eager=NULL;
+
+  int32_t lazy=0;
+  for (o=save_list; o; o=o->next)
+  {
+    game_object *g=o->me;
+    int keep=g->total_objects() || g->total_lights();
+    for (i=0; !keep && i<tl; i++)
+      keep=targets[i]==g;
+    keep|=!split;
+    for (i=0; !keep && i<ts; i++)
+      keep=abs(g->x-starts[i*2])<LEVEL_REGION_SIZE
+           && abs(g->y-starts[i*2+1])<LEVEL_REGION_SIZE;
+
+    if (keep)
+    {
+      object_node *n=new object_node(g,NULL);
+      if (eager_last)
+        eager_last->next=n;
+      else
+        eager=n;
+      eager_last=n;
+    } else
+    {
+      int cx=Max(0,Min(cw-1,(int)(g->x/LEVEL_REGION_SIZE))),
+          cy=Max(0,Min(ch-1,(int)(g->y/LEVEL_REGION_SIZE)));
+      cells[cx+cy*cw]=new object_node(g,cells[cx+cy*cw]);
+      lazy++;
+    }
+  }
+  free(targets);
+  free(starts);
+
+  int32_t obj_size=2+2+2;
+  for (i=0; i<TOTAL_OBJECT_VARS; i++)
+    obj_size+=RC_type_size(object_descriptions[i].type);
+
+  int32_t nregions=0;
+  size=2+4;
+  for (i=0; i<TOTAL_OBJECT_VARS; i++)
+    size+=1+strlen(object_descriptions[i].name)+1+1;
+  for (i=0; i<cw*ch; i++)
+  {
+    if (!cells[i])
+      continue;
+    nregions++;
+    size+=6*4;
+    for (o=cells[i]; o; o=o->next)
+      size+=obj_size+figures[o->me->otype]->tv*4;
+  }
+  int32_t count;
+  for (i=0; regions && i<regions->total; i++)
+    if (regions->region[i].data)
+    {
+      nregions++;
+      size+=6*4+recode_region(i,NULL,count);
+    }
+
+  uint8_t *ret=(uint8_t *)malloc(size),*p=ret;
+  region_put(p,TOTAL_OBJECT_VARS,2);
+  for (i=0; i<TOTAL_OBJECT_VARS; i++)
+  {
+    int len=strlen(object_descriptions[i].name)+1;
+    region_put(p,len,1);
+    memcpy(p,object_descriptions[i].name,len);
+    p+=len;
+    region_put(p,object_descriptions[i].type,1);
+  }
+
+  region_put(p,nregions,4);
+  for (i=0; i<cw*ch; i++)
+  {
+    if (!cells[i])
+      continue;
+
+    // the list was built backwards, put it back in level order
+    object_node *rev=NULL;
+    while (cells[i])
+    {
+      o=cells[i];
+      cells[i]=o->next;
+      o->next=rev;
+      rev=o;
+    }
+
+    int32_t x1=INT_MAX,y1=INT_MAX,x2=INT_MIN,y2=INT_MIN,count=0,rsize=0;
+    for (o=rev; o; o=o->next)
+    {
+      x1=Min(x1,o->me->x); y1=Min(y1,o->me->y);
+      x2=Max(x2,o->me->x); y2=Max(y2,o->me->y);
+      count++;
+      rsize+=obj_size+figures[o->me->otype]->tv*4;
+    }
+    region_put(p,x1,4); region_put(p,y1,4);
+    region_put(p,x2,4); region_put(p,y2,4);
+    region_put(p,count,4);
+    region_put(p,rsize,4);
+
+    for (o=rev; o; o=o->next)
+    {
+      game_object *g=o->me;
+      region_put(p,g->type(),2);
+      region_put(p,g->reduced_state(),2);
+      for (int j=0; j<TOTAL_OBJECT_VARS; j++)
+        region_put(p,g->get_var(j),RC_type_size(object_descriptions[j].type));
+      region_put(p,figures[g->otype]->tv,2);
+      for (int k=0; k<figures[g->otype]->tv; k++)
+        region_put(p,g->lvars[k],4);
+    }
+    delete_object_list(rev);
+  }
+  free(cells);
+
+  for (i=0; regions && i<regions->total; i++)
+  {
+    object_region *g=regions->region+i;
+    if (!g->data)
+      continue;
+    int32_t rsize=recode_region(i,NULL,count);
+    region_put(p,g->x1,4); region_put(p,g->y1,4);
+    region_put(p,g->x2,4); region_put(p,g->y2,4);
+    region_put(p,count,4);
+    region_put(p,rsize,4);
+    recode_region(i,p,count);
+    p+=rsize;
+  }
+
+  return ret;
 }
 
-level::level(spec_directory *sd, bFILE *fp, char const *lev_name)
+level::level(spec_directory *sd, bFILE *file, char const *lev_name)
 {
   spec_entry *e;
   area_list=NULL;
@@ -1296,6 +1914,23 @@ level::level(spec_directory *sd, bFILE *fp, char const *lev_name)
   all_block_list_size=all_block_total=0;
   first_name=NULL;
 
+  thash=0;
+  ohash=NULL;
+  oticked=NULL;
+  ohash_total=ohash_size=0;
+
+  buckets=NULL;
+  total_buckets=buckets_valid=0;
+  type_bits=NULL;
+  query_type=NULL;
+  query_offsets=NULL;
+  query_offsets_size=0;
+  queries.calls=queries.examined=0;
+  last_queries=queries;
+  ray_memos=NULL;
+  map_gen=1;
+  memset(&rays,0,sizeof(rays));
+
   the_game->need_refresh();
 
   char cmd[100];
@@ -1303,6 +1938,13 @@ level::level(spec_directory *sd, bFILE *fp, char const *lev_name)
   stack_stat stat(cmd);
   Name = strdup(lev_name);
 
+  // read every section at once, then parse them from memory
+  Timer load_timer;
+  spec_entry *load_all=sd->find("player_info");
+  level_stage stage(sd,file,check_fg_tiles,load_all!=NULL,check_bg_tiles);
+  bFILE *fp=stage.open_failure() ? file : &stage;
+  float stage_ms=load_timer.GetMs();
+
   e=sd->find("first name");
   if (e)
   {
@@ -1315,10 +1957,28 @@ level::level(spec_directory *sd, bFILE *fp, char const *lev_name)
     first_name = strdup(Name);
   }
 
-  e=sd->find("fgmap");
-  int no_fg=0,no_bg=0;
+  fg_bands=bg_bands=NULL;
+  regions=NULL;
+
+  e=sd->find("fgmap.v2");
+  int no_fg=0,no_bg=0,fg_checked=0,bg_checked=0;
 
   if (e)
+  {
+    // format v2, bands are decoded and checked the first time they are used
+    fp->seek(e->offset,0);
+    fg_bands=new map_bands(check_fg_tiles,load_all!=NULL);
+    if (!fg_bands->read(fp,map_fg,fg_width,fg_height))
+    {
+      the_game->show_help("Warning foreground map damaged");
+      delete fg_bands;
+      fg_bands=NULL;
+      no_fg=1;
+    }
+  }
+  else if ((map_fg=stage.take_map(0,fg_width,fg_height)))
+    fg_checked=1;              // decoded and checked by the map thread
+  else if ((e=sd->find("fgmap")))
   {
     fp->seek(e->offset,0);
     fg_width=fp->read_uint32();
@@ -1335,8 +1995,22 @@ level::level(spec_directory *sd, bFILE *fp, char const *lev_name)
   }
   stat_man->update(5);
 
-  e=sd->find("bgmap");
+  e=sd->find("bgmap.v2");
   if (e)
+  {
+    fp->seek(e->offset,0);
+    bg_bands=new map_bands(check_bg_tiles,0);
+    if (!bg_bands->read(fp,map_bg,bg_width,bg_height))
+    {
+      the_game->show_help("Warning background map damaged");
+      delete bg_bands;
+      bg_bands=NULL;
+      no_bg=1;
+    }
+  }
+  else if ((map_bg=stage.take_map(1,bg_width,bg_height)))
+    bg_checked=1;
+  else if ((e=sd->find("bgmap")))
   {
     fp->seek(e->offset,0);
     bg_width=fp->read_uint32();
@@ -1370,23 +2044,11 @@ level::level(spec_directory *sd, bFILE *fp, char const *lev_name)
   stat_man->update(10);
 
   /***************** Check map for non exsistant tiles **************************/
-  int32_t i,w;
-  uint16_t *m;
-  spec_entry *load_all=sd->find("player_info");
-  for (i=0,w=fg_width*fg_height,m=map_fg; i<w; i++,m++)
-  {
-    if (!load_all)
-      (*m)=(*m)&(~0x8000);    // clear the has-seen bit on the tile
-
-    if (fgvalue(*m)>=nforetiles || foretiles[fgvalue(*m)]<0)
-      *m=0;
-  }
-
-  for (i=0,w=bg_width*bg_height,m=map_bg; i<w; i++,m++)
-  {
-    if ( (bgvalue(*m)>=nbacktiles) || backtiles[bgvalue(*m)]<0)
-       *m=0;
-  }
+  if (!fg_bands && !fg_checked)
+    check_fg_tiles(map_fg,fg_width*fg_height,load_all!=NULL);
+  if (!bg_bands && !bg_checked)
+    check_bg_tiles(map_bg,bg_width*bg_height,0);
+  float maps_ms=load_timer.GetMs();
 
   load_options(sd,fp);
   stat_man->update(15);
@@ -1394,6 +2056,7 @@ level::level(spec_directory *sd, bFILE *fp, char const *lev_name)
 //  first=first_active=last=NULL;
   load_objects(sd,fp);
   stat_man->update(25);
+  float objects_ms=load_timer.GetMs();
 
   object_node *players,*objs;
   players=make_player_onodes();
@@ -1402,8 +2065,10 @@ level::level(spec_directory *sd, bFILE *fp, char const *lev_name)
 
 
   read_lights(sd,fp,lev_name);
+  float lights_ms=load_timer.GetMs();
   load_links(fp,sd,objs,players);
   int players_got_loaded=load_player_info(fp,sd,objs);
+  float links_ms=load_timer.GetMs();
 
 
   game_object *l=first;
@@ -1416,6 +2081,7 @@ level::level(spec_directory *sd, bFILE *fp, char const *lev_name)
   }
 
   load_cache_info(sd,fp);
+  float cache_ms=load_timer.GetMs();
 
   if (!players_got_loaded)
   {
@@ -1438,6 +2104,17 @@ level::level(spec_directory *sd, bFILE *fp, char const *lev_name)
   delete_object_list(players);
   delete_object_list(objs);
 
+  // the editor works on every object, and demos can't depend on the size
+  // of the views to create them at the same tick
+  if ((dev&EDIT_MODE) || demo_man.current_state()!=demo_manager::NORMAL)
+    load_all_regions();
+
+  if (!level_load_times)
+    return ;
+  stage.log_times(lev_name);
+  dprintf("  staging %.2f ms, then maps %.2f ms  objects %.2f ms  lights %.2f ms"
+          "  links %.2f ms  cache %.2f ms  setup %.2f ms\n",stage_ms,maps_ms,
+          objects_ms,lights_ms,links_ms,cache_ms,load_timer.GetMs());
 }
 
 
@@ -1523,7 +2200,8 @@ void level::level_loaded_notify()
 
 
 bFILE *level::create_dir(char *filename, int save_all,
-             object_node *save_list, object_node *exclude_list)
+             object_node *save_list, object_node *exclude_list,
+             level_v2_entries *v2)
 {
   spec_directory sd;
   sd.add_by_hand(new spec_entry(SPEC_DATA_ARRAY,"Copyright 1995 Crack dot Com, All Rights reserved",NULL,0,0));
@@ -1532,8 +2210,15 @@ bFILE *level::create_dir(char *filename, int save_all,
 
 
 
-  sd.add_by_hand(new spec_entry(SPEC_GRUE_FGMAP,"fgmap",NULL,4+4+fg_width*fg_height*2,0));
-  sd.add_by_hand(new spec_entry(SPEC_GRUE_BGMAP,"bgmap",NULL,4+4+bg_width*bg_height*2,0));
+  if (v2)
+  {
+    sd.add_by_hand(new spec_entry(SPEC_GRUE_FGMAP,"fgmap.v2",NULL,v2->fg_size,0));
+    sd.add_by_hand(new spec_entry(SPEC_GRUE_BGMAP,"bgmap.v2",NULL,v2->bg_size,0));
+  } else
+  {
+    sd.add_by_hand(new spec_entry(SPEC_GRUE_FGMAP,"fgmap",NULL,4+4+fg_width*fg_height*2,0));
+    sd.add_by_hand(new spec_entry(SPEC_GRUE_BGMAP,"bgmap",NULL,4+4+bg_width*bg_height*2,0));
+  }
   sd.add_by_hand(new spec_entry(SPEC_DATA_ARRAY,"bg_scroll_rate",NULL,1+4*4,0));
 
   int ta=0;
@@ -1611,6 +2296,8 @@ bFILE *level::create_dir(char *filename, int save_all,
 
   sd.add_by_hand(new spec_entry(SPEC_DATA_ARRAY,"object_links",NULL,1+4+total_object_links(save_list)*8,0));
   sd.add_by_hand(new spec_entry(SPEC_DATA_ARRAY,"light_links",NULL,1+4+total_light_links(save_list)*8,0));
+  if (v2)
+    sd.add_by_hand(new spec_entry(SPEC_DATA_ARRAY,"object_regions",NULL,v2->regions_size,0));
 
   if (save_all)
   {
@@ -2201,6 +2888,16 @@ void level::load_cache_info(spec_directory *sd, bFILE *fp)
 }
 
 
+static void free_v2_entries(level_v2_entries *v2)
+{
+    if( v2 )
+    {
+        free( v2->fg );
+        free( v2->bg );
+        free( v2->regions );
+    }
+}
+
 int level::save(char const *filename, int save_all)
 {
     char name[255], bkname[255];
@@ -2254,7 +2951,28 @@ int level::save(char const *filename, int save_all)
 
     objs = make_not_list(players);     // negate the above list
 
-    bFILE *fp = create_dir( name, save_all, objs, players);
+    // the regions and bands not loaded yet are written as they are, so
+    // saving (a demo keyframe too) creates no object and decodes no tile
+    level_v2_entries v2, *use_v2 = NULL;
+    if( ( level_save_v2 && !save_all ) || regions || fg_bands || bg_bands )
+    {
+        object_node *eager;
+        v2.regions = write_regions( objs, players, level_save_v2 && !save_all,
+                                    eager, v2.regions_size );
+        delete_object_list( objs );
+        objs = eager;
+        if( fg_bands )
+            v2.fg = fg_bands->repack( v2.fg_size );
+        else
+            v2.fg = map_bands::pack( map_fg, fg_width, fg_height, v2.fg_size );
+        if( bg_bands )
+            v2.bg = bg_bands->repack( v2.bg_size );
+        else
+            v2.bg = map_bands::pack( map_bg, bg_width, bg_height, v2.bg_size );
+        use_v2 = &v2;
+    }
+
+    bFILE *fp = create_dir( name, save_all, objs, players, use_v2 );
     if( fp != NULL )
     {
         if( !fp->open_failure() )
@@ -2270,61 +2988,72 @@ int level::save(char const *filename, int save_all)
                 fp->write_uint8( 0 );
             }
 
-            fp->write_uint32( fg_width );
-            fp->write_uint32( fg_height );
-
-            int t  = fg_width * fg_height;
-            uint16_t *rm = map_fg;
-            for (; t; t--,rm++)
+            if( use_v2 )
             {
-                uint16_t x = *rm;
-                x = lstl(x);            // convert to intel endianess
-                *rm = x;
+                fp->write( v2.fg, v2.fg_size );
+                fp->write( v2.bg, v2.bg_size );
             }
-
-            fp->write( (char *)map_fg, 2 * fg_width * fg_height );
-            t = fg_width * fg_height;
-            rm = map_fg;
-            for (; t; t--,rm++)
+            else
             {
-                uint16_t x = *rm;
-                x = lstl( x );            // convert to intel endianess
-                *rm = x;
-            }
+                fp->write_uint32( fg_width );
+                fp->write_uint32( fg_height );
+
+                int t  = fg_width * fg_height;
+                uint16_t *rm = map_fg;
+                for (; t; t--,rm++)
+                {
+                    uint16_t x = *rm;
+                    x = lstl(x);            // convert to intel endianess
+                    *rm = x;
+                }
 
-            fp->write_uint32( bg_width );
-            fp->write_uint32( bg_height );
-            t = bg_width * bg_height;
-            rm = map_bg;
+                fp->write( (char *)map_fg, 2 * fg_width * fg_height );
+                t = fg_width * fg_height;
+                rm = map_fg;
+                for (; t; t--,rm++)
+                {
+                    uint16_t x = *rm;
+                    x = lstl( x );            // convert to intel endianess
+                    *rm = x;
+                }
 
-            for (; t; t--,rm++)
-            {
-                uint16_t x=*rm;
-                x = lstl( x );        // convert to intel endianess
-                *rm = x;
-            }
+                fp->write_uint32( bg_width );
+                fp->write_uint32( bg_height );
+                t = bg_width * bg_height;
+                rm = map_bg;
 
-            fp->write( (char *)map_bg, 2 * bg_width * bg_height );
-            rm = map_bg;
-            t = bg_width*bg_height;
+                for (; t; t--,rm++)
+                {
+                    uint16_t x=*rm;
+                    x = lstl( x );        // convert to intel endianess
+                    *rm = x;
+                }
 
-            for (; t; t--,rm++)
-            {
-                uint16_t x = *rm;
-                x = lstl( x );        // convert to intel endianess
-                *rm = x;
+                fp->write( (char *)map_bg, 2 * bg_width * bg_height );
+                rm = map_bg;
+                t = bg_width*bg_height;
+
+                for (; t; t--,rm++)
+                {
+                    uint16_t x = *rm;
+                    x = lstl( x );        // convert to intel endianess
+                    *rm = x;
+                }
             }
 
             write_options( fp );
             write_objects( fp, objs );
             write_lights( fp );
             write_links( fp, objs, players );
+            if( use_v2 )
+                fp->write( v2.regions, v2.regions_size );
             if( save_all )
             {
                 write_player_info( fp, objs );
                 write_thumb_nail( fp,screen );
             }
 
+            free_v2_entries( use_v2 );
             delete fp;
 #if (defined(__MACH__) || !defined(__APPLE__))
             chmod( name, S_IRWXU | S_IRWXG | S_IRWXO );
@@ -2334,6 +3063,7 @@ int level::save(char const *filename, int save_all)
         else
         {
             the_game->show_help( "Unable to open file for saving\n" );
+            free_v2_entries( use_v2 );
             delete fp;
             return 0;
         }
@@ -2341,6 +3071,7 @@ int level::save(char const *filename, int save_all)
     else
     {
         the_game->show_help( "Unable to open file for saving.\n" );
+        free_v2_entries( use_v2 );
         printf( "\nFailed to save game.\n" );
         printf( "I was trying to save to: '%s'\n\tPath: '%s'\n\tFile: '%s'\n", name, get_save_filename_prefix(), filename );
         printf( "\nPlease send an email to:\n\ttrandor@labyrinth.net.au\nwith these details.\nThanks.\n" );
@@ -2374,8 +3105,27 @@ level::level(int width, int height, char const *name)
   Name=NULL;
   first_name=NULL;
 
+  thash=0;
+  ohash=NULL;
+  oticked=NULL;
+  ohash_total=ohash_size=0;
+
+  buckets=NULL;
+  total_buckets=buckets_valid=0;
+  type_bits=NULL;
+  query_type=NULL;
+  query_offsets=NULL;
+  query_offsets_size=0;
+  queries.calls=queries.examined=0;
+  last_queries=queries;
+  ray_memos=NULL;
+  map_gen=1;
+  memset(&rays,0,sizeof(rays));
+
   set_name(name);
   first=first_active=NULL;
+  fg_bands=bg_bands=NULL;
+  regions=NULL;
 
   fg_width=width;
   fg_height=height;
@@ -2515,6 +3265,18 @@ void level::remove_object(game_object *who)
       o->next_active=who->next_active;
   }
 
+  if (buckets_valid && who->otype<total_buckets)
+  {
+    active_bucket *b=buckets+who->otype;
+    for (int i=0; i<b->count; i++)
+      if (b->e[i].o==who)
+      {
+        memmove(b->e+i,b->e+i+1,(b->count-i-1)*sizeof(active_entry));
+        b->count--;
+        break;
+      }
+  }
+
   if (who->flags()&KNOWN_FLAG)
   {
     game_object *o=first;
@@ -2552,7 +3314,7 @@ void level::remove_object(game_object *who)
 void level::to_front(game_object *o)  // move to end of list, so we are drawn last, therefore top
 {
   if (o==last) return ;
-  first_active=NULL;     // make sure nothing goes screwy with the active list
+  clear_active_list();   // make sure nothing goes screwy with the active list
 
   if (o==first)
     first=first->next;
@@ -2572,7 +3334,7 @@ void level::to_front(game_object *o)  // move to end of list, so we are drawn la
 void level::to_back(game_object *o)   // to make the character drawn in back, put at front of list
 {
   if (o==first) return;
-  first_active=NULL;     // make sure nothing goes screwy with the active list
+  clear_active_list();   // make sure nothing goes screwy with the active list
 
   game_object *w=first;
   for (; w && w->next!=o; w=w->next);
@@ -2604,24 +3366,92 @@ game_object *level::find_object(int32_t x, int32_t y)
 }
 
 int32_t last_tile_hit_x,last_tile_hit_y;
+int raycast_check=0;
+int raycast_reference=0;
 
 #define remapx(x) (x==0 ? -1 : x==tl-1 ? tl+1 : x)
 #define remapy(y) (y==0 ? -1 : y==th-1 ? th+1 : y)
 
-void level::foreground_intersect(int32_t x1, int32_t y1, int32_t &x2, int32_t &y2)
+#define RAY_MEMO_SIZE 512
+
+struct ray_memo
 {
-/*  if (x1==x2)
-  { vforeground_intersect(x1,y1,y2);
-    return ;
-  }  */
+  int32_t x1,y1,x2,y2;          // the query
+  int32_t rx2,ry2,hitx,hity;    // its result, hitx<0 if nothing was hit
+  uint32_t tick,gen;
+};
 
-  int32_t tl=the_game->ftile_width(),th=the_game->ftile_height(),
-    j,
-    xp1,yp1,xp2,yp2,    // starting and ending points of block line segment
-    swap;               // temp var
-  int32_t blockx1,blocky1,blockx2,blocky2,block,bx,by;
-  point_list *block_list;
-  unsigned char *bdat;
+// Foretile boundaries don't change once loaded, so which tiles have one
+// is only looked up once: 0 not known yet, 1 no boundary, 2 boundary
+static uint8_t *tile_solid=NULL;
+static int tile_solid_total=0;
+
+static inline int tile_has_boundary(int block)
+{
+  if (block<=BLACK)             // don't check BLACK, should be no points in it
+    return 0;
+  if (block>=nforetiles)        // drawn as BLACK, but its points are checked
+    return the_game->get_fg(block)->points->tot>1;
+
+  if (tile_solid_total!=nforetiles)
+  {
+    tile_solid=(uint8_t *)realloc(tile_solid,nforetiles);
+    memset(tile_solid,0,nforetiles);
+    tile_solid_total=nforetiles;
+  }
+  if (!tile_solid[block])
+    tile_solid[block]=the_game->get_fg(block)->points->tot>1 ? 2 : 1;
+  return tile_solid[block]==2;
+}
+
+static inline int32_t floor_div(int32_t a, int32_t b)
+{
+  return a>=0 ? a/b : -((-a+b-1)/b);
+}
+
+// Clips (x1,y1)-(x2,y2) against the boundary of the tile at xo,yo straight
+// from its points, returns 1 if the end point moved
+static int clip_tile(int32_t x1, int32_t y1, int32_t &x2, int32_t &y2,
+                     int block, int32_t xo, int32_t yo, int32_t tl, int32_t th)
+{
+  int32_t xp1,yp1,xp2,yp2;    // starting and ending points of block line segment
+  foretile *f=the_game->get_fg(block);
+  point_list *block_list=f->points;
+  unsigned char total=block_list->tot;
+  unsigned char *bdat=block_list->data;
+  unsigned char *ins=f->points->inside;
+  int hit=0;
+  for (int j=0; j<total-1; j++,ins++)
+  {
+    // find the starting and ending points for this segment
+    xp1=xo+remapx(*bdat);
+    bdat++;
+
+    yp1=yo+remapy(*bdat);
+    bdat++;
+
+    xp2=xo+remapx(*bdat);
+    yp2=yo+remapy(bdat[1]);
+
+    int32_t ox2=x2,oy2=y2;
+    if (*ins)
+      setback_intersect(x1,y1,x2,y2,xp1,yp1,xp2,yp2,1);
+    else
+      setback_intersect(x1,y1,x2,y2,xp1,yp1,xp2,yp2,-1);
+    if (ox2!=x2 || oy2!=y2)
+      hit=1;
+  }
+  return hit;
+}
+
+// The tile range both versions work on. As it always did, this moves the
+// end point to the last pixel of the map when the range reaches its edge.
+// Returns 0 if there is nothing to check.
+int level::ray_bounds(int32_t x1, int32_t y1, int32_t &x2, int32_t &y2,
+                      int32_t &blockx1, int32_t &blocky1,
+                      int32_t &blockx2, int32_t &blocky2)
+{
+  int32_t tl=the_game->ftile_width(),th=the_game->ftile_height(),swap;
 
   blockx1=x1;
   blocky1=y1;
@@ -2640,73 +3470,262 @@ void level::foreground_intersect(int32_t x1, int32_t y1, int32_t &x2, int32_t &y
   blockx1=Max(blockx1,0);
   blocky1=Max(blocky1,0);
 
-  if ((blockx1>blockx2) || (blocky1>blocky2)) return ;
+  return blockx1<=blockx2 && blocky1<=blocky2;
+}
+
+// The original check of every tile of the bounding box, kept for -raycheck
+// and -raytest
+void level::bbox_intersect(int32_t x1, int32_t y1, int32_t &x2, int32_t &y2,
+                           int32_t &hitx, int32_t &hity)
+{
+  int32_t tl=the_game->ftile_width(),th=the_game->ftile_height();
+  int32_t blockx1,blocky1,blockx2,blocky2,block,bx,by;
+  if (!ray_bounds(x1,y1,x2,y2,blockx1,blocky1,blockx2,blocky2))
+    return ;
 
   // now check all the map positions this line could intersect
   for (bx=blockx1; bx<=blockx2; bx++)
-  {
     for (by=blocky1; by<=blocky2; by++)
     {
       block=the_game->get_map_fg(bx,by);
-      if (block>BLACK)        // don't check BLACK, should be no points in it
-      {
-        // now check the all the line segments in the block
-        foretile *f=the_game->get_fg(block);
-        block_list=f->points;
-        unsigned char total=block_list->tot;
-        bdat=block_list->data;
-        unsigned char *ins=f->points->inside;
-    int32_t xo=bx*tl,yo=by*th;
-        for (j=0; j<total-1; j++,ins++)
-        {
-          // find the starting and ending points for this segment
-      xp1=xo+remapx(*bdat);
-      bdat++;
+      if (block>BLACK && clip_tile(x1,y1,x2,y2,block,bx*tl,by*th,tl,th))
+      {
+        hitx=bx;
+        hity=by;
+      }
+    }
+}
 
-      yp1=yo+remapy(*bdat);
-      bdat++;
+// Only visits the tiles the segment goes through, column by column, in the
+// same order as bbox_intersect(): the end point is clipped by each tile in
+// turn, so the order decides the result when several boundaries are hit.
+void level::raycast(int32_t x1, int32_t y1, int32_t &x2, int32_t &y2,
+                    int32_t &hitx, int32_t &hity)
+{
+  int32_t tl=the_game->ftile_width(),th=the_game->ftile_height();
+  int32_t blockx1,blocky1,blockx2,blocky2,bx,by;
+  if (!ray_bounds(x1,y1,x2,y2,blockx1,blocky1,blockx2,blocky2))
+    return ;
 
-      xp2=xo+remapx(*bdat);
-      yp2=yo+remapy(bdat[1]);
+  // tile boundaries reach one pixel into the next tile, the segment only
+  // gets shorter while it is clipped: look two pixels around the segment
+  // as it is now
+  int32_t sx1=Min(x1,x2),sx2=Max(x1,x2),sy1=Min(y1,y2),sy2=Max(y1,y2),
+          dx=x2-x1,dy=y2-y1;
+  int32_t cbx1=Max(blockx1,floor_div(sx1-tl-2,tl)),
+          cbx2=Min(blockx2,floor_div(sx2+2,tl));
 
+  for (bx=cbx1; bx<=cbx2; bx++)
+  {
+    int32_t cx1=Max(sx1,bx*tl-2),cx2=Min(sx2,bx*tl+tl+2),ylo,yhi;
+    if (cx1>cx2)
+      continue;
+    if (dx)
+    {
+      int32_t ya=y1+(int32_t)((int64_t)(cx1-x1)*dy/dx),
+              yb=y1+(int32_t)((int64_t)(cx2-x1)*dy/dx);
+      ylo=Max(sy1,Min(ya,yb)-1);   // -1/+1 for the rounding
+      yhi=Min(sy2,Max(ya,yb)+1);
+    } else
+    {
+      ylo=sy1;
+      yhi=sy2;
+    }
 
-      int32_t ox2=x2,oy2=y2;
-          if (*ins)
-            setback_intersect(x1,y1,x2,y2,xp1,yp1,xp2,yp2,1);
-          else
-            setback_intersect(x1,y1,x2,y2,xp1,yp1,xp2,yp2,-1);
-      if (ox2!=x2 || oy2!=y2)
+    int32_t cby1=Max(blocky1,floor_div(ylo-th-2,th)),
+            cby2=Min(blocky2,floor_div(yhi+2,th));
+    for (by=cby1; by<=cby2; by++)
+    {
+      int block=the_game->get_map_fg(bx,by);
+      if (!tile_has_boundary(block))
+        continue;
+      rays.tiles++;
+      if (setback_edges(x1,y1,x2,y2,the_game->get_fg(block)->edges,bx*tl,by*th))
       {
-        last_tile_hit_x=bx;
-        last_tile_hit_y=by;
+        hitx=bx;
+        hity=by;
       }
+    }
+  }
+}
 
-        }
-      }
+void level::foreground_intersect(int32_t x1, int32_t y1, int32_t &x2, int32_t &y2)
+{
+/*  if (x1==x2)
+  { vforeground_intersect(x1,y1,y2);
+    return ;
+  }  */
+
+  rays.calls++;
+  if (raycast_reference)
+  {
+    int32_t hitx=-1,hity=-1;
+    bbox_intersect(x1,y1,x2,y2,hitx,hity);
+    if (hitx>=0)
+    {
+      last_tile_hit_x=hitx;
+      last_tile_hit_y=hity;
     }
+    return ;
   }
+  if (raycast_check)
+  {
+    int32_t rx2=x2,ry2=y2,rhitx=-1,rhity=-1,hitx=-1,hity=-1,ox2=x2,oy2=y2;
+    bbox_intersect(x1,y1,rx2,ry2,rhitx,rhity);
+    raycast(x1,y1,x2,y2,hitx,hity);
+    if (rx2!=x2 || ry2!=y2 || rhitx!=hitx || rhity!=hity)
+    {
+      if (rays.mismatches<20)
+        dprintf("raycast: (%d,%d)-(%d,%d) gives (%d,%d) tile %d,%d, "
+                "expected (%d,%d) tile %d,%d\n",x1,y1,ox2,oy2,x2,y2,hitx,hity,
+                rx2,ry2,rhitx,rhity);
+      rays.mismatches++;
+      x2=rx2;             // keep the game going the way it used to
+      y2=ry2;
+      hitx=rhitx;
+      hity=rhity;
+    }
+    if (hitx>=0)
+    {
+      last_tile_hit_x=hitx;
+      last_tile_hit_y=hity;
+    }
+    return ;
+  }
+
+  // the same rays are often cast several times in a tick, by several
+  // objects looking at the same player or by one AI checking twice
+  if (!ray_memos)
+    ray_memos=(ray_memo *)calloc(RAY_MEMO_SIZE,sizeof(ray_memo));
+  uint32_t h=((uint32_t)x1*73856093u)^((uint32_t)y1*19349663u)
+             ^((uint32_t)x2*83492791u)^((uint32_t)y2*2654435761u);
+  ray_memo *m=ray_memos+((h^(h>>15))&(RAY_MEMO_SIZE-1));
+  if (m->tick==ctick && m->gen==map_gen && m->x1==x1 && m->y1==y1
+      && m->x2==x2 && m->y2==y2)
+  {
+    rays.memo_hits++;
+    x2=m->rx2;
+    y2=m->ry2;
+  } else
+  {
+    m->x1=x1; m->y1=y1; m->x2=x2; m->y2=y2;
+    m->hitx=m->hity=-1;
+    raycast(x1,y1,x2,y2,m->hitx,m->hity);
+    m->rx2=x2;
+    m->ry2=y2;
+    m->tick=ctick;
+    m->gen=map_gen;
+  }
+
+  if (m->hitx>=0)
+  {
+    last_tile_hit_x=m->hitx;
+    last_tile_hit_y=m->hity;
+  }
+}
+
+
+// Casts a ray with foreground_intersect() and with bbox_intersect(), returns
+// 1 if the end point or the tile hit differ
+int level::ray_differs(int32_t x1, int32_t y1, int32_t x2, int32_t y2)
+{
+  int32_t rx2=x2,ry2=y2,rhitx=-1,rhity=-1,ox2=x2,oy2=y2;
+  bbox_intersect(x1,y1,rx2,ry2,rhitx,rhity);
+  last_tile_hit_x=last_tile_hit_y=-1;   // left alone when nothing is hit
+  foreground_intersect(x1,y1,x2,y2);
+  if (x2==rx2 && y2==ry2 && last_tile_hit_x==rhitx && last_tile_hit_y==rhity)
+    return 0;
+  if (rays.mismatches<20)
+    printf("  (%d,%d)-(%d,%d) gives (%d,%d) tile %d,%d, expected (%d,%d) "
+           "tile %d,%d\n",x1,y1,ox2,oy2,x2,y2,last_tile_hit_x,last_tile_hit_y,
+           rx2,ry2,rhitx,rhity);
+  rays.mismatches++;
+  return 1;
+}
+
+// -raytest: casts a fixed set of rays over the level with the tile walk and
+// the old bounding box scan, each twice so the second one comes from the
+// memo, then changes a tile under some of them with put_fg() within the same
+// tick and casts them again, which the memo may only answer if map_gen was
+// not bumped
+int level::check_raycasts(int count)
+{
+  int32_t tl=the_game->ftile_width(),th=the_game->ftile_height(),
+          w=fg_width*tl,h=fg_height*th;
+  int old_check=raycast_check,old_reference=raycast_reference;
+  raycast_check=raycast_reference=0;
+  ray_stats before=rays;
+
+  int solid=0;            // a tile to put where there is none
+  for (int y=0; y<fg_height && !solid; y++)
+    for (int x=0; x<fg_width && !solid; x++)
+      if (tile_has_boundary(get_fg(x,y)))
+        solid=get_fg(x,y);
+
+  uint32_t seed=0x2545f491;
+  int differ=0,changed=0,crossed=0;
+  for (int i=0; i<count; i++)
+  {
+    int32_t r[4];
+    for (int j=0; j<4; j++)
+    {
+      seed=seed*1103515245+12345;
+      r[j]=(seed>>8)&0xffffff;
+    }
+    int32_t x1=r[0]%w,y1=r[1]%h,   // every 8th ray vertical, then horizontal
+            x2=Min(Max(x1+(i%8==0 ? 0 : r[2]%(tl*16+1)-tl*8),0),w-1),
+            y2=Min(Max(y1+(i%8==1 ? 0 : r[3]%(th*16+1)-th*8),0),h-1);
+
+    differ+=ray_differs(x1,y1,x2,y2);
+    differ+=ray_differs(x1,y1,x2,y2);
+
+    if (i%4 || !solid)
+      continue;
+
+    // turn the tile in the middle of the ray into or out of a wall
+    int bx=Min(Max((x1+x2)/2/tl,0),fg_width-1),
+        by=Min(Max((y1+y2)/2/th,0),fg_height-1);
+    uint16_t raw=get_fgline(by)[bx];
+    int32_t ox2=x2,oy2=y2,nx2=x2,ny2=y2,hitx=-1,hity=-1,nhitx=-1,nhity=-1;
+    bbox_intersect(x1,y1,ox2,oy2,hitx,hity);
+    put_fg(bx,by,tile_has_boundary(fgvalue(raw)) ? 0 : solid);
+    bbox_intersect(x1,y1,nx2,ny2,nhitx,nhity);
+    if (nx2!=ox2 || ny2!=oy2 || nhitx!=hitx || nhity!=hity)
+      changed++;
+    crossed++;
+    differ+=ray_differs(x1,y1,x2,y2);
+    put_fg(bx,by,raw);
+    differ+=ray_differs(x1,y1,x2,y2);
+  }
+
+  printf("%d rays cast twice, %d again across a changed tile "
+         "(%d of them hit differently)\n",count,crossed,changed);
+  printf("  tile walk: %d rays, %d from the memo, %d tiles tested\n",
+         rays.calls-before.calls,rays.memo_hits-before.memo_hits,
+         rays.tiles-before.tiles);
+  printf("  %d mismatches\n",differ);
+
+  raycast_check=old_check;
+  raycast_reference=old_reference;
+  rays.mismatches=before.mismatches;
+  return differ;
 }
 
 
 void level::vforeground_intersect(int32_t x1, int32_t y1, int32_t &y2)
 {
-  int32_t tl=f_wid,th=f_hi,
-    j,
-    xp1,yp1,xp2,yp2;    // starting and ending points of block line segment temp var
   int32_t blocky1,blocky2,block,bx,by,checkx;
-  point_list *block_list;
-  unsigned char *bdat;
 
   int y_addback;
   if (y1>y2)
   {
-    blocky1=y2/th;
-    blocky2=y1/th;
+    blocky1=y2/f_hi;
+    blocky2=y1/f_hi;
     y_addback=blocky2*f_hi;
   } else
   {
-    blocky1=y1/th;
-    blocky2=y2/th;
+    blocky1=y1/f_hi;
+    blocky2=y2/f_hi;
     y_addback=blocky1*f_hi;
   }
 
@@ -2725,36 +3744,10 @@ void level::vforeground_intersect(int32_t x1, int32_t y1, int32_t &y2)
 
     // now check the all the line segments in the block
     foretile *f=the_game->get_fg(block);
-    block_list=f->points;
-
-    unsigned char total=block_list->tot;
-    bdat=block_list->data;
-    unsigned char *ins=f->points->inside;
-
-//    int32_t xo=bx*tl,yo=by*th;
-    for (j=0; j<total-1; j++,ins++)
+    if (setback_edges(checkx,y1,checkx,y2,f->edges,0,0))
     {
-      // find the starting and ending points for this segment
-      xp1=remapx(*bdat);
-      bdat++;
-
-      yp1=remapy(*bdat);
-      bdat++;
-
-      xp2=remapx(*bdat);
-      yp2=remapy(bdat[1]);
-
-
-      int32_t oy2=y2;
-      if (*ins)
-        setback_intersect(checkx,y1,checkx,y2,xp1,yp1,xp2,yp2,1);
-      else
-        setback_intersect(checkx,y1,checkx,y2,xp1,yp1,xp2,yp2,-1);
-      if (oy2!=y2)
-      {
-    last_tile_hit_x=bx;
-    last_tile_hit_y=by;
-      }
+      last_tile_hit_x=bx;
+      last_tile_hit_y=by;
     }
   }
   y2+=y_addback;
@@ -3162,33 +4155,151 @@ void level::add_all_block(game_object *who)
 }
 
 
+void level::build_buckets()
+{
+  if (total_buckets!=total_objects)
+  {
+    for (int i=0; i<total_buckets; i++)
+      free(buckets[i].e);
+    total_buckets=total_objects;
+    buckets=(active_bucket *)realloc(buckets,total_buckets*sizeof(active_bucket));
+    memset(buckets,0,total_buckets*sizeof(active_bucket));
+    type_bits=(uint32_t *)realloc(type_bits,((total_buckets+31)/32)*4);
+    memset(type_bits,0,((total_buckets+31)/32)*4);
+    query_type=(uint16_t *)realloc(query_type,total_buckets*sizeof(uint16_t));
+  }
+
+  int i;
+  for (i=0; i<total_buckets; i++)
+    buckets[i].count=0;
+
+  int32_t seq=0;
+  for (game_object *o=first_active; o; o=o->next_active,seq++)
+  {
+    if (o->otype>=total_buckets)
+      continue;
+    active_bucket *b=buckets+o->otype;
+    if (b->count==b->size)
+    {
+      b->size=b->size ? b->size*2 : 8;
+      b->e=(active_entry *)realloc(b->e,b->size*sizeof(active_entry));
+    }
+    b->e[b->count].o=o;
+    b->e[b->count].seq=seq;
+    b->count++;
+  }
+  buckets_valid=1;
+}
+
+void level::active_type_changed(game_object *o, int old_type)
+{
+  if (!buckets_valid || old_type==o->otype)
+    return;
+  if (old_type>=total_buckets || o->otype>=total_buckets)
+  {
+    buckets_valid=0;
+    return;
+  }
+
+  // move the entry over, keeping the new bucket in list order
+  active_bucket *from=buckets+old_type,*to=buckets+o->otype;
+  int i;
+  for (i=0; i<from->count && from->e[i].o!=o; i++);
+  if (i==from->count)
+    return;                        // not active
+  active_entry e=from->e[i];
+  memmove(from->e+i,from->e+i+1,(from->count-i-1)*sizeof(active_entry));
+  from->count--;
+
+  if (to->count==to->size)
+  {
+    to->size=to->size ? to->size*2 : 8;
+    to->e=(active_entry *)realloc(to->e,to->size*sizeof(active_entry));
+  }
+  for (i=to->count; i>0 && to->e[i-1].seq>e.seq; i--)
+    to->e[i]=to->e[i-1];
+  to->e[i]=e;
+  to->count++;
+}
+
+// Turns a Lisp list of types into query_type[], without duplicates
+int level::query_types(Cell *list)
+{
+  if (!buckets_valid)
+    build_buckets();
+
+  int n=0;
+  for (Cell *v=list; !NILP(v); v=CDR(v))
+  {
+    int32_t t=lnumber_value(CAR(v));
+    if (t>=0 && t<total_buckets && !(type_bits[t>>5]&(1u<<(t&31))))
+    {
+      type_bits[t>>5]|=1u<<(t&31);
+      query_type[n++]=t;
+    }
+  }
+  for (int i=0; i<n; i++)
+    type_bits[query_type[i]>>5]&=~(1u<<(query_type[i]&31));
+  return n;
+}
+
+// Makes room for count entries in each of the five arrays of
+// query_offsets: x and y offsets, distances, angles and bucket indices
+int32_t *level::query_scratch(int count)
+{
+  if (count>query_offsets_size)
+  {
+    query_offsets_size=Max(count,query_offsets_size*2);
+    query_offsets=(int32_t *)realloc(query_offsets,5*query_offsets_size*sizeof(int32_t));
+  }
+  return query_offsets;
+}
+
+// Both queries return the closest match, and the first one in the active
+// list when two are as close, like a walk of the whole active list would
 game_object *level::find_object_in_area(int32_t x, int32_t y, int32_t x1, int32_t y1, int32_t x2, int32_t y2,
                      Cell *list, game_object *exclude)
 {
   game_object *closest=NULL;
-  int32_t closest_distance=0xfffffff,distance,xo,yo;
-  game_object *o=first_active;
-  for (; o; o=o->next_active)
-  {
-    int32_t xp1,yp1,xp2,yp2;
-    o->picture_space(xp1,yp1,xp2,yp2);
+  int32_t closest_distance=0xfffffff,closest_seq=0,distance;
+  int n=query_types(list);
+  queries.calls++;
 
+  for (int i=0; i<n; i++)
+  {
+    active_bucket *b=buckets+query_type[i];
+    queries.examined+=b->count;
+    int32_t *dx=query_scratch(b->count),*dy=dx+query_offsets_size,
+            *dist=dy+query_offsets_size,*pick=dist+2*query_offsets_size;
+    int t=0;
+    for (int j=0; j<b->count; j++)
+    {
+      game_object *o=b->e[j].o;
+      if (o==exclude)
+        continue;
+
+      int32_t xp1,yp1,xp2,yp2;
+      o->picture_space(xp1,yp1,xp2,yp2);
+      if (xp1>x2 || xp2<x1 || yp1>y2 || yp2<y1)
+        continue;
+
+      dx[t]=o->x-x;
+      dy[t]=o->y-y;
+      pick[t++]=j;
+    }
 
-    if (!(xp1>x2 || xp2<x1 || yp1>y2 || yp2<y1) && o!=exclude)
+    // only the objects in the area need their distance
+    lisp_dist2_batch(dy,dx,dist,t);
+    for (int k=0; k<t; k++)
     {
-      // check to see if the type is in the list
-      Cell *v=list;
-      for (; !NILP(v) && lnumber_value(CAR(v))!=o->otype; v=CDR(v));
-      if (!NILP(v))
+      int j=pick[k];
+      distance=dist[k];
+      if (distance<closest_distance
+          || (distance==closest_distance && closest && b->e[j].seq<closest_seq))
       {
-    xo=abs(o->x-x);
-    yo=abs(o->y-y);
-    distance=xo*xo+yo*yo;
-    if (distance<closest_distance)
-    {
-      closest_distance=distance;
-      closest=o;
-    }
+        closest_distance=distance;
+        closest_seq=b->e[j].seq;
+        closest=b->e[j].o;
       }
     }
   }
@@ -3197,33 +4308,58 @@ game_object *level::find_object_in_area(int32_t x, int32_t y, int32_t x1, int32_
 
 
 
-
 game_object *level::find_object_in_angle(int32_t x, int32_t y, int32_t start_angle, int32_t end_angle,
                     void *list, game_object *exclude)
 {
   game_object *closest=NULL;
-  int32_t closest_distance=0xfffffff,distance,xo,yo;
-  game_object *o=first_active;
-  for (; o; o=o->next_active)
+  int32_t closest_distance=0xfffffff,closest_seq=0,distance,xo,yo;
+  int n=query_types((Cell *)list);
+  queries.calls++;
+
+  for (int i=0; i<n; i++)
   {
-    int32_t angle=lisp_atan2(o->y-y,o->x-x);
-    if (((start_angle<=end_angle && (angle>=start_angle && angle<=end_angle))
-    || (start_angle>end_angle && (angle>=start_angle || angle<=end_angle)))
-    && o!=exclude)
-    {
-      // check to see if the type is in the list
-      Cell *v=(Cell *)list;
-      for (; !NILP(v) && lnumber_value(CAR(v))!=o->otype; v=CDR(v));
-      if (!NILP(v))
-      {
-    xo=abs(o->x-x);
-    yo=abs(o->y-y);
-    distance=xo*xo+yo*yo;
-    if (distance<closest_distance)
+    active_bucket *b=buckets+query_type[i];
+    queries.examined+=b->count;
+    int32_t *dx=query_scratch(b->count),*dy=dx+query_offsets_size,
+            *dist=dy+query_offsets_size,*angle=dist+query_offsets_size,
+            *pick=angle+query_offsets_size;
+    int t=0;
+    for (int j=0; j<b->count; j++)
     {
-      closest_distance=distance;
-      closest=o;
+      game_object *o=b->e[j].o;
+      if (o==exclude)
+        continue;
+
+      // only objects closer than the best so far need the angle
+      xo=o->x-x;
+      yo=o->y-y;
+      distance=xo*xo+yo*yo;
+      if (distance>closest_distance
+          || (distance==closest_distance && (!closest || b->e[j].seq>closest_seq)))
+        continue;
+
+      dx[t]=xo;
+      dy[t]=yo;
+      dist[t]=distance;
+      pick[t++]=j;
     }
+
+    lisp_atan2_batch(dy,dx,angle,t);
+    for (int k=0; k<t; k++)
+    {
+      // the best may have got closer since the object was picked
+      int j=pick[k];
+      distance=dist[k];
+      if (distance>closest_distance
+          || (distance==closest_distance && (!closest || b->e[j].seq>closest_seq)))
+        continue;
+
+      if ((start_angle<=end_angle && (angle[k]>=start_angle && angle[k]<=end_angle))
+          || (start_angle>end_angle && (angle[k]>=start_angle || angle[k]<=end_angle)))
+      {
+        closest_distance=distance;
+        closest_seq=b->e[j].seq;
+        closest=b->e[j].o;
       }
     }
   }
@@ -16,6 +16,7 @@
 #include "objects.h"
 #include "view.h"
 #include "id.h"
+#include "levelmap.h"
 
 #include <stdlib.h>
 #define ASPECT 4             // foreground scrolls 4 times faster than background
@@ -44,6 +45,37 @@ class area_controller
 
 extern int32_t last_tile_hit_x,last_tile_hit_y;
 extern int dev;
+extern int level_save_v2;    // save levels in format v2 (-levelv2)
+extern int level_load_times;  // print how long loading took (-loadtimes)
+extern int raycast_check;    // compare raycasts with the old scan (-raycheck)
+extern int raycast_reference;  // only use the old scan (-movebench)
+
+class object_regions;
+
+struct active_entry
+{
+  game_object *o;
+  int32_t seq;             // position in the active list
+};
+
+struct active_bucket       // the active objects of one type, in list order
+{
+  active_entry *e;
+  int count,size;
+};
+
+struct query_stats
+{
+  int32_t calls,examined;
+};
+
+struct ray_stats
+{
+  int32_t calls,memo_hits,tiles,mismatches;
+};
+
+struct ray_memo;
+
 class level        // contain map info and objects
 {
   uint16_t *map_fg,        // just big 2d arrays
@@ -54,6 +86,21 @@ class level        // contain map info and objects
   int32_t total_objs;
   game_object *first,*first_active,*last;
 
+  map_bands *fg_bands,*bg_bands;           // format v2 maps, NULL once decoded
+  void need_fg(int y) { if (fg_bands && !fg_bands->ready(y)) decode_fg(y); }
+  void need_bg(int y) { if (bg_bands && !bg_bands->ready(y)) decode_bg(y); }
+  void decode_fg(int y);
+  void decode_bg(int y);
+  void decode_maps();
+
+  object_regions *regions;                 // format v2 objects not created yet
+  void load_regions(int32_t x1, int32_t y1, int32_t x2, int32_t y2);
+  void load_region(int n);
+  int32_t recode_region(int n, uint8_t *p, int32_t &count);
+  int read_regions(spec_directory *sd, bFILE *fp, object_regions *r);
+  uint8_t *write_regions(object_node *save_list, object_node *players,
+                         int split, object_node *&eager, int32_t &size);
+
   game_object **attack_list;                // list of characters for tick which can attack someone
   int attack_list_size,attack_total;
   void add_attacker(game_object *who);
@@ -74,13 +121,57 @@ class level        // contain map info and objects
   void add_all_block(game_object *who);
   uint32_t ctick;
 
+  uint64_t thash;                          // hash of the objects run by the last tick
+  uint64_t *ohash;                         // hash of each of them, in tick order
+  game_object **oticked;
+  int ohash_total,ohash_size;
+  void add_tick_hash(game_object *who);
+
+  // active objects by type for find_object_in_area/angle, built by the
+  // first query after the active list changes
+  active_bucket *buckets;
+  int total_buckets,buckets_valid;
+  uint32_t *type_bits;
+  uint16_t *query_type;
+  query_stats queries,last_queries;
+  void build_buckets();
+  int query_types(Cell *list);
+
+  // offsets of the objects of a bucket left after the cheap tests, and
+  // their angles and distances, for lisp_atan2_batch() and lisp_dist2_batch()
+  int32_t *query_offsets;
+  int query_offsets_size;
+  int32_t *query_scratch(int count);
+
+  // foreground_intersect() answers repeated rays of a tick from ray_memos,
+  // which map_gen invalidates when a foreground tile changes
+  ray_memo *ray_memos;
+  uint32_t map_gen;
+  ray_stats rays;
+  int ray_bounds(int32_t x1, int32_t y1, int32_t &x2, int32_t &y2,
+                 int32_t &blockx1, int32_t &blocky1,
+                 int32_t &blockx2, int32_t &blocky2);
+  void raycast(int32_t x1, int32_t y1, int32_t &x2, int32_t &y2,
+               int32_t &hitx, int32_t &hity);
+  void bbox_intersect(int32_t x1, int32_t y1, int32_t &x2, int32_t &y2,
+                      int32_t &hitx, int32_t &hity);
+  int ray_differs(int32_t x1, int32_t y1, int32_t x2, int32_t y2);
+
 public :
   char *original_name() { if (first_name) return first_name; else return Name; }
   uint32_t tick_counter() { return ctick; }
+  uint64_t tick_hash() { return thash; }
+  int tick_hash_total() { return ohash_total; }
+  uint64_t tick_hash_of(int x) { return ohash[x]; }
+  game_object *ticked_object(int x);        // NULL if it was deleted since
   void set_tick_counter(uint32_t x);
   area_controller *area_list;
 
-  void clear_active_list() { first_active=NULL; }
+  void clear_active_list() { first_active=NULL; buckets_valid=0; }
+  void load_all_regions();                  // demos need every object at once
+  void active_type_changed(game_object *o, int old_type);
+  query_stats const &query_counts() { return last_queries; }  // last tick
+  ray_stats const &ray_counts() { return rays; }
   char *name() { return Name; }
   game_object *attacker(game_object *who);
   int is_attacker(game_object *who);
@@ -104,28 +195,34 @@ public :
   ~level();
 
   int fg_raised(int x, int y) { CHECK(x>=0 && y>=0 && x<fg_width && y<fg_height);
+                 need_fg(y);
                  return (*(map_fg+x+y*fg_width))&0x4000; }
   void fg_set_raised(int x, int y, int r) { CHECK(x>=0 && y>=0 && x<fg_width && y<fg_height);
+                        need_fg(y);
                         uint16_t v=(*(map_fg+x+y*fg_width))&(0xffff-0x4000);
                         if (r) (*(map_fg+x+y*fg_width))=v|0x4000;
                         else (*(map_fg+x+y*fg_width))=v;
                       }
   void mark_seen(int x, int y) { CHECK(x>=0 && y>=0 && x<fg_width && y<fg_height);
+                      need_fg(y);
                       (*(map_fg+x+y*fg_width))|=0x8000; }
-  void clear_fg(int32_t x, int32_t y) { *(map_fg+x+y*fg_width)&=0x7fff; }
+  void clear_fg(int32_t x, int32_t y) { need_fg(y); *(map_fg+x+y*fg_width)&=0x7fff; }
 
-  uint16_t *get_fgline(int y) { CHECK(y>=0 && y<fg_height); return map_fg+y*fg_width; }
-  uint16_t *get_bgline(int y) { CHECK(y>=0 && y<bg_height); return map_bg+y*bg_width; }
+  // false for format v2 rows that were not used yet
+  int fg_ready(int y) { return !fg_bands || fg_bands->ready(y); }
+  int bg_ready(int y) { return !bg_bands || bg_bands->ready(y); }
+  uint16_t *get_fgline(int y) { CHECK(y>=0 && y<fg_height); need_fg(y); return map_fg+y*fg_width; }
+  uint16_t *get_bgline(int y) { CHECK(y>=0 && y<bg_height); need_bg(y); return map_bg+y*bg_width; }
   uint16_t get_fg(int x, int y) { if (x>=0 && y>=0 && x<fg_width && y<fg_height)
-                              return fgvalue(*(map_fg+x+y*fg_width));
+                              { need_fg(y); return fgvalue(*(map_fg+x+y*fg_width)); }
                                     else return 0;
                       }
   uint16_t get_bg(int x, int y) { if (x>=0 && y>=0 && x<bg_width && y<bg_height)
-                      return *(map_bg+x+y*bg_width);
+                      { need_bg(y); return *(map_bg+x+y*bg_width); }
                                      else return 0;
                     }
-  void put_fg(int x, int y, uint16_t tile) { *(map_fg+x+y*fg_width)=tile; }
-  void put_bg(int x, int y, uint16_t tile) { *(map_bg+x+y*bg_width)=tile; }
+  void put_fg(int x, int y, uint16_t tile) { need_fg(y); *(map_fg+x+y*fg_width)=tile; map_gen++; }
+  void put_bg(int x, int y, uint16_t tile) { need_bg(y); *(map_bg+x+y*bg_width)=tile; }
   void draw_objects(view *v);
   void interpolate_draw_objects(view *v);
   void draw_areas(view *v);
@@ -163,6 +260,7 @@ public :
   int platform_push(game_object *by_who, int xamount, int yamount);
   void foreground_intersect(int32_t x1, int32_t y1, int32_t &x2, int32_t &y2);
   void vforeground_intersect(int32_t x1, int32_t y1, int32_t &y2);
+  int check_raycasts(int count);           // -raytest, returns the mismatches
 
   void hurt_radius(int32_t x, int32_t y,int32_t r, int32_t m, game_object *from, game_object *exclude,
            int max_push);
@@ -188,7 +286,8 @@ public :
 //  game_object *find_enemy(game_object *exclude1, game_object *exclude2);
 
   bFILE *create_dir(char *filename, int save_all,
-            object_node *save_list, object_node *exclude_list);
+            object_node *save_list, object_node *exclude_list,
+            level_v2_entries *v2=NULL);
   view *make_view_list(int nplayers);
   int32_t total_light_links(object_node *list);
   int32_t total_object_links(object_node *save_list);
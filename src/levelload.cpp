@@ -0,0 +1,259 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#if defined HAVE_PTHREAD_H
+#   include <pthread.h>
+#endif
+
+#include "common.h"
+
+#include "levelload.h"
+#include "dprint.h"
+
+static char const *section_names[STAGE_SECTIONS] =
+{
+    "maps", "objects", "lights"
+};
+
+struct stage_section
+{
+    level_stage *stage;
+    spec_entry **entry;
+    int count;
+    long bytes;
+    int failed;
+    float read_ms, decode_ms;
+
+    void run();
+    void decode_map(spec_entry *e, int bg);
+};
+
+// Returns -1 for the entries no level loader reads
+static int section_of(char const *name)
+{
+    if (!strcmp(name, "fgmap") || !strcmp(name, "bgmap")
+         || !strcmp(name, "fgmap.v2") || !strcmp(name, "bgmap.v2"))
+        return STAGE_MAPS;
+    if (!strcmp(name, "lights") || !strcmp(name, "light_links"))
+        return STAGE_LIGHTS;
+    if (!strcmp(name, "thumb nail"))
+        return -1;
+    // object arrays and links, level options, player info
+    return STAGE_OBJECTS;
+}
+
+static inline uint32_t get32(uint8_t const *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void stage_section::decode_map(spec_entry *e, int bg)
+{
+    uint8_t *p = stage->image + e->offset;
+    if (e->size < 8)
+        return;
+    uint32_t w = get32(p), h = get32(p + 4);
+    if (w > 0xffff || h > 0xffff || 8 + 2 * (uint64_t)w * h > e->size)
+        return;
+
+    uint16_t *m = (uint16_t *)malloc(2 * w * h + 2);
+    memcpy(m, p + 8, 2 * w * h);
+    for (uint32_t i = 0; i < w * h; i++)
+        m[i] = lstl(m[i]);
+    stage->check[bg](m, w * h, stage->check_arg[bg]);
+
+    stage->map[bg] = m;
+    stage->map_w[bg] = w;
+    stage->map_h[bg] = h;
+}
+
+void stage_section::run()
+{
+    Timer t;
+    if (stage->direct)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            spec_entry *e = entry[i];
+            if (stage->src->read_at(stage->image + e->offset, e->size,
+                                    e->offset) != (int)e->size)
+                failed = 1;
+        }
+        read_ms = t.GetMs();
+    }
+
+    // on failure the main thread reads everything again, decode nothing
+    if (failed)
+        return;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (!strcmp(entry[i]->name, "fgmap"))
+            decode_map(entry[i], 0);
+        else if (!strcmp(entry[i]->name, "bgmap"))
+            decode_map(entry[i], 1);
+    }
+    decode_ms = t.GetMs();
+}
+
+#if defined HAVE_PTHREAD_H
+static void *stage_thread(void *arg)
+{
+    ((stage_section *)arg)->run();
+    return NULL;
+}
+#endif
+
+level_stage::level_stage(spec_directory *sd, bFILE *fp, tile_check fg_check,
+                         int fg_arg, tile_check bg_check)
+{
+    src = fp;
+    size = fp->file_size();
+    pos = 0;
+    image = (uint8_t *)calloc(size + 1, 1);
+    check[0] = fg_check;
+    check[1] = bg_check;
+    check_arg[0] = fg_arg;
+    check_arg[1] = 0;
+    map[0] = map[1] = NULL;
+    map_w[0] = map_w[1] = map_h[0] = map_h[1] = 0;
+
+    section = (stage_section *)calloc(STAGE_SECTIONS, sizeof(stage_section));
+    for (int s = 0; s < STAGE_SECTIONS; s++)
+    {
+        section[s].stage = this;
+        section[s].entry = (spec_entry **)malloc((sd->total + 1)
+                                                 * sizeof(spec_entry *));
+    }
+    for (int i = 0; i < sd->total; i++)
+    {
+        spec_entry *e = sd->entries[i];
+        int s = section_of(e->name);
+        if (s < 0 || !e->size || e->offset + e->size > (unsigned long)size)
+            continue;
+        section[s].entry[section[s].count++] = e;
+        section[s].bytes += e->size;
+    }
+
+    // only files on disk can be read from several threads, the others
+    // are read here first and only the decoding is spread
+    char probe;
+    direct = size > 0 && fp->read_at(&probe, 1, 0) == 1;
+    if (!direct)
+    {
+        for (int s = 0; s < STAGE_SECTIONS; s++)
+        {
+            Timer t;
+            for (int i = 0; i < section[s].count; i++)
+            {
+                spec_entry *e = section[s].entry[i];
+                fp->seek(e->offset, 0);
+                fp->read(image + e->offset, e->size);
+            }
+            section[s].read_ms = t.GetMs();
+        }
+    }
+
+    int needed[STAGE_SECTIONS];
+    for (int s = 0; s < STAGE_SECTIONS; s++)
+        needed[s] = section[s].count && (direct || s == STAGE_MAPS);
+
+#if defined HAVE_PTHREAD_H
+    pthread_t thread[STAGE_SECTIONS];
+    int started[STAGE_SECTIONS];
+    for (int s = 0; s < STAGE_SECTIONS; s++)
+        started[s] = needed[s] && !pthread_create(thread + s, NULL,
+                                                  stage_thread, section + s);
+    for (int s = 0; s < STAGE_SECTIONS; s++)
+        if (needed[s] && !started[s])
+            section[s].run();
+    for (int s = 0; s < STAGE_SECTIONS; s++)
+        if (started[s])
+            pthread_join(thread[s], NULL);
+#else
+    for (int s = 0; s < STAGE_SECTIONS; s++)
+        if (needed[s])
+            section[s].run();
+#endif
+
+    for (int s = 0; s < STAGE_SECTIONS; s++)
+    {
+        if (!section[s].failed)
+            continue;
+        dprintf("level: reading %s again\n", section_names[s]);
+        for (int i = 0; i < section[s].count; i++)
+        {
+            spec_entry *e = section[s].entry[i];
+            fp->seek(e->offset, 0);
+            fp->read(image + e->offset, e->size);
+        }
+    }
+}
+
+level_stage::~level_stage()
+{
+    for (int s = 0; s < STAGE_SECTIONS; s++)
+        free(section[s].entry);
+    free(section);
+    free(map[0]);
+    free(map[1]);
+    free(image);
+}
+
+uint16_t *level_stage::take_map(int bg, uint16_t &w, uint16_t &h)
+{
+    uint16_t *ret = map[bg];
+    if (ret)
+    {
+        w = map_w[bg];
+        h = map_h[bg];
+        map[bg] = NULL;
+    }
+    return ret;
+}
+
+void level_stage::log_times(char const *name)
+{
+    dprintf("level: staged %s, %s threads\n", name,
+            direct ? "reading in" : "decoding in");
+    for (int s = 0; s < STAGE_SECTIONS; s++)
+        if (section[s].count)
+            dprintf("  %-8s %4d entries %7ld KB  read %.2f ms  decode %.2f ms\n",
+                    section_names[s], section[s].count,
+                    (section[s].bytes + 1023) / 1024, section[s].read_ms,
+                    section[s].decode_ms);
+}
+
+int level_stage::unbuffered_read(void *buf, size_t count)
+{
+    if (pos + (long)count > size)
+        count = size - pos;
+    memcpy(buf, image + pos, count);
+    pos += count;
+    return count;
+}
+
+int level_stage::unbuffered_seek(long offset, int whence)
+{
+    if (whence == SEEK_CUR)
+        offset += pos;
+    else if (whence == SEEK_END)
+        offset = size - offset;
+    if (offset < 0 || offset > size)
+        return -1;
+    pos = offset;
+    return 0;
+}
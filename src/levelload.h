@@ -0,0 +1,72 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __LEVELLOAD_H__
+#define __LEVELLOAD_H__
+
+#include "specs.h"
+#include "levelmap.h"
+
+// The sections of a level or savegame file, read by one thread per group
+// (maps, objects, lights) into an image of the file. The level loaders
+// then parse that image on the main thread through the bFILE interface,
+// at the offsets given by the spec directory. Version 1 maps are also
+// byte swapped and checked by the map thread. The thumbnail is left out,
+// only the savegame menu reads it.
+
+enum
+{
+    STAGE_MAPS,
+    STAGE_OBJECTS,
+    STAGE_LIGHTS,
+    STAGE_SECTIONS
+};
+
+struct stage_section;
+
+class level_stage : public bFILE
+{
+public:
+    // fg_check and bg_check are run on version 1 maps as they are decoded
+    level_stage(spec_directory *sd, bFILE *fp, tile_check fg_check,
+                int fg_arg, tile_check bg_check);
+    virtual ~level_stage();
+
+    // Hands over a decoded version 1 map, NULL if there is none
+    uint16_t *take_map(int bg, uint16_t &w, uint16_t &h);
+
+    // Adds the read and decode times of each section to the load log
+    void log_times(char const *name);
+
+    virtual int open_failure() { return !image; }
+    virtual int file_size() { return size; }
+
+protected:
+    virtual int unbuffered_read(void *buf, size_t count);
+    virtual int unbuffered_write(void const *buf, size_t count) { return 0; }
+    virtual int unbuffered_seek(long offset, int whence);
+    virtual int unbuffered_tell() { return pos; }
+    virtual int allow_read_buffering() { return 0; }
+
+private:
+    friend struct stage_section;
+
+    bFILE *src;
+    int direct;                  // src supports read_at()
+    uint8_t *image;
+    long size, pos;
+    stage_section *section;
+
+    tile_check check[2];
+    int check_arg[2];
+    uint16_t *map[2], map_w[2], map_h[2];
+};
+
+#endif // __LEVELLOAD_H__
@@ -0,0 +1,244 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+#include "levelmap.h"
+#include "dprint.h"
+
+#define RUN_FLAG 0x8000
+#define RUN_MAX  0x7fff
+
+static inline void put16(uint8_t *&p, uint16_t x)
+{
+    p[0] = x & 0xff;
+    p[1] = x >> 8;
+    p += 2;
+}
+
+static inline uint16_t get16(uint8_t const *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static int32_t pack_band(uint16_t const *src, int count, uint8_t *dst)
+{
+    uint8_t *p = dst;
+    int i = 0;
+    while (i < count)
+    {
+        int run = 1;
+        while (i + run < count && run < RUN_MAX && src[i + run] == src[i])
+            run++;
+        if (run >= 3)
+        {
+            put16(p, RUN_FLAG | run);
+            put16(p, src[i]);
+            i += run;
+            continue;
+        }
+
+        // literals until the next run worth encoding
+        int start = i, n = 0;
+        while (i < count && n < RUN_MAX)
+        {
+            if (i + 2 < count && src[i] == src[i + 1] && src[i] == src[i + 2])
+                break;
+            i++;
+            n++;
+        }
+        put16(p, n);
+        for (int j = start; j < start + n; j++)
+            put16(p, src[j]);
+    }
+    return p - dst;
+}
+
+// Returns 0 if the band does not decode to exactly count tiles
+static int unpack_band(uint8_t const *src, int32_t size, uint16_t *dst,
+                       int count)
+{
+    uint8_t const *end = src + size;
+    while (src + 2 <= end)
+    {
+        int n = get16(src);
+        src += 2;
+        if (n & RUN_FLAG)
+        {
+            n &= RUN_MAX;
+            if (n > count || src + 2 > end)
+                return 0;
+            uint16_t x = get16(src);
+            src += 2;
+            for (count -= n; n; n--)
+                *dst++ = x;
+        }
+        else
+        {
+            if (n > count || src + 2 * n > end)
+                return 0;
+            for (count -= n; n; n--, src += 2)
+                *dst++ = get16(src);
+        }
+    }
+    return src == end && !count;
+}
+
+uint8_t *map_bands::pack(uint16_t const *map, int w, int h, int32_t &size)
+{
+    int bands = (h + LEVEL_BAND_ROWS - 1) / LEVEL_BAND_ROWS;
+    int32_t header = 4 + 4 + 2 + 4 + 4 * bands;
+    // a run never takes more room than the tiles it replaces, this is
+    // plenty for the headers of the literal runs between them
+    uint8_t *ret = (uint8_t *)malloc(header + 4 * w * h + 8 * bands);
+    uint8_t *p = ret;
+
+    put16(p, w & 0xffff); put16(p, w >> 16);
+    put16(p, h & 0xffff); put16(p, h >> 16);
+    put16(p, LEVEL_BAND_ROWS);
+    put16(p, bands & 0xffff); put16(p, bands >> 16);
+
+    uint8_t *sizes = p, *out = ret + header;
+    for (int b = 0; b < bands; b++)
+    {
+        int rows = Min(LEVEL_BAND_ROWS, h - b * LEVEL_BAND_ROWS);
+        int32_t n = pack_band(map + b * LEVEL_BAND_ROWS * w, rows * w, out);
+        put16(sizes, n & 0xffff); put16(sizes, n >> 16);
+        out += n;
+    }
+
+    size = out - ret;
+    return ret;
+}
+
+map_bands::map_bands(tile_check check, int arg)
+  : check(check),
+    arg(arg)
+{
+    data = done = NULL;
+    offset = NULL;
+    map = NULL;
+    w = h = rows = bands = left = 0;
+}
+
+map_bands::~map_bands()
+{
+    free(data);
+    free(done);
+    free(offset);
+}
+
+int map_bands::read(bFILE *fp, uint16_t *&ret, uint16_t &ret_w, uint16_t &ret_h)
+{
+    w = fp->read_uint32();
+    h = fp->read_uint32();
+    rows = fp->read_uint16();
+    bands = fp->read_uint32();
+    // the editor never makes maps this big, anything larger is damage
+    if (w <= 0 || h <= 0 || w > 0xffff || h > 0xffff
+         || (size_t)w * h > LEVEL_MAX_TILES || rows <= 0
+         || bands != (h + rows - 1) / rows)
+        return 0;
+
+    size_t total = 0, band_max = 4 * (size_t)w * Min(rows, h) + 4;
+    offset = (int32_t *)malloc(sizeof(int32_t) * (bands + 1));
+    offset[0] = 0;
+    for (int b = 0; b < bands; b++)
+    {
+        uint32_t n = fp->read_uint32();
+        total += n;
+        if (n > band_max || total > 4 * (size_t)w * h + 4 * (size_t)bands)
+            return 0;
+        offset[b + 1] = (int32_t)total;
+    }
+
+    data = (uint8_t *)malloc(total + 1);
+    if (fp->read(data, total) != (int)total)
+        return 0;
+
+    done = (uint8_t *)calloc(bands, 1);
+    left = bands;
+    map = (uint16_t *)malloc(sizeof(uint16_t) * (size_t)w * h);
+    ret = map;
+    ret_w = w;
+    ret_h = h;
+    return 1;
+}
+
+uint8_t *map_bands::repack(int32_t &size)
+{
+    int32_t header = 4 + 4 + 2 + 4 + 4 * bands, room = header;
+    for (int b = 0; b < bands; b++)
+        room += done[b] ? 4 * w * Min(rows, h - b * rows) + 8
+                        : offset[b + 1] - offset[b];
+    uint8_t *ret = (uint8_t *)malloc(room);
+    uint8_t *p = ret;
+
+    put16(p, w & 0xffff); put16(p, w >> 16);
+    put16(p, h & 0xffff); put16(p, h >> 16);
+    put16(p, rows);
+    put16(p, bands & 0xffff); put16(p, bands >> 16);
+
+    uint8_t *sizes = p, *out = ret + header;
+    for (int b = 0; b < bands; b++)
+    {
+        int32_t n;
+        if (done[b])
+            n = pack_band(map + b * rows * w, Min(rows, h - b * rows) * w, out);
+        else
+        {
+            // still unchecked, the tile check runs again when it is loaded
+            n = offset[b + 1] - offset[b];
+            memcpy(out, data + offset[b], n);
+        }
+        put16(sizes, n & 0xffff); put16(sizes, n >> 16);
+        out += n;
+    }
+
+    size = out - ret;
+    return ret;
+}
+
+int map_bands::decode(int y)
+{
+    int b = y / rows;
+    if (done[b])
+        return left;
+
+    int count = Min(rows, h - b * rows) * w;
+    uint16_t *dst = map + b * rows * w;
+    if (!unpack_band(data + offset[b], offset[b + 1] - offset[b], dst, count))
+    {
+        dprintf("level: map band %d is damaged\n", b);
+        memset(dst, 0, 2 * count);
+    }
+    check(dst, count, arg);
+
+    done[b] = 1;
+    if (!--left)
+    {
+        free(data);
+        data = NULL;
+    }
+    return left;
+}
+
+void map_bands::decode_all()
+{
+    for (int y = 0; left && y < h; y += rows)
+        decode(y);
+}
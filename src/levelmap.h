@@ -0,0 +1,77 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __LEVELMAP_H__
+#define __LEVELMAP_H__
+
+#include "specs.h"
+
+// Level format v2 stores each map as bands of LEVEL_BAND_ROWS rows which
+// are compressed separately, so a band is only decoded the first time one
+// of its rows is used. Entry layout, little endian:
+//   uint32 width, uint32 height, uint16 band rows, uint32 bands,
+//   bands * uint32 packed size, packed bands
+// A packed band is a list of runs: uint16 n followed by n tiles when n is
+// below 0x8000, otherwise by a single tile repeated n-0x8000 times.
+
+#define LEVEL_BAND_ROWS 32
+#define LEVEL_MAX_TILES 0x1000000  // per map, rejected as damage above
+
+// Called on every decoded band, to drop tiles this game doesn't have
+typedef void (*tile_check)(uint16_t *tiles, int count, int arg);
+
+class map_bands
+{
+public:
+    // Packs a whole map into a malloc()ed entry of the given size
+    static uint8_t *pack(uint16_t const *map, int w, int h, int32_t &size);
+
+    map_bands(tile_check check, int arg);
+    ~map_bands();
+
+    // Reads an entry and allocates the map it decodes into, returns 0
+    // if the entry is damaged
+    int read(bFILE *fp, uint16_t *&map, uint16_t &w, uint16_t &h);
+
+    // Packs the map again, the bands not decoded yet are copied as read
+    uint8_t *repack(int32_t &size);
+
+    int ready(int y) { return done[y / rows]; }
+    // Decodes the band holding row y, returns the number of bands left
+    int decode(int y);
+    void decode_all();
+
+private:
+    uint8_t *data, *done;
+    int32_t *offset;              // bands+1 offsets in data
+    uint16_t *map;
+    int w, h, rows, bands, left;
+    tile_check check;
+    int arg;
+};
+
+// Objects far from the starts are saved in an "object_regions" entry and
+// only created when a view gets near them. Entry layout, little endian:
+//   uint16 vars, vars * (uint8 length, name, uint8 type),
+//   uint32 regions, regions * (int32 x1 y1 x2 y2, uint32 objects,
+//   uint32 size, objects * (uint16 type, uint16 state, vars, uint16 lvars,
+//   lvars * int32))
+// Types, states and lvars are numbered as in the describe_* entries.
+
+#define LEVEL_REGION_SIZE 1024    // side of a region, in pixels
+
+// Entries of a level being saved in format v2, all malloc()ed
+struct level_v2_entries
+{
+    uint8_t *fg, *bg, *regions;
+    int32_t fg_size, bg_size, regions_size;
+};
+
+#endif // __LEVELMAP_H__
@@ -24,6 +24,8 @@
 #include "specs.h"
 #include "dprint.h"
 #include "filter.h"
+#include "nearest.h"
+#include "tblcache.h"
 #include "status.h"
 #include "dev.h"
 
@@ -205,49 +207,33 @@ void calc_tint(uint8_t *tint, int rs, int gs, int bs, int ra, int ga, int ba, pa
 }
 
 
+// white_light, the tints and bright_tint, cached together per palette
+#define LIGHT_TABLE_SIZE    (256*64+TTINTS*256+256)
+#define LIGHT_TABLE_VERSION 1   // bump when the tables are built differently
+
 void calc_light_table(palette *pal)
 {
-    white_light_initial=(uint8_t *)malloc(256*64);
+    uint8_t *data=table_load("light",LIGHT_TABLE_VERSION,pal,LIGHT_TABLE_SIZE);
+    int recalc = !data;
+    if (recalc)
+        data=(uint8_t *)malloc(LIGHT_TABLE_SIZE);
+
+    white_light_initial=data;
     white_light=white_light_initial;
 
 //    green_light=(uint8_t *)malloc(256*64);
     int i = 0;
     for( ; i < TTINTS; i++ )
     {
-        tints[i] = (uint8_t *)malloc( 256 );
-    }
-
-    char *lightpath;
-    lightpath = (char *)malloc( strlen( get_save_filename_prefix() ) + 9 + 1 );
-    sprintf( lightpath, "%slight.tbl", get_save_filename_prefix() );
-
-    bFILE *fp=open_file( lightpath, "rb" );
-    int recalc = 0;
-    if( fp->open_failure() )
-    {
-        recalc = 1;
-    }
-    else
-    {
-        if (fp->read_uint16()!=calc_crc((uint8_t *)pal->addr(),768))
-            recalc=1;
-        else
-        {
-            fp->read(white_light,256*64);
-//            fp->read(green_light,256*64);
-            for (i=0; i<TTINTS; i++)
-                fp->read(tints[i],256);
-            fp->read(bright_tint,256);
-//            trans_table=(uint8_t *)malloc(256*256);
-//            fp.read(trans_table,256*256);
-        }
+        tints[i] = data+256*64+i*256;
     }
-    delete fp;
-    fp = NULL;
+    if (!recalc)
+        memcpy(bright_tint,data+256*64+TTINTS*256,256);
 
     if( recalc )
     {
         dprintf("Palette has changed, recalculating light table...\n");
+        NearestColor nearest(pal);
         stat_man->push("white light",NULL);
         int color=0;
         for (; color<256; color++)
@@ -258,7 +244,7 @@ void calc_light_table(palette *pal)
             for (int intensity=63; intensity>=0; intensity--)
             {
                 if (r>0 || g>0 || b>0)
-                    white_light[intensity*256+color]=pal->find_closest(r,g,b);
+                    white_light[intensity*256+color]=nearest.Find(r,g,b);
                 else
                     white_light[intensity*256+color]=0;
                 if (r) r--;  if (g) g--;  if (b) b--;
@@ -313,14 +299,14 @@ void calc_light_table(palette *pal)
       int r=pal->red(i)/2,g=255-pal->green(i)-30,b=pal->blue(i)*3/5+50;
       if (g<0) g=0;
       if (b>255) b=0;
-      *c=pal->find_closest(r,g,b);
+      *c=nearest.Find(r,g,b);
     }
     for (i=0; i<256; i++)
     {
       int r=pal->red(i)+(255-pal->red(i))/2,
           g=pal->green(i)+(255-pal->green(i))/2,
           b=pal->blue(i)+(255-pal->blue(i))/2;
-      bright_tint[i]=pal->find_closest(r,g,b);
+      bright_tint[i]=nearest.Find(r,g,b);
     }
 
     // make the colored tints
@@ -354,24 +340,101 @@ void calc_light_table(palette *pal)
     }*/
 
 
-        bFILE *f = open_file( lightpath, "wb" );
-        if( f->open_failure() )
-            dprintf( "Unable to open file light.tbl for writing\n" );
-        else
-        {
-            f->write_uint16(calc_crc((uint8_t *)pal->addr(),768));
-            f->write(white_light,256*64);
-//      f->write(green_light,256*64);
-            for (int i=0; i<TTINTS; i++)
-                f->write(tints[i],256);
-            f->write(bright_tint,256);
-//    f.write(trans_table,256*256);
-        }
-        delete f;
+        memcpy(data+256*64+TTINTS*256,bright_tint,256);
+        table_store("light",LIGHT_TABLE_VERSION,pal,data,LIGHT_TABLE_SIZE);
     }
-    free( lightpath );
 }
 
+void free_light_table()
+{
+    table_release(white_light_initial);
+    white_light=white_light_initial=NULL;
+    for (int i=0; i<TTINTS; i++)
+        tints[i]=NULL;
+}
+
+
+// Reference search the tables used to be built with
+static int linear_closest(palette *pal, int r, int g, int b)
+{
+  uint8_t const *cl=(uint8_t const *)pal->colors();
+  int c=0,d=0x7fffffff;
+  for (int i=0; i<pal->pal_size(); i++,cl+=3)
+  {
+    int nd=(r-cl[0])*(r-cl[0])+(g-cl[1])*(g-cl[1])+(b-cl[2])*(b-cl[2]);
+    if (nd<d)
+    { c=i; d=nd; }
+  }
+  return c;
+}
+
+// -palbench: times the colour cube and light table builds against the
+// linear search and checks that both pick the same entries
+void palette_benchmark(palette *pal)
+{
+  time_marker start,end;
+  double linear,sorted;
+  int mismatch;
+
+  for (int bits=5; bits<=6; bits++)
+  {
+    int size=1<<bits,mul=1<<(8-bits);
+    uint8_t *ref=(uint8_t *)malloc(size*size*size),*dst=ref;
+    start.get_time();
+    for (int r=0; r<size; r++)
+      for (int g=0; g<size; g++)
+        for (int b=0; b<size; b++)
+          *dst++=linear_closest(pal,r*mul,g*mul,b*mul);
+    end.get_time();
+    linear=end.diff_time(&start);
+
+    start.get_time();
+    ColorFilter cf(pal,bits);
+    end.get_time();
+    sorted=end.diff_time(&start);
+
+    mismatch=0;
+    dst=ref;
+    for (int r=0; r<size; r++)
+      for (int g=0; g<size; g++)
+        for (int b=0; b<size; b++)
+          mismatch+=cf.Lookup(r,g,b)!=*dst++;
+    free(ref);
+    printf("%d bit cube   : linear %7.2f ms  sorted %7.2f ms  mismatches %d\n",
+           bits,linear*1000.0,sorted*1000.0,mismatch);
+  }
+
+  uint8_t *ref=(uint8_t *)malloc(256*64*2),*tbl=ref+256*64;
+  for (int pass=0; pass<2; pass++)
+  {
+    NearestColor nearest(pal);
+    uint8_t *dst=pass ? tbl : ref;
+    start.get_time();
+    for (int color=0; color<256; color++)
+    {
+      uint8_t r,g,b;
+      pal->get(color,r,g,b);
+      for (int intensity=63; intensity>=0; intensity--)
+      {
+        if (r>0 || g>0 || b>0)
+          dst[intensity*256+color]=pass ? nearest.Find(r,g,b) : linear_closest(pal,r,g,b);
+        else
+          dst[intensity*256+color]=0;
+        if (r) r--;
+        if (g) g--;
+        if (b) b--;
+      }
+    }
+    end.get_time();
+    if (pass) sorted=end.diff_time(&start); else linear=end.diff_time(&start);
+  }
+  mismatch=0;
+  for (int i=0; i<256*64; i++)
+    mismatch+=ref[i]!=tbl[i];
+  free(ref);
+  printf("light table  : linear %7.2f ms  sorted %7.2f ms  mismatches %d\n",
+         linear*1000.0,sorted*1000.0,mismatch);
+}
 
 light_patch *light_patch::copy(light_patch *Next)
 {
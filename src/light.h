@@ -77,6 +77,8 @@ void double_light_screen(image *sc, int32_t screenx, int32_t screeny, uint8_t *l
              image *out, int32_t out_x, int32_t out_y);
 
 void calc_light_table(palette *pal);
+void free_light_table();
+void palette_benchmark(palette *pal);
 extern light_source *first_light_source;
 extern int light_detail;
 
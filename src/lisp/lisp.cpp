@@ -44,9 +44,13 @@
 
 bFILE *current_print_file=NULL;
 
-LSymbol *LSymbol::root = NULL;
+LSymbol **LSymbol::table = NULL;
+size_t LSymbol::table_size = 0;
 size_t LSymbol::count = 0;
 
+// Symbol lookups since lisp_init() started, and the table slots they read
+static size_t symbol_lookups = 0, symbol_probes = 0;
+
 
 uint8_t *space[4], *free_space[4];
 size_t space_size[4];
@@ -55,6 +59,8 @@ int total_user_functions;
 
 int current_space;  // normally set to TMP_SPACE, unless compiling or other needs
 
+static lisp_alloc_stats allocs, last_allocs;
+
 int break_level=0;
 
 void l1print(void *block)
@@ -206,9 +212,22 @@ static void *lmalloc(size_t size, int which_space)
 
     void *ret = (void *)free_space[which_space];
     free_space[which_space] += size;
+    allocs.allocs++;
+    allocs.bytes += size;
     return ret;
 }
 
+void lisp_alloc_tick()
+{
+    last_allocs = allocs;
+    memset(&allocs, 0, sizeof(allocs));
+}
+
+lisp_alloc_stats const &lisp_alloc_counts()
+{
+    return last_allocs;
+}
+
 void *eval_block(void *list)
 {
   PtrRef r1(list);
@@ -311,12 +330,8 @@ LPointer *LPointer::Create(void *addr)
 
 LChar *LChar::Create(uint16_t ch)
 {
-    size_t size = Max(sizeof(LChar), sizeof(LRedirect));
-
-    LChar *c = (LChar *)lmalloc(size, current_space);
-    c->type = L_CHARACTER;
-    c->ch = ch;
-    return c;
+    allocs.immediates++;
+    return (LChar *)(((intptr_t)ch << 2) | L_TAG_CHARACTER);
 }
 
 struct LString *LString::Create(char const *string)
@@ -354,6 +369,13 @@ LUserFunction *new_lisp_user_function(LList *arg_list, LList *block_list)
     lu->type = L_USER_FUNCTION;
     lu->arg_list = arg_list;
     lu->block_list = block_list;
+    lu->arity = 0;
+    for (LObject *a = arg_list; a; a = CDR(a), lu->arity++)
+        if (item_type(a) != L_CONS_CELL || item_type(CAR(a)) != L_SYMBOL)
+        {
+            lu->arity = -1;
+            break;
+        }
     return lu;
 }
 
@@ -411,6 +433,14 @@ LSymbol *new_lisp_symbol(char *name)
 
 LNumber *LNumber::Create(long num)
 {
+    // only allocate numbers that don't fit in a tagged pointer
+    intptr_t tagged = (intptr_t)((uintptr_t)num << 2) | L_TAG_NUMBER;
+    if ((long)(tagged >> 2) == num)
+    {
+        allocs.immediates++;
+        return (LNumber *)tagged;
+    }
+
     size_t size = Max(sizeof(LNumber), sizeof(LRedirect));
 
     LNumber *n = (LNumber *)lmalloc(size, current_space);
@@ -485,7 +515,7 @@ int32_t lnumber_value(void *lnumber)
   switch (item_type(lnumber))
   {
     case L_NUMBER :
-      return ((LNumber *)lnumber)->num;
+      return lfixnum_value(lnumber);
     case L_FIXED_POINT :
       return (((LFixedPoint *)lnumber)->x)>>16;
     case L_STRING :
@@ -549,6 +579,8 @@ uint16_t lcharacter_value(void *c)
     exit(0);
   }
 #endif
+  if (limmediate(c))
+    return (uint16_t)((intptr_t)c >> 2);
   return ((LChar *)c)->ch;
 }
 
@@ -557,7 +589,7 @@ long lfixed_point_value(void *c)
   switch (item_type(c))
   {
     case L_NUMBER :
-      return ((LNumber *)c)->num<<16; break;
+      return lfixnum_value(c)<<16; break;
     case L_FIXED_POINT :
       return (((LFixedPoint *)c)->x); break;
     default :
@@ -575,15 +607,15 @@ void *lisp_eq(void *n1, void *n2)
   if (!n1 && !n2) return true_symbol;
   else if ((n1 && !n2) || (n2 && !n1)) return NULL;
   {
-    int t1=*((ltype *)n1), t2=*((ltype *)n2);
+    int t1=item_type(n1), t2=item_type(n2);
     if (t1!=t2) return NULL;
     else if (t1==L_NUMBER)
-    { if (((LNumber *)n1)->num==((LNumber *)n2)->num)
+    { if (lfixnum_value(n1)==lfixnum_value(n2))
         return true_symbol;
       else return NULL;
     } else if (t1==L_CHARACTER)
     {
-      if (((LChar *)n1)->ch==((LChar *)n2)->ch)
+      if (lcharacter_value(n1)==lcharacter_value(n2))
         return true_symbol;
       else return NULL;
     }
@@ -638,7 +670,7 @@ void *lisp_equal(void *n1, void *n2)
             return NULL;
           n1=CDR(n1);
           n2=CDR(n2);
-          if (n1 && *((ltype *)n1)!=L_CONS_CELL)
+          if (n1 && item_type(n1)!=L_CONS_CELL)
             return lisp_equal(n1, n2);
         }
         if (n1 || n2)
@@ -751,6 +783,122 @@ int32_t lisp_atan2(int32_t dy, int32_t dx)
   }
 }
 
+// atan_table widened to 32 bits, vectorizers only gather 32 bit elements
+static int32_t atan_wide[TBS];
+
+// The build uses -O2, where gcc only vectorizes loops it can prove cheap,
+// which excludes any loop over a count not known at compile time
+#if defined __GNUC__ && !defined __clang__
+#   define BATCH_LOOP __attribute__((optimize("tree-vectorize", \
+                                              "vect-cost-model=dynamic")))
+#else
+#   define BATCH_LOOP
+#endif
+
+// Same results as lisp_atan2() for offsets below 2^26, where |d|*29 fits
+// in 32 bits. The loop has no branch and no table but atan_wide, so gcc
+// vectorizes it: every case is computed and the right one picked
+// arithmetically. The quotient is estimated in single precision, which
+// is within one of the integer division below TBS, then corrected.
+BATCH_LOOP
+void lisp_atan2_batch(int32_t const *dy, int32_t const *dx, int32_t *angle,
+                      int n)
+{
+  if (!atan_wide[TBS-1])
+    for (int i=0; i<TBS; i++)
+      atan_wide[i]=atan_table[i];
+
+  for (int i=0; i<n; i++)
+  {
+    int32_t x=dx[i],y=dy[i];
+    int32_t ax=abs(x),ay=abs(y);
+    int32_t steep=ax<=ay,xn=x<0,yn=y<0;
+    int32_t num=(steep ? ay : ax)*29,den=steep ? ax : ay;
+    den+=den==0;
+
+    float q=(float)num/(float)den;
+    int32_t a=(int32_t)(q<TBS ? q : TBS);
+    uint32_t p=(uint32_t)a*den;
+    a-=p>(uint32_t)num;
+    a+=p+den<=(uint32_t)num;
+    int32_t in_table=a<TBS;
+    a*=in_table;
+
+    // by octant the angle is base+step*atan_table[a], or sat past the
+    // table, with lisp_atan2()'s 260 where 270 was meant
+    int32_t base=45+90*(xn+yn*3-2*xn*yn);
+    int32_t step=((xn^yn^steep)<<1)-1;
+    int32_t sat=(base+step*45)%360-10*(yn&steep&(xn^1));
+    int32_t r=sat+in_table*(base+step*atan_wide[a]-sat);
+
+    r+=(x==0)*(90+180*yn-r);
+    r+=(y==0)*(180*(x<=0)-r);
+    angle[i]=r;
+  }
+}
+
+BATCH_LOOP
+void lisp_dist2_batch(int32_t const *dy, int32_t const *dx, int32_t *dist,
+                      int n)
+{
+  for (int i=0; i<n; i++)
+    dist[i]=dx[i]*dx[i]+dy[i]*dy[i];
+}
+
+// -trigbench: checks the batch functions against the scalar ones on
+// every offset of a 1025x1025 square and on random ones across a level,
+// then times both on the random offsets
+void trig_benchmark()
+{
+  int const side=1025,grid=side*side,count=1<<20;
+  int total=grid+count;
+  int32_t *dx=(int32_t *)malloc(total*4*sizeof(int32_t));
+  int32_t *dy=dx+total,*angle=dy+total,*dist=angle+total;
+
+  for (int i=0; i<grid; i++)
+  {
+    dx[i]=i%side-side/2;
+    dy[i]=i/side-side/2;
+  }
+  uint32_t seed=1;
+  for (int i=grid; i<total; i++)
+  {
+    // offsets up to 2^21, the size of the largest level in pixels
+    seed=seed*1664525+1013904223; dx[i]=(int32_t)(seed>>10)-(1<<21);
+    seed=seed*1664525+1013904223; dy[i]=(int32_t)(seed>>10)-(1<<21);
+  }
+
+  lisp_atan2_batch(dy,dx,angle,total);
+  lisp_dist2_batch(dy,dx,dist,total);
+  int bad_angle=0,bad_dist=0;
+  for (int i=0; i<total; i++)
+  {
+    if (angle[i]!=lisp_atan2(dy[i],dx[i]))
+    {
+      if (!bad_angle++)
+        printf("atan2 %d,%d: batch %d, lisp_atan2 %d\n",dy[i],dx[i],
+               angle[i],lisp_atan2(dy[i],dx[i]));
+    }
+    if (dist[i]!=dx[i]*dx[i]+dy[i]*dy[i])
+      bad_dist++;
+  }
+  printf("%d offsets checked, %d angles and %d distances differ\n",total,
+         bad_angle,bad_dist);
+
+  int32_t *x=dx+grid,*y=dy+grid,*a=angle+grid,sum=0;
+  Timer t;
+  for (int i=0; i<count; i++)
+    sum+=lisp_atan2(y[i],x[i]);
+  float scalar_ms=t.GetMs();
+  lisp_atan2_batch(y,x,a,count);
+  float batch_ms=t.GetMs();
+  for (int i=0; i<count; i++)
+    sum-=a[i];
+  printf("%d angles: lisp_atan2 %.2f ms, batch %.2f ms%s\n",count,
+         scalar_ms,batch_ms,sum ? " (results differ)" : "");
+  free(dx);
+}
+
 
 /*
 LSymbol *find_symbol(char const *name)
@@ -787,38 +935,73 @@ LSymbol *make_find_symbol(char const *name)    // find a symbol, if it doesn't e
 
 */
 
-LSymbol *LSymbol::Find(char const *name)
+static uint32_t symbol_hash(char const *name)
 {
-    LSymbol *p = root;
-    while (p)
+    uint32_t h = 2166136261u; // FNV-1a
+    for (; *name; name++)
+        h = (h ^ (uint8_t)*name) * 16777619u;
+    return h;
+}
+
+// Returns the slot holding the symbol, or the empty one where it would go
+static LSymbol **symbol_slot(char const *name, uint32_t hash)
+{
+    size_t mask = LSymbol::table_size - 1;
+    symbol_lookups++;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask)
     {
-        int cmp = strcmp(name, p->name->GetString());
-        if (cmp == 0)
-            return p;
-        p = (cmp < 0) ? p->left : p->right;
+        symbol_probes++;
+        LSymbol *p = LSymbol::table[i];
+        if (!p || (p->hash == hash && !strcmp(name, p->name->GetString())))
+            return LSymbol::table + i;
     }
-    return NULL;
 }
 
-LSymbol *LSymbol::FindOrCreate(char const *name)
+static void grow_symbol_table()
 {
-    LSymbol *p = root;
-    LSymbol **parent = &root;
-    while (p)
+    LSymbol **old = LSymbol::table;
+    size_t old_size = LSymbol::table_size;
+
+    LSymbol::table_size = old_size ? old_size * 2 : 1024;
+    LSymbol::table = (LSymbol **)calloc(LSymbol::table_size,
+                                        sizeof(LSymbol *));
+    size_t mask = LSymbol::table_size - 1;
+    for (size_t j = 0; j < old_size; j++)
     {
-        int cmp = strcmp(name, p->name->GetString());
-        if (cmp == 0)
-            return p;
-        parent = (cmp < 0) ? &p->left : &p->right;
-        p = *parent;
+        if (!old[j])
+            continue;
+        size_t i = old[j]->hash & mask;
+        while (LSymbol::table[i])
+            i = (i + 1) & mask;
+        LSymbol::table[i] = old[j];
     }
+    free(old);
+}
+
+LSymbol *LSymbol::Find(char const *name)
+{
+    if (!table)
+        return NULL;
+    return *symbol_slot(name, symbol_hash(name));
+}
+
+LSymbol *LSymbol::FindOrCreate(char const *name)
+{
+    // keep the table at most half full so probes stay short
+    if ((count + 1) * 2 > table_size)
+        grow_symbol_table();
+
+    uint32_t hash = symbol_hash(name);
+    LSymbol **slot = symbol_slot(name, hash);
+    if (*slot)
+        return *slot;
 
     // Make sure all symbols get defined in permanant space
     int sp = current_space;
     if (current_space != GC_SPACE)
        current_space = PERM_SPACE;
 
-    p = (LSymbol *)malloc(sizeof(LSymbol));
+    LSymbol *p = (LSymbol *)malloc(sizeof(LSymbol));
     p->type = L_SYMBOL;
     p->name = LString::Create(name);
 
@@ -828,22 +1011,32 @@ LSymbol *LSymbol::FindOrCreate(char const *name)
 #ifdef L_PROFILE
     p->time_taken = 0;
 #endif
-    p->left = p->right = NULL;
-    *parent = p;
+    p->hash = hash;
+    *slot = p;
     count++;
 
     current_space = sp;
     return p;
 }
 
-static void DeleteAllSymbols(LSymbol *root)
+static void DeleteAllSymbols()
 {
-    if (root)
-    {
-        DeleteAllSymbols(root->left);
-        DeleteAllSymbols(root->right);
-        free(root);
-    }
+    for (size_t i = 0; i < LSymbol::table_size; i++)
+        free(LSymbol::table[i]);
+    free(LSymbol::table);
+    LSymbol::table = NULL;
+    LSymbol::table_size = 0;
+    LSymbol::count = 0;
+}
+
+// Average number of slots read to find each symbol in the table
+static float symbol_probe_length()
+{
+    size_t mask = LSymbol::table_size - 1, total = 0;
+    for (size_t i = 0; i < LSymbol::table_size; i++)
+        if (LSymbol::table[i])
+            total += ((i - LSymbol::table[i]->hash) & mask) + 1;
+    return LSymbol::count ? (float)total / LSymbol::count : 0.f;
 }
 
 void *assoc(void *item, void *list)
@@ -1183,9 +1376,9 @@ LObject *LObject::Compile(char const *&code)
     lerror(code, "mismatched )");
   else if (isdigit(n[0]) || (n[0]=='-' && isdigit(n[1])))
   {
-    LNumber *num = LNumber::Create(0);
-    sscanf(n, "%ld", &num->num);
-    ret=num;
+    long num = 0;
+    sscanf(n, "%ld", &num);
+    ret = LNumber::Create(num);
   } else if (n[0]=='"')
   {
     ret = LString::Create(str_token_len(code));
@@ -1302,7 +1495,7 @@ void LObject::Print()
         }
         break;
     case L_NUMBER:
-        sprintf(buf, "%ld", ((LNumber *)this)->num);
+        sprintf(buf, "%ld", lfixnum_value(this));
         lprint_string(buf);
         break;
     case L_SYMBOL:
@@ -1339,12 +1532,12 @@ void LObject::Print()
     case L_CHARACTER:
         if (current_print_file)
         {
-            uint8_t ch = ((LChar *)this)->ch;
+            uint8_t ch = lcharacter_value(this);
             current_print_file->write(&ch, 1);
         }
         else
         {
-            uint16_t ch = ((LChar *)this)->ch;
+            uint16_t ch = lcharacter_value(this);
             dprintf("#\\");
             switch (ch)
             {
@@ -1401,12 +1594,17 @@ LObject *LSymbol::EvalFunction(void *arg_list)
 #endif
 
     LObject *fun = function;
-    PtrRef ref2(fun);
-    PtrRef ref3(arg_list);
 
     // make sure the arguments given to the function are the correct number
     ltype t = item_type(fun);
 
+    // user functions protect what they need themselves
+    if (t == L_USER_FUNCTION)
+        return EvalUserFunction((LList *)arg_list);
+
+    PtrRef ref2(fun);
+    PtrRef ref3(arg_list);
+
 #ifdef TYPE_CHECKING
     switch (t)
     {
@@ -1504,24 +1702,29 @@ LObject *LSymbol::EvalFunction(void *arg_list)
 }
 
 #ifdef L_PROFILE
-void pro_print(bFILE *out, LSymbol *p)
+static int pro_compare(void const *a, void const *b)
 {
-  if (p)
-  {
-    pro_print(out, p->right);
-    {
-      char st[100];
-      sprintf(st, "%20s %f\n", lstring_value(p->GetName()), p->time_taken);
-      out->write(st, strlen(st));
-    }
-    pro_print(out, p->left);
-  }
+  // reverse name order, as the report always was
+  return strcmp(lstring_value((*(LSymbol **)b)->GetName()),
+                lstring_value((*(LSymbol **)a)->GetName()));
 }
 
 void preport(char *fn)
 {
   bFILE *fp=open_file("preport.out", "wb");
-  pro_print(fp, LSymbol::root);
+  LSymbol **list=(LSymbol **)malloc((LSymbol::count+1)*sizeof(LSymbol *));
+  size_t n=0;
+  for (size_t i=0; i<LSymbol::table_size; i++)
+    if (LSymbol::table[i])
+      list[n++]=LSymbol::table[i];
+  qsort(list, n, sizeof(LSymbol *), pro_compare);
+  for (size_t i=0; i<n; i++)
+  {
+    char st[100];
+    sprintf(st, "%20s %f\n", lstring_value(list[i]->GetName()), list[i]->time_taken);
+    fp->write(st, strlen(st));
+  }
+  free(list);
   delete fp;
 }
 #endif
@@ -1672,7 +1875,7 @@ void *concatenate(void *prog_list)
         while (char_list)
         {
           if (item_type(CAR(char_list))==L_CHARACTER)
-            *(s++)=((LChar *)CAR(char_list))->ch;
+            *(s++)=lcharacter_value(CAR(char_list));
           char_list=(LList *)CDR(char_list);
         }
       } break;
@@ -1887,11 +2090,11 @@ LObject *LSysFunction::EvalFunction(LList *arg_list)
             }
             else if (first)
             {
-                quot = ((LNumber *)i)->num;
+                quot = lfixnum_value(i);
                 first = 0;
             }
             else
-                quot /= ((LNumber *)i)->num;
+                quot /= lfixnum_value(i);
             arg_list = (LList *)CDR(arg_list);
         }
         ret = LNumber::Create(quot);
@@ -2180,7 +2383,7 @@ LObject *LSysFunction::EvalFunction(LList *arg_list)
         switch (item_type(i))
         {
         case L_CHARACTER:
-            ret = LNumber::Create(((LChar *)i)->ch);
+            ret = LNumber::Create(lcharacter_value(i));
             break;
         case L_STRING:
             ret = LNumber::Create(*lstring_value(i));
@@ -2203,7 +2406,7 @@ LObject *LSysFunction::EvalFunction(LList *arg_list)
             lbreak(" is not number type\n");
             exit(0);
         }
-        ret = LChar::Create(((LNumber *)i)->num);
+        ret = LChar::Create(lfixnum_value(i));
         break;
     }
     case SYS_FUNC_COND:
@@ -2691,7 +2894,7 @@ LObject *LSysFunction::EvalFunction(LList *arg_list)
     case SYS_FUNC_EQ0:
     {
         LObject *v = CAR(arg_list)->Eval();
-        if (item_type(v) != L_NUMBER || (((LNumber *)v)->num != 0))
+        if (item_type(v) != L_NUMBER || lfixnum_value(v) != 0)
             ret = NULL;
         else
             ret = true_symbol;
@@ -2960,9 +3163,89 @@ void use_user_space(void *addr, long size)
     space_size[USER_SPACE] = size;
 }
 
+// Calls with as many arguments as the function has symbols keep these
+// symbols in a preallocated frame rather than walking the argument list
+// again, and only register with PtrRef what an allocation could move.
+// Symbols are malloc()ed and never move, the argument list and body only
+// need protecting if evaluating an argument can allocate, and a body of a
+// single form has nothing left to walk once it is evaluated.
+#define LISP_FRAME_SIZE 4096
+static LSymbol *call_frame[LISP_FRAME_SIZE];
+static int frame_used = 0;
+
+static inline int may_allocate(LObject *x)
+{
+    ltype t = item_type(x);
+    if (t == L_CONS_CELL)
+        return x != NULL;
+    if (t == L_SYMBOL)
+        return item_type(((LSymbol *)x)->value) == L_OBJECT_VAR;
+    return 0;
+}
+
+static LObject *eval_fixed_call(LUserFunction *fun, LList *arg_list,
+                                int may_gc)
+{
+    int n = fun->arity;
+    LSymbol **syms = call_frame + frame_used;
+    LObject *f = fun->arg_list;
+    for (int i = 0; i < n; i++, f = CDR(f))
+        syms[i] = (LSymbol *)CAR(f);
+    frame_used += n;
+
+    long stack_start = l_user_stack.m_size;
+    for (int i = 0; i < n; i++)
+        l_user_stack.push(syms[i]->value);
+
+    LList *block_list = fun->block_list;
+    if (may_gc)
+    {
+        PtrRef r1(block_list), r2(arg_list);
+        for (int i = 0; i < n; i++, arg_list = (LList *)CDR(arg_list))
+            l_user_stack.push(CAR(arg_list)->Eval());
+    }
+    else
+        for (int i = 0; i < n; i++, arg_list = (LList *)CDR(arg_list))
+            l_user_stack.push(CAR(arg_list)->Eval());
+
+    for (int i = 0; i < n; i++)
+        syms[i]->value = (LObject *)l_user_stack.sdata[stack_start + n + i];
+    l_user_stack.m_size = stack_start + n;
+
+    LObject *ret = NULL;
+    if (block_list && !CDR(block_list))
+        ret = CAR(block_list)->Eval();
+    else
+    {
+        PtrRef r3(block_list);
+        for (; block_list; block_list = (LList *)CDR(block_list))
+            ret = CAR(block_list)->Eval();
+    }
+
+    for (int i = 0; i < n; i++)
+        syms[i]->value = (LObject *)l_user_stack.sdata[stack_start + i];
+    l_user_stack.m_size = stack_start;
+    frame_used -= n;
+
+    return ret;
+}
+
 /* PtrRef check: OK */
 LObject *LSymbol::EvalUserFunction(LList *arg_list)
 {
+#if !defined L_PROFILE
+    LUserFunction *f = (LUserFunction *)function;
+    if (item_type(f) == L_USER_FUNCTION && f->arity >= 0
+         && frame_used + f->arity <= LISP_FRAME_SIZE)
+    {
+        int given = 0, may_gc = 0;
+        for (LObject *a = arg_list; a; a = CDR(a), given++)
+            may_gc |= may_allocate(CAR(a));
+        if (given == f->arity)
+            return eval_fixed_call(f, arg_list, may_gc);
+    }
+#endif
+
     LObject *ret = NULL;
     PtrRef ref1(ret);
 
@@ -3058,11 +3341,10 @@ LObject *LSymbol::EvalUserFunction(LList *arg_list)
     return ret;
 }
 
-/* PtrRef check: OK */
+// this is not used once an allocation can happen, so it needs no PtrRef
 LObject *LObject::Eval()
 {
-    PtrRef ref1(this);
-
+#if !defined HAVE_RELEASE
     int tstart = trace_level;
 
     if (trace_level)
@@ -3077,6 +3359,7 @@ LObject *LObject::Eval()
         }
         trace_level++;
     }
+#endif
 
     LObject *ret = NULL;
 
@@ -3114,6 +3397,7 @@ LObject *LObject::Eval()
         }
     }
 
+#if !defined HAVE_RELEASE
     if (tstart)
     {
         trace_level--;
@@ -3124,6 +3408,7 @@ LObject *LObject::Eval()
         ret->Print();
         dprintf("\n");
     }
+#endif
 
 /*  l_user_stack.push(ret);
   LispGC::CollectSpace(PERM_SPACE);
@@ -3132,11 +3417,72 @@ LObject *LObject::Eval()
     return ret;
 }
 
+// -lispbench: times a few programs that are mostly function calls
+void lisp_benchmark()
+{
+    static char const *setup =
+        "(defun lb_fib (n) (if (< n 2) n (+ (lb_fib (- n 1)) (lb_fib (- n 2)))))"
+        "(defun lb_sq (x) (* x x))"
+        "(defun lb_sum (n) (do ((i 0 (setq i (+ i 1)))"
+        "                       (acc 0 (setq acc (+ acc (lb_sq (mod i 100))))))"
+        "                      ((>= i n) acc)))"
+        "(defun lb_list (n) (do ((i 0 (setq i (+ i 1)))"
+        "                        (l nil (setq l (cons (lb_sq i) l))))"
+        "                       ((>= i n) (length l))))";
+    static struct { char const *name, *prog; } const tests[] =
+    {
+        { "recursion", "(lb_fib 22)" },
+        { "arithmetic loop", "(lb_sum 50000)" },
+        { "list building", "(lb_list 20000)" },
+    };
+
+    int sp = current_space;
+    current_space = PERM_SPACE;
+    for (char const *s = setup; *s; )
+    {
+        LObject::Compile(s)->Eval();
+        while (*s == ' ')
+            s++;
+    }
+
+#if defined HAVE_RELEASE
+    printf("lisp calls, tracing compiled out\n");
+#else
+    printf("lisp calls, tracing compiled in\n");
+#endif
+    current_space = TMP_SPACE;
+    for (size_t i = 0; i < sizeof(tests) / sizeof(*tests); i++)
+    {
+        void *m = mark_heap(TMP_SPACE);
+        char const *s = tests[i].prog;
+        LObject *prog = LObject::Compile(s);
+        PtrRef r1(prog);
+
+        lisp_alloc_tick();
+        Timer t;
+        LObject *ret = NULL;
+        for (int j = 0; j < 5; j++)
+            ret = prog->Eval();
+        float ms = t.GetMs();
+        lisp_alloc_tick();
+
+        printf("  %-16s %8.2f ms  %8d allocations  result %ld\n",
+               tests[i].name, ms / 5, lisp_alloc_counts().allocs / 5,
+               (long)lnumber_value(ret));
+        restore_heap(m, TMP_SPACE);
+    }
+    current_space = sp;
+}
+
 void l_comp_init();
 
 void lisp_init()
 {
-    LSymbol::root = NULL;
+    free(LSymbol::table);
+    LSymbol::table = NULL;
+    LSymbol::table_size = 0;
+    LSymbol::count = 0;
+    symbol_lookups = symbol_probes = 0;
     total_user_functions = 0;
 
     free_space[0] = space[0] = (uint8_t *)malloc(0x1000);
@@ -3156,15 +3502,18 @@ void lisp_init()
     dprintf("Lisp: %d symbols defined, %d system functions, "
             "%d pre-compiled functions\n", LSymbol::count,
             sizeof(sys_funcs) / sizeof(*sys_funcs), total_user_functions);
+    dprintf("Lisp: symbol table %d slots, %.2f probes per symbol, "
+            "%d lookups with %.2f probes on average\n",
+            (int)LSymbol::table_size, symbol_probe_length(),
+            (int)symbol_lookups,
+            symbol_lookups ? (float)symbol_probes / symbol_lookups : 0.f);
 }
 
 void lisp_uninit()
 {
     free(space[0]);
     free(space[1]);
-    DeleteAllSymbols(LSymbol::root);
-    LSymbol::root = NULL;
-    LSymbol::count = 0;
+    DeleteAllSymbols();
 }
 
 void clear_tmp()
@@ -3195,7 +3544,9 @@ void LSymbol::SetNumber(long num)
         exit(0);
     }
 #endif
-    if (value != l_undefined && item_type(value) == L_NUMBER)
+    // allocated numbers are still changed in place
+    if (value != l_undefined && item_type(value) == L_NUMBER
+         && !limmediate(value))
         ((LNumber *)value)->num = num;
     else
         value = LNumber::Create(num);
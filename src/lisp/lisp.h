@@ -134,10 +134,11 @@ struct LSymbol : LObject
     LObject *value;
     LObject *function;
     LString *name;
-    LSymbol *left, *right; // tree structure
+    uint32_t hash;         // of the name
 
     /* Static members */
-    static LSymbol *root;
+    static LSymbol **table; // open addressing, table_size is a power of two
+    static size_t table_size;
     static size_t count;
 };
 
@@ -154,6 +155,7 @@ struct LSysFunction : LObject
 struct LUserFunction : LObject
 {
     LList *arg_list, *block_list;
+    int arity;      // -1 unless arg_list is a plain list of symbols
 };
 
 struct LArray : LObject
@@ -199,9 +201,45 @@ struct LFixedPoint : LObject
     int32_t x;
 };
 
+/* Numbers that fit and all characters are not allocated but kept in the
+ * pointer itself, tagged in the low bits which are always clear for objects
+ * from lmalloc(). Anything that looks inside an object must check its type
+ * with item_type() first, and read numbers and characters through
+ * lfixnum_value() and lcharacter_value(). */
+#define L_TAG_MASK 3
+#define L_TAG_NUMBER 1
+#define L_TAG_CHARACTER 3
+
+static inline int limmediate(void const *x) { return (intptr_t)x & 1; }
+
 static inline LObject *&CAR(void *x) { return ((LList *)x)->car; }
 static inline LObject *&CDR(void *x) { return ((LList *)x)->cdr; }
-static inline ltype item_type(void *x) { if (x) return *(ltype *)x; return L_CONS_CELL; }
+static inline ltype item_type(void *x)
+{
+    if (limmediate(x))
+        return ((intptr_t)x & L_TAG_MASK) == L_TAG_NUMBER ? L_NUMBER
+                                                          : L_CHARACTER;
+    if (x)
+        return *(ltype *)x;
+    return L_CONS_CELL;
+}
+
+// The value of an L_NUMBER, without the conversions of lnumber_value()
+static inline long lfixnum_value(void *x)
+{
+    if (limmediate(x))
+        return (long)((intptr_t)x >> 2);
+    return ((LNumber *)x)->num;
+}
+
+// Objects allocated and numbers and characters that were not, counted
+// between calls to lisp_alloc_tick()
+struct lisp_alloc_stats
+{
+    int32_t allocs, bytes, immediates;
+};
+void lisp_alloc_tick();
+lisp_alloc_stats const &lisp_alloc_counts();  // the last tick
 
 void perm_space();
 void tmp_space();
@@ -241,11 +279,18 @@ int end_of_program(char *s);
 void clear_tmp();
 void lisp_init();
 void lisp_uninit();
+void lisp_benchmark();
 
 extern uint8_t *space[4], *free_space[4];
 extern size_t space_size[4];
 void *nth(int num, void *list);
 int32_t lisp_atan2(int32_t dy, int32_t dx);
+// lisp_atan2() and dx*dx+dy*dy on n offsets at once, same results
+void lisp_atan2_batch(int32_t const *dy, int32_t const *dx, int32_t *angle,
+                      int n);
+void lisp_dist2_batch(int32_t const *dy, int32_t const *dx, int32_t *dist,
+                      int n);
+void trig_benchmark();
 int32_t lisp_sin(int32_t x);
 int32_t lisp_cos(int32_t x);
 void restore_heap(void *val, int heap);
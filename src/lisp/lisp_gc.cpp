@@ -84,6 +84,10 @@ LObject *LispGC::CollectObject(LObject *x)
 {
     LObject *ret = x;
 
+    // immediate numbers and characters are not in any space
+    if (limmediate(x))
+        return x;
+
     if ((uint8_t *)x >= cstart && (uint8_t *)x < cend)
     {
         switch (item_type(x))
@@ -92,7 +96,7 @@ LObject *LispGC::CollectObject(LObject *x)
             lbreak("error: collecting corrupted cell\n");
             break;
         case L_NUMBER:
-            ret = LNumber::Create(((LNumber *)x)->num);
+            ret = LNumber::Create(lfixnum_value(x));
             break;
         case L_SYS_FUNCTION:
             ret = new_lisp_sys_function(((LSysFunction *)x)->min_args,
@@ -172,16 +176,17 @@ LObject *LispGC::CollectObject(LObject *x)
     return ret;
 }
 
-void LispGC::CollectSymbols(LSymbol *root)
+void LispGC::CollectSymbols()
 {
-    if (!root)
-        return;
-
-    root->value = CollectObject(root->value);
-    root->function = CollectObject(root->function);
-    root->name = (LString *)CollectObject(root->name);
-    CollectSymbols(root->left);
-    CollectSymbols(root->right);
+    for (size_t i = 0; i < LSymbol::table_size; i++)
+    {
+        LSymbol *p = LSymbol::table[i];
+        if (!p)
+            continue;
+        p->value = CollectObject(p->value);
+        p->function = CollectObject(p->function);
+        p->name = (LString *)CollectObject(p->name);
+    }
 }
 
 void LispGC::CollectStacks()
@@ -224,7 +229,7 @@ void LispGC::CollectSpace(int which_space, int grow)
     collected_start = new_space;
     collected_end = new_space + space_size[GC_SPACE];
 
-    CollectSymbols(LSymbol::root);
+    CollectSymbols();
     CollectStacks();
 
     // for debuging clear it out
@@ -25,7 +25,7 @@ private:
     static LArray *CollectArray(LArray *x);
     static LList *CollectList(LList *x);
     static LObject *CollectObject(LObject *x);
-    static void CollectSymbols(LSymbol *root);
+    static void CollectSymbols();
     static void CollectStacks();
 };
 
@@ -0,0 +1,242 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+
+#include "nativeai.h"
+#include "objects.h"
+#include "level.h"
+#include "lisp.h"
+#include "jrand.h"
+#include "dprint.h"
+#include "ant.h"
+#include "cop.h"
+
+extern void *sensor_ai();
+
+struct native_entry
+{
+    char const *name;
+    int ofun;
+    native_ai_fun ai;
+    native_mover_fun mover;
+};
+
+// Porting an AI: write it like the ones in cop.cpp and add it here
+static native_entry const registry[] =
+{
+    { "ant_ai",     OFUN_AI,    ant_ai,     NULL },
+    { "sensor_ai",  OFUN_AI,    sensor_ai,  NULL },
+    { "top_ai",     OFUN_AI,    top_ai,     NULL },
+    { "ladder_ai",  OFUN_AI,    ladder_ai,  NULL },
+    { "mover_ai",   OFUN_AI,    mover_ai,   NULL },
+    { "sgun_ai",    OFUN_AI,    sgun_ai,    NULL },
+    { "respawn_ai", OFUN_AI,    respawn_ai, NULL },
+    { "cop_mover",  OFUN_MOVER, NULL,       cop_mover },
+};
+
+int native_ai_check = 0;
+static native_stats stats;
+static int checking = 0;
+
+int native_bind(int type, int ofun, char const *name)
+{
+    if (type < 0 || type >= total_objects
+         || (ofun != OFUN_AI && ofun != OFUN_MOVER))
+        return 0;
+
+    character_type *t = figures[type];
+    if (!name)
+    {
+        if (ofun == OFUN_AI)
+            t->native_ai = NULL;
+        else
+            t->native_mover = NULL;
+        return 1;
+    }
+    if (!t->get_fun(ofun))
+        return 0;
+
+    for (size_t i = 0; i < sizeof(registry) / sizeof(*registry); i++)
+    {
+        if (registry[i].ofun != ofun || strcmp(registry[i].name, name))
+            continue;
+        if (ofun == OFUN_AI)
+            t->native_ai = registry[i].ai;
+        else
+            t->native_mover = registry[i].mover;
+        dprintf("native: %s %s bound to %s\n", object_names[type],
+                ofun_names[ofun], name);
+        return 1;
+    }
+    return 0;
+}
+
+native_stats const &native_counts()
+{
+    return stats;
+}
+
+// Like game_object::copy() but without running the constructor, the
+// copy is never added to the level
+static game_object *clone(game_object *o)
+{
+    game_object *c = create(o->otype, o->x, o->y, 1);
+    c->state = o->state;
+    for (int i = 0; i < TOTAL_OBJECT_VARS; i++)
+        c->set_var(i, o->get_var(i));
+    memcpy(c->lvars, o->lvars, 4 * figures[o->otype]->tv);
+    for (int i = 0; i < o->total_objects(); i++)
+        c->add_object(o->get_object(i));
+    for (int i = 0; i < o->total_lights(); i++)
+        c->add_light(o->get_light(i));
+    c->set_controller(o->controller());
+    c->last_x = o->last_x;
+    c->last_y = o->last_y;
+    return c;
+}
+
+static void drop(game_object *c)
+{
+    c->set_controller(NULL);
+    delete c;
+}
+
+static char const *lvar_name(int type, int index)
+{
+    character_type *t = figures[type];
+    for (int i = 0; i < t->tiv; i++)
+        if (t->vars[i] && t->var_index[i] == index)
+            return lstring_value(((LSymbol *)t->vars[i])->GetName());
+    return "lvar";
+}
+
+// Returns the name of the first field the lisp and native runs left
+// different, NULL if they agree
+static char const *first_difference(game_object *l, game_object *n,
+                                    int32_t &lv, int32_t &nv)
+{
+    lv = l->otype; nv = n->otype;
+    if (lv != nv)
+        return "otype";
+    lv = l->state; nv = n->state;
+    if (lv != nv)
+        return "state";
+    for (int i = 0; i < TOTAL_OBJECT_VARS; i++)
+    {
+        lv = l->get_var(i); nv = n->get_var(i);
+        if (lv != nv)
+            return object_descriptions[i].name;
+    }
+    for (int i = 0; i < figures[l->otype]->tv; i++)
+    {
+        lv = l->lvars[i]; nv = n->lvars[i];
+        if (lv != nv)
+            return lvar_name(l->otype, i);
+    }
+    lv = l->total_objects(); nv = n->total_objects();
+    if (lv != nv)
+        return "links";
+    lv = l->total_lights(); nv = n->total_lights();
+    if (lv != nv)
+        return "lights";
+    return NULL;
+}
+
+static void compare(game_object *l, game_object *n, int ofun,
+                    int32_t lret, int32_t nret, int lrand, int nrand)
+{
+    stats.checks++;
+    int32_t lv, nv;
+    char const *what = first_difference(l, n, lv, nv);
+    if (!what && lret != nret)
+    {
+        what = "return value";
+        lv = lret; nv = nret;
+    }
+    if (!what && lrand != nrand)
+    {
+        what = "random numbers drawn";
+        lv = lrand; nv = nrand;
+    }
+    if (!what)
+        return;
+
+    if (!stats.mismatches++)
+        dprintf("native: %s %s differs from lisp at tick %d: %s is %d "
+                "instead of %d\n", object_names[l->otype], ofun_names[ofun],
+                current_level ? (int)current_level->tick_counter() : 0,
+                what, nv, lv);
+}
+
+LObject *native_check_ai(game_object *o)
+{
+    character_type *t = figures[o->otype];
+    stats.calls++;
+    if (checking == 1)
+        return (LObject *)t->native_ai();
+    if (checking == 2)
+        return ((LSymbol *)t->get_fun(OFUN_AI))->EvalFunction(NULL);
+
+    // calls made from inside each run stay on the same side
+    checking = 1;
+    unsigned short rand_start = rand_on;
+    game_object *c = clone(o);
+    current_object = c;
+    int nret = !NILP(t->native_ai());
+    int nrand = (unsigned short)(rand_on - rand_start);
+
+    checking = 2;
+    rand_on = rand_start;
+    current_object = o;
+    LObject *lret = ((LSymbol *)t->get_fun(OFUN_AI))->EvalFunction(NULL);
+    int lrand = (unsigned short)(rand_on - rand_start);
+
+    compare(o, c, OFUN_AI, !NILP(lret), nret, lrand, nrand);
+    drop(c);
+    checking = 0;
+    return lret;
+}
+
+LObject *native_check_mover(game_object *o, LObject *args, int cx, int cy,
+                            int button)
+{
+    character_type *t = figures[o->otype];
+    stats.calls++;
+    if (checking == 1)
+        return (LObject *)t->native_mover(cx, cy, button);
+    if (checking == 2)
+        return ((LSymbol *)t->get_fun(OFUN_MOVER))->EvalFunction(args);
+
+    checking = 1;
+    unsigned short rand_start = rand_on;
+    game_object *c = clone(o);
+    current_object = c;
+    int32_t nret = lnumber_value(t->native_mover(cx, cy, button));
+    int nrand = (unsigned short)(rand_on - rand_start);
+
+    checking = 2;
+    rand_on = rand_start;
+    current_object = o;
+    LObject *lret = ((LSymbol *)t->get_fun(OFUN_MOVER))->EvalFunction(args);
+    int lrand = (unsigned short)(rand_on - rand_start);
+
+    compare(o, c, OFUN_MOVER, lnumber_value(lret), nret, lrand, nrand);
+    drop(c);
+    checking = 0;
+    return lret;
+}
@@ -0,0 +1,45 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __NATIVEAI_H__
+#define __NATIVEAI_H__
+
+// AI and move functions ported from lisp to C++ are listed by name in
+// nativeai.cpp. A character's ai_fun or move_fun is switched to one with
+// (bind_native type 'ai_fun "name"), and back to its lisp function with
+// (bind_native type 'ai_fun nil). Both work on current_object like the
+// lisp functions they replace and return the same values.
+
+typedef void *(*native_ai_fun)();
+typedef void *(*native_mover_fun)(int xm, int ym, int but);
+
+class game_object;
+class LObject;
+
+// Binds ofun (OFUN_AI or OFUN_MOVER) of type to the named function, or
+// unbinds it if name is NULL. Returns 0 and leaves the lisp function in
+// use if there is no such function or nothing to replace.
+int native_bind(int type, int ofun, char const *name);
+
+// With -aicheck, every call of a bound function is also run on a copy of
+// the object, and the lisp result is kept. These run both and compare,
+// args is the lisp argument list of the move function.
+extern int native_ai_check;
+LObject *native_check_ai(game_object *o);
+LObject *native_check_mover(game_object *o, LObject *args, int cx, int cy,
+                            int button);
+
+struct native_stats
+{
+    int calls, checks, mismatches;
+};
+native_stats const &native_counts();
+
+#endif // __NATIVEAI_H__
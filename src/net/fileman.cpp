@@ -17,7 +17,6 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
-#include <signal.h>
 #include <sys/stat.h>
 
 #include "common.h"
@@ -37,6 +36,9 @@ file_manager::file_manager(int argc, char **argv, net_protocol *proto) : proto(p
   default_fs=NULL;
   no_security=0;
   nfs_list=NULL;
+  remote_list=NULL;
+  use_bulk=1;
+  sim_rtt=0;
 
   int i;
   for (i=1; i<argc; i++)
@@ -45,6 +47,8 @@ file_manager::file_manager(int argc, char **argv, net_protocol *proto) : proto(p
       fprintf(stderr,"Warning : Security measures bypassed (-bastard)\n");
       no_security=1;
     }
+    else if (!strcmp(argv[i],"-nobulk"))  // read remote files on demand like old versions
+      use_bulk=0;
 }
 
 
@@ -62,7 +66,7 @@ void file_manager::process_net()
       ok=0;
       //fprintf(stderr,"Killing nfs client, socket went bad\n");
     }
-    else if (nc->size_to_read && nc->sock->ready_to_write())
+    else if (nc->sending() && nc->sock->ready_to_write())
       ok=nc->send_read();
     else if (nc->sock->ready_to_read())
       ok=process_nfs_command(nc);    // if we couldn't process the packet, delete the connection
@@ -87,6 +91,7 @@ int file_manager::process_nfs_command(nfs_client *c)
 {
   char cmd;
   if (c->sock->read(&cmd,1)!=1) return 0;
+  if (sim_rtt) usleep(sim_rtt*1000);
   switch (cmd)
   {
     case NFCMD_READ :
@@ -129,54 +134,49 @@ int file_manager::process_nfs_command(nfs_client *c)
 
 int file_manager::nfs_client::send_read()   // return 0 if failure on socket, not failure to read
 {
-  if (file_fd>=0 && sock)
-  {
-    // first make sure the socket isn't 'full'
-    if (sock->ready_to_write())
-    {
-      char buf[READ_PACKET_SIZE];
-      short read_total;
-      short actual;
-
-      do
-      {
-    read_total=size_to_read>(READ_PACKET_SIZE-2) ? (READ_PACKET_SIZE-2) : size_to_read;
+  if (file_fd<0 || !sock)
+    return 0;
 
-    actual=read(file_fd,buf+2,read_total);
-    ushort tmp = lstl(actual);
-    memcpy(buf, &tmp, sizeof(tmp));
+  if (!packet)
+    packet=(char *)malloc(packet_size);
 
-    int write_amount=sock->write(buf,actual+2);
-    if (write_amount!=actual+2)
+  do
+  {
+    if (packet_sent==packet_used)
     {
-      fprintf(stderr,"write failed\n");
-      return 0;
+      int read_total=size_to_read>(packet_size-2) ? (packet_size-2) : size_to_read;
+      int actual=read(file_fd,packet+2,read_total);
+      if (actual<0) actual=0;
+      ushort tmp = lstl(actual);
+      memcpy(packet, &tmp, sizeof(tmp));
+      packet_used=actual+2;
+      packet_sent=0;
+      // a short read is the end of the file, this is the last packet
+      size_to_read=actual==read_total ? size_to_read-actual : 0;
     }
 
-    size_to_read-=actual;
-
-    if (!sock->ready_to_write())
+    while (packet_sent<packet_used)
     {
-      sock->read_unselectable();
-      sock->write_selectable();
-      return 1;    // not ok to write anymore, try again latter
+      int n=sock->write_some(packet+packet_sent,packet_used-packet_sent);
+      if (n<0)
+      {
+        fprintf(stderr,"write failed\n");
+        return 0;
+      }
+      if (!n)
+      {
+        // the socket is full, process_net() resumes when it drains
+        sock->read_unselectable();
+        sock->write_selectable();
+        return 1;
+      }
+      packet_sent+=n;
     }
+  } while (size_to_read);
 
-      } while (size_to_read && actual==read_total);
-
-      sock->read_selectable();
-      sock->write_unselectable();
-
-      size_to_read=0;
-      return 1;
-    } else
-    {
-      sock->read_unselectable();
-      sock->write_selectable();
-      return 1;
-    }
-  }
-  return 0;
+  sock->read_selectable();
+  sock->write_unselectable();
+  return 1;
 }
 
 
@@ -210,15 +210,18 @@ void file_manager::secure_filename(char *filename, char *mode)
 
 
 file_manager::nfs_client::nfs_client(net_socket *sock, int file_fd, nfs_client *next) :
-  sock(sock),file_fd(file_fd),next(next),size_to_read(0)
+  sock(sock),file_fd(file_fd),next(next),size_to_read(0),packet_size(READ_PACKET_SIZE),
+  packet(NULL),packet_used(0),packet_sent(0)
 {
   sock->read_selectable();
+  sock->no_delay();
 }
 
 
 file_manager::nfs_client::~nfs_client()
 {
   delete sock;
+  free(packet);
   if (file_fd>=0)
     close(file_fd);
 }
@@ -255,22 +258,28 @@ void file_manager::add_nfs_client(net_socket *sock)
   if (f<0)
     f=-1;  // make sure this is -1
 
-
-  int32_t ret=lltl(f);
-  if (sock->write(&ret,sizeof(ret))!=sizeof(ret)) { delete sock; return ; }
+  if (sim_rtt) usleep(sim_rtt*1000);
 
   if (f<0)    // no file, sorry
+  {
+    int32_t ret=lltl(f);
+    sock->write(&ret,sizeof(ret));
     delete sock;
+  }
   else
   {
     int32_t cur_pos=lseek(f,0,SEEK_CUR);
     int32_t size=lseek(f,0,SEEK_END);
     lseek(f,cur_pos,SEEK_SET);
-    size=lltl(size);
-    if (sock->write(&size,sizeof(size))!=sizeof(size)) {  close(f); delete sock; sock=NULL; return ; }
+
+    // one write for both, the client waits on each small write
+    int32_t ret[2]={ (int32_t)lltl(f),(int32_t)lltl(size) };
+    if (sock->write(ret,sizeof(ret))!=sizeof(ret)) {  close(f); delete sock; sock=NULL; return ; }
 
     nfs_list=new nfs_client(sock,f,nfs_list);
     nfs_list->size=size;
+    if (strchr(mode,'B'))
+      nfs_list->packet_size=BULK_PACKET_SIZE;
   }
 }
 
@@ -285,18 +294,37 @@ void file_manager::remote_file::r_close(char const *reason)
     delete sock;
     sock=NULL;
   }
-
+  free(bulk);
+  bulk=NULL;
 }
 
-file_manager::remote_file::remote_file(net_socket *sock, char const *filename, char const *mode, remote_file *Next) : sock(sock)
+file_manager::remote_file::remote_file(net_socket *sock, char const *filename, char const *mode, int use_bulk, remote_file *Next) : sock(sock)
 {
   next=Next;
   open_local=0;
+  sock->no_delay();   // every request waits for its answer
+  bulk=NULL;
+  bulk_received=pos=0;
+
+  // 'B' tells newer servers we can take BULK_PACKET_SIZE packets,
+  // older ones ignore mode letters they don't know
+  char bmode[20];
+  use_bulk=use_bulk && !strchr(mode,'w') && strlen(mode)<sizeof(bmode)-1;
+  if (use_bulk)
+  {
+    sprintf(bmode,"%sB",mode);
+    mode=bmode;
+  }
 
-  uint8_t sizes[3]={ CLIENT_NFS,strlen(filename)+1,strlen(mode)+1};
-  if (sock->write(sizes,3)!=3) { r_close("could not send open info"); return ; }
-  if (sock->write(filename,sizes[1])!=sizes[1]) { r_close("could not send filename"); return ; }
-  if (sock->write(mode,sizes[2])!=sizes[2]) { r_close("could not send mode"); return ; }
+  uint8_t buf[3+255+20];
+  int name_len=strlen(filename)+1,mode_len=strlen(mode)+1;
+  if (name_len>255) { r_close("filename too long"); return ; }
+  buf[0]=CLIENT_NFS;
+  buf[1]=name_len;
+  buf[2]=mode_len;
+  memcpy(buf+3,filename,name_len);
+  memcpy(buf+3+name_len,mode,mode_len);
+  if (sock->write(buf,3+name_len+mode_len)!=3+name_len+mode_len) { r_close("could not send open info"); return ; }
 
   int32_t remote_file_fd;
   if (sock->read(&remote_file_fd,sizeof(remote_file_fd))!=sizeof(remote_file_fd))
@@ -307,49 +335,99 @@ file_manager::remote_file::remote_file(net_socket *sock, char const *filename, c
   if (sock->read(&size,sizeof(size))!=sizeof(size)) { r_close("could not read remote filesize"); return ; }
 
   size=lltl(size);
-}
 
-int file_manager::remote_file::unbuffered_read(void *buffer, size_t count)
-{
-  if (sock && count)
+  if (use_bulk && size>0 && size<=BULK_MAX_FILE_SIZE)
   {
-    uint8_t cmd=NFCMD_READ;
-    if (sock->write(&cmd,sizeof(cmd))!=sizeof(cmd)) { r_close("read : could not send command"); return 0; }
+    // ask for everything now, the data streams in while the caller works
+    if (!send_command(NFCMD_READ,size)) { r_close("could not request file"); return ; }
+    bulk=(uint8_t *)malloc(size);
+  }
+}
 
-    int32_t rsize=lltl(count);
-    if (sock->write(&rsize,sizeof(rsize))!=sizeof(rsize)) { r_close("read : could not send size"); return 0; }
+int file_manager::remote_file::send_command(uint8_t cmd, int32_t arg)
+{
+  uint8_t buf[5];
+  buf[0]=cmd;
+  arg=lltl(arg);
+  memcpy(buf+1,&arg,sizeof(arg));
+  return sock->write(buf,sizeof(buf))==sizeof(buf);
+}
 
-    int32_t total_read=0;
-    char buf[READ_PACKET_SIZE];
+int file_manager::remote_file::read_full(void *buf, int count)
+{
+  int total=0;
+  while (total<count)
+  {
+    int ret=sock->read((char *)buf+total,count-total);
+    if (ret<=0)
+      return 0;
+    total+=ret;
+  }
+  return 1;
+}
 
-    ushort packet_size;
-    do
-    {
-      if (sock->read(&packet_size,sizeof(packet_size))!=sizeof(packet_size))
-      {
+int file_manager::remote_file::read_packet(void *buf, int max)
+{
+  ushort packet_size;
+  if (!read_full(&packet_size,sizeof(packet_size)))
+  {
     fprintf(stderr,"could not read packet size\n");
-    return 0;
-      }
+    return -1;
+  }
+  packet_size=lstl(packet_size);
+  if (packet_size>max || !read_full(buf,packet_size))
+  {
+    fprintf(stderr,"incomplete packet\n");
+    return -1;
+  }
+  return packet_size;
+}
 
-      packet_size=lstl(packet_size);
+int file_manager::remote_file::fill_bulk(int32_t upto)   // receive the file up to offset upto
+{
+  while (bulk_received<upto)
+  {
+    int ret=read_packet(bulk+bulk_received,size-bulk_received);
+    if (ret<0) { r_close("read : lost connection"); return 0; }
+    if (ret==0) { size=bulk_received; break; }      // file got shorter
+    bulk_received+=ret;
+  }
+  return 1;
+}
 
-      ushort size_read=sock->read(buf,packet_size);
+int file_manager::remote_file::unbuffered_read(void *buffer, size_t count)
+{
+  if (bulk)
+  {
+    int32_t todo=Min((int32_t)count,size-pos);
+    if (todo<=0 || !fill_bulk(pos+todo))
+      return 0;
+    todo=Min(todo,size-pos);
+    memcpy(buffer,bulk+pos,todo);
+    pos+=todo;
+    return todo;
+  }
 
-      if (size_read!=packet_size)
-      {
-    if (sock->read(buf+2+size_read,packet_size-size_read)!=packet_size-size_read)
+  // servers send short packets at the end of the file but we can't tell
+  // their packet size apart, so never ask for more than is left
+  int32_t todo=Min((int32_t)count,size-pos);
+  if (sock && todo>0)
+  {
+    if (!send_command(NFCMD_READ,todo)) { r_close("read : could not send command"); return 0; }
+
+    int32_t total_read=0;
+    int packet_size;
+    do
     {
-      fprintf(stderr,"incomplete packet\n");
-      return 0;
-    }
-      }
+      packet_size=read_packet(buffer,todo);
+      if (packet_size<0)
+        return 0;
 
-      memcpy(buffer,buf,packet_size);
       buffer=(void *)(((char *)buffer)+packet_size);
-
       total_read+=packet_size;
-      count-=packet_size;
-    } while (packet_size==READ_PACKET_SIZE-2 && count);
+      todo-=packet_size;
+    } while (packet_size && todo);
+    pos+=total_read;
     return total_read;
   }
   return 0;
@@ -357,6 +435,8 @@ int file_manager::remote_file::unbuffered_read(void *buffer, size_t count)
 
 int32_t file_manager::remote_file::unbuffered_tell()   // ask server where the offset of the file pointer is
 {
+  if (bulk)
+    return pos;
   if (sock)
   {
     uint8_t cmd=NFCMD_TELL;
@@ -371,16 +451,18 @@ int32_t file_manager::remote_file::unbuffered_tell()   // ask server where the o
 
 int32_t file_manager::remote_file::unbuffered_seek(int32_t offset)  // tell server to seek to a spot in a file
 {
+  if (bulk)
+  {
+    pos=Max(0,Min(offset,size));
+    return pos;
+  }
   if (sock)
   {
-    uint8_t cmd=NFCMD_SEEK;
-    if (sock->write(&cmd,sizeof(cmd))!=sizeof(cmd)) { r_close("seek : could not send command"); return 0; }
-
-    int32_t off=lltl(offset);
-    if (sock->write(&off,sizeof(off))!=sizeof(off)) { r_close("seek : could not send offset"); return 0; }
+    if (!send_command(NFCMD_SEEK,offset)) { r_close("seek : could not send command"); return 0; }
 
     if (sock->read(&offset,sizeof(offset))!=sizeof(offset)) { r_close("seek : could not read offset"); return 0; }
-    return lltl(offset);
+    pos=lltl(offset);
+    return pos;
   }
   return 0;
 }
@@ -417,7 +499,7 @@ int file_manager::rf_open_file(char const *&filename, char const *mode)
       return -1;
     }
 
-    remote_file *rf=new remote_file(sock,filename,mode,remote_list);
+    remote_file *rf=new remote_file(sock,filename,mode,use_bulk,remote_list);
     if (rf->open_failure())
     {
       delete rf;
@@ -21,8 +21,12 @@ class file_manager
     nfs_client *next;
     int32_t size_to_read;
     int32_t size;
+    int packet_size;   // READ_PACKET_SIZE, or BULK_PACKET_SIZE for bulk clients
+    char *packet;      // packet being sent, the rest goes out on the next poll
+    int packet_used,packet_sent;
     nfs_client(net_socket *sock, int file_fd, nfs_client *next);
-    int send_read();     // flushes as much of size_to_read as possible
+    int sending() { return size_to_read || packet_sent<packet_used; }
+    int send_read();     // sends as much of size_to_read as fits, never waits
     ~nfs_client();
   } ;
 
@@ -35,7 +39,18 @@ class file_manager
     int32_t size;   // server tells us the size of the file when we open it
     int open_local;
     remote_file *next;
-    remote_file(net_socket *sock, char const *filename, char const *mode, remote_file *Next);
+
+    // bulk mode : the whole file is requested right after the open and
+    // arrives while we read it, seeks and tells never touch the network
+    uint8_t *bulk;
+    int32_t bulk_received;
+    int32_t pos;    // our idea of the file offset, reads never ask past the end
+
+    remote_file(net_socket *sock, char const *filename, char const *mode, int use_bulk, remote_file *Next);
+    int send_command(uint8_t cmd, int32_t arg);  // command and argument in one write
+    int read_full(void *buf, int count);
+    int read_packet(void *buf, int max);       // returns payload size or -1
+    int fill_bulk(int32_t upto);
 
     int unbuffered_read(void *buffer, size_t count);
     int unbuffered_write(void const *buf, size_t count) { return 0; } // not supported
@@ -55,6 +70,8 @@ class file_manager
   void secure_filename(char *filename, char *mode);
   remote_file *find_rf(int fd);
   net_protocol *proto;
+  int use_bulk;
+  int sim_rtt;      // milliseconds the server waits before answering, for benchmarks
   public :
 
   file_manager(int argc, char **argv, net_protocol *proto);
@@ -69,6 +86,8 @@ class file_manager
   int rf_close(int fd);
   int32_t rf_file_size(int fd);
   void set_default_fs(net_address *def) { default_fs=def->copy(); }
+  void set_bulk(int on) { use_bulk=on; }
+  void set_sim_rtt(int ms) { sim_rtt=ms; }
   ~file_manager() { if (default_fs) delete default_fs; }
 } ;
 
@@ -0,0 +1,84 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <string.h>
+
+#include "common.h"
+
+#include "gbatch.h"
+
+int net_batch_delay=0;
+
+int tick_ring::append(uint8_t tick, void const *buf, int len)
+{
+  int i=tick%BATCH_RING;
+  if (size[i]+len>BATCH_SLOT_MAX)
+    return 0;
+  memcpy(data[i]+size[i],buf,len);
+  size[i]+=len;
+  return 1;
+}
+
+int batch_datagram::parse(net_packet *pk)
+{
+  int left=pk->packet_size();
+  uint8_t *p=pk->packet_data();
+  if (left<3)
+    return 0;
+
+  epoch=pk->tick_received();
+  ack=p[0];
+  first=p[1];
+  count=p[2];
+  p+=3; left-=3;
+  if (count>BATCH_RING)
+    return 0;
+
+  for (int i=0; i<count; i++)
+  {
+    uint16_t x;
+    if (left<2) return 0;
+    memcpy(&x,p,2);
+    x=lstl(x);
+    p+=2; left-=2;
+    if (x>left) return 0;
+    entry[i]=p;
+    entry_size[i]=x;
+    p+=x; left-=x;
+  }
+  return 1;
+}
+
+void batch_write(net_packet *pk, uint8_t epoch, uint8_t ack,
+                 tick_ring *ring, uint8_t first, uint8_t end)
+{
+  pk->packet_reset();
+  pk->set_tick_received(epoch);
+  pk->write_uint8(ack);
+  pk->write_uint8(first);
+  pk->write_uint8(0);
+
+  int count=0,room=PACKET_MAX_SIZE-pk->packet_prefix_size()-pk->packet_size()-1;
+  for (uint8_t t=first; t!=end && count<BATCH_RING; t++,count++)
+  {
+    int size=ring->slot_size(t);
+    if (size+2>room)
+      break;
+    pk->write_uint16(size);
+    pk->add_to_packet(ring->slot_data(t),size);
+    room-=size+2;
+  }
+  pk->packet_data()[2]=count;
+  pk->calc_checksum();
+}
@@ -0,0 +1,53 @@
+#ifndef __GBATCH_HPP_
+#define __GBATCH_HPP_
+
+#include "netface.h"
+
+// Batched game data transport, used when the server runs with -netdelay.
+// Inputs are sent net_batch_delay ticks ahead of the tick they apply to and
+// every datagram repeats all the ticks the other side has not acknowledged
+// yet, so a lost datagram is covered by the next one instead of stalling
+// everyone until a resend.
+//
+// datagram : net_packet prefix, tick byte holds the epoch (bumped on reload)
+//            uint8 ack     next tick the sender needs from the receiver
+//            uint8 first   tick of the first entry
+//            uint8 count   number of entries
+//            count * { uint16 size, data }
+
+#define BATCH_MAX_DELAY 8
+#define BATCH_RING      32     // ticks kept in flight, > 2*(BATCH_MAX_DELAY+1)
+#define BATCH_SLOT_MAX  (PACKET_MAX_SIZE-16)  // one entry always fits a datagram
+
+extern int net_batch_delay;    // 0 uses the lockstep transport
+
+// a<b for 8-bit ticks that are less than 128 ticks apart
+static inline int tick_before(uint8_t a, uint8_t b) { return (int8_t)(a-b)<0; }
+
+class tick_ring
+{
+  uint16_t size[BATCH_RING];
+  uint8_t data[BATCH_RING][BATCH_SLOT_MAX];
+  public :
+  tick_ring() { clear(); }
+  void clear() { memset(size,0,sizeof(size)); }
+  void clear(uint8_t tick) { size[tick%BATCH_RING]=0; }
+  uint16_t slot_size(uint8_t tick) { return size[tick%BATCH_RING]; }
+  uint8_t *slot_data(uint8_t tick) { return data[tick%BATCH_RING]; }
+  int append(uint8_t tick, void const *buf, int len);   // returns 0 if the slot is full
+} ;
+
+struct batch_datagram
+{
+  uint8_t epoch,ack,first,count;
+  uint8_t *entry[BATCH_RING];
+  uint16_t entry_size[BATCH_RING];
+
+  int parse(net_packet *pk);          // returns 0 if the datagram is malformed
+} ;
+
+// fills pk with ticks [first,end) of ring, stopping when it is full
+void batch_write(net_packet *pk, uint8_t epoch, uint8_t ack,
+                 tick_ring *ring, uint8_t first, uint8_t end);
+
+#endif
@@ -60,6 +60,13 @@ int game_client::process_server_command()
       }
       return 1;
     } break;
+    case CLCMD_BATCH_MODE :
+    {
+      uint8_t delay;
+      if (client_sock->read(&delay,1)!=1) return 0;
+      set_batch_mode(delay);
+      return 1;
+    } break;
     default :
     {
       fprintf(stderr,"unknown command from server %d\n",cmd);
@@ -84,7 +91,9 @@ int game_client::process_net()
       uint16_t rec_crc=tmp.get_checksum();
       if (rec_crc==tmp.calc_checksum())
       {
-    if (base->current_tick==tmp.tick_received())
+    if (net_batch_delay)
+      process_batch(&tmp);
+    else if (base->current_tick==tmp.tick_received())
     {
       base->packet=tmp;
       wait_local_input=1;
@@ -120,10 +129,87 @@ game_client::game_client(net_socket *client_sock, net_address *server_addr) :
  server_data_port=server_addr->copy();
   client_sock->read_selectable();
   wait_local_input=1;
+  out=in=NULL;
+  epoch=stale_epoch=-1;
+  batch_fresh=1;
+}
+
+void game_client::set_batch_mode(int delay)
+{
+  net_batch_delay=Min(delay,BATCH_MAX_DELAY);
+  if (net_batch_delay && !out)
+  {
+    out=new tick_ring;
+    in=new tick_ring;
+  }
+  batch_fresh=1;
+}
+
+void game_client::send_batch()
+{
+  net_packet pk;
+  batch_write(&pk,epoch,in_end,out,out_start,out_end);
+  game_sock->write(pk.data,pk.packet_size()+pk.packet_prefix_size(),server_data_port);
+}
+
+void game_client::process_batch(net_packet *pk)
+{
+  batch_datagram d;
+  if (!d.parse(pk))
+  {
+    fprintf(stderr,"received malformed batch\n");
+    return ;
+  }
+
+  if (epoch<0)
+  {
+    if (d.epoch==stale_epoch)      // left over from before the last reload
+      return ;
+    epoch=d.epoch;
+  }
+  if (d.epoch!=epoch || batch_fresh)
+    return ;
+
+  if (tick_before(out_start,d.ack) && !tick_before(out_end,d.ack))
+    out_start=d.ack;
+
+  uint8_t now=base->current_tick;
+  for (int i=0; i<d.count; i++)
+  {
+    uint8_t t=d.first+i;
+    if (t==in_end && tick_before(t,now+BATCH_RING))
+    {
+      in->clear(t);
+      in->append(t,d.entry[i],d.entry_size[i]);
+      in_end++;
+    }
+  }
+  deliver_batch();
+}
+
+// hand the merged input for the current tick to the engine if we have it
+void game_client::deliver_batch()
+{
+  uint8_t now=base->current_tick;
+  if (wait_local_input || !tick_before(now,in_end))
+    return ;
+
+  base->packet.packet_reset();
+  base->packet.set_tick_received(now);
+  base->packet.add_to_packet(in->slot_data(now),in->slot_size(now));
+  wait_local_input=1;
+  base->input_state=INPUT_PROCESSING;
 }
 
 int game_client::input_missing()
 {
+  if (net_batch_delay)
+  {
+    if (!batch_fresh)
+      send_batch();
+    return 1;
+  }
+
   if (prot->debug_level(net_protocol::DB_IMPORTANT_EVENT))
     fprintf(stderr,"(resending %d)\n",base->packet.tick_received());
   net_packet *pack=&base->packet;
@@ -143,6 +229,24 @@ void game_client::add_engine_input()
   net_packet *pack=&base->packet;
   base->input_state=INPUT_COLLECTING;
   wait_local_input=0;
+  if (net_batch_delay)
+  {
+    uint8_t now=base->current_tick;
+    if (batch_fresh)
+    {
+      out_start=out_end=now+net_batch_delay;   // the server fills the ticks before that
+      in_end=now;
+      batch_fresh=0;
+    }
+    // our input applies net_batch_delay ticks from now, until the server
+    // acknowledges it every datagram carries it again
+    out->clear(out_end);
+    out->append(out_end,pack->packet_data(),pack->packet_size());
+    out_end++;
+    send_batch();
+    deliver_batch();
+    return ;
+  }
   pack->set_tick_received(base->current_tick);
   pack->calc_checksum();
   game_sock->write(pack->data,pack->packet_size()+pack->packet_prefix_size(),server_data_port);
@@ -155,6 +259,13 @@ void game_client::add_engine_input()
 
 int game_client::end_reload(int disconnect)  // notify evryone you've reloaded the level (at server request)
 {
+  if (net_batch_delay)       // start over with the reloaded level's ticks
+  {
+    stale_epoch=epoch;
+    epoch=-1;
+    batch_fresh=1;
+  }
+
   uint8_t cmd=CLCMD_RELOAD_END;
   if (client_sock->write(&cmd,1)!=1) return 0;
   return 1;
@@ -165,6 +276,12 @@ int game_client::start_reload()
   uint8_t cmd=CLCMD_RELOAD_START;
   if (client_sock->write(&cmd,1)!=1) return 0;
   if (client_sock->read(&cmd,1)!=1) return 0;
+  if (cmd==CLCMD_BATCH_MODE)    // sent right after joining, may not have been read yet
+  {
+    uint8_t delay;
+    if (client_sock->read(&delay,1)!=1 || client_sock->read(&cmd,1)!=1) return 0;
+    set_batch_mode(delay);
+  }
   return 1;
 }
 
@@ -192,6 +309,8 @@ int game_client::quit()
 
 game_client::~game_client()
 {
+  delete out;
+  delete in;
   delete client_sock;
   delete server_data_port;
 }
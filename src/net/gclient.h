@@ -4,6 +4,7 @@
 #include <unistd.h>
 #include "sock.h"
 #include "ghandler.h"
+#include "gbatch.h"
 
 class game_client : public game_handler
 {
@@ -11,6 +12,15 @@ class game_client : public game_handler
   int wait_local_input;
   int process_server_command();
   net_address *server_data_port;
+
+  // batched transport (-netdelay), see gbatch.h
+  tick_ring *out,*in;                  // our unacked inputs, merged ticks not processed yet
+  uint8_t out_start,out_end,in_end;
+  int epoch,stale_epoch,batch_fresh;
+  void set_batch_mode(int delay);
+  void send_batch();
+  void process_batch(net_packet *pk);
+  void deliver_batch();
   public :
 
   game_client(net_socket *client_sock, net_address *server_addr);
@@ -21,6 +31,7 @@ class game_client : public game_handler
   virtual int end_reload(int disconnect=0);
   virtual int kill_slackers();
   virtual int quit();
+  virtual int networked() { return 1; }
   virtual ~game_client();
 } ;
 
@@ -22,6 +22,8 @@ class game_handler     // game_client and game_serevr are derived from here
   virtual int kill_slackers()     { return 1; }
   virtual int quit()              { return 1; }  // should disconnect from everone and close all sockets
   virtual void game_start_wait()  { ; }
+  virtual int peers_support_sync64() { return 1; }
+  virtual int networked()         { return 0; }  // a server or a client
   virtual ~game_handler()         { ; }
 } ;
 
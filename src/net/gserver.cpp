@@ -45,6 +45,9 @@ game_server::game_server()
     player_list = NULL;
     waiting_server_input = 1;
     reload_state = 0;
+    merged = net_batch_delay ? new tick_ring : NULL;
+    merged_start = merged_end = own_end = served = epoch = 0;
+    batch_fresh = 1;
 }
 
 int game_server::total_players()
@@ -100,28 +103,16 @@ game_server::player_client::~player_client()
   delete data_address;
 }
 
-void game_server::check_collection_complete()
+// tells everyone about clients that left in pk and forgets about them
+void game_server::remove_deleted_clients(net_packet *pk)
 {
-  player_client *c;
-  int got_all=waiting_server_input==0;
-  int add_deletes=0;
-  for (c=player_list; c && got_all; c=c->next)
-  {
-    if (c->delete_me())
-      add_deletes=1;
-    else if (c->has_joined() && c->wait_input())
-      got_all=0;
-  }
-
-  if (add_deletes)
-  {
-    player_client *last=NULL;
+    player_client *c,*last=NULL;
     for (c=player_list; c; )
     {
       if (c->delete_me())
       {
-    base->packet.write_uint8(SCMD_DELETE_CLIENT);
-    base->packet.write_uint8(c->client_id);
+    pk->write_uint8(SCMD_DELETE_CLIENT);
+    pk->write_uint8(c->client_id);
     if (c->wait_reload())
     {
       c->set_wait_reload(0);
@@ -139,8 +130,30 @@ void game_server::check_collection_complete()
     c=c->next;
       }
     }
+}
+
+void game_server::check_collection_complete()
+{
+  if (net_batch_delay)
+  {
+    check_batch_complete();
+    return ;
   }
 
+  player_client *c;
+  int got_all=waiting_server_input==0;
+  int add_deletes=0;
+  for (c=player_list; c && got_all; c=c->next)
+  {
+    if (c->delete_me())
+      add_deletes=1;
+    else if (c->has_joined() && c->wait_input())
+      got_all=0;
+  }
+
+  if (add_deletes)
+    remove_deleted_clients(&base->packet);
+
   if (got_all)    // see if we have input from everyone, if so send it out
   {
     base->packet.calc_checksum();
@@ -161,8 +174,144 @@ void game_server::check_collection_complete()
   }
 }
 
+// starts a new run of ticks after the game began or a reload: nobody has
+// input for the first net_batch_delay ticks, so they are complete at once
+void game_server::batch_start(uint8_t tick)
+{
+  merged->clear();
+  epoch++;
+  merged_start=merged_end=served=tick;
+  own_end=tick+net_batch_delay;
+  for (player_client *c=player_list; c; c=c->next)
+  {
+    c->in_next=own_end;
+    c->acked=tick;
+  }
+  batch_fresh=0;
+}
+
+void game_server::send_batch(player_client *c)
+{
+  net_packet pk;
+  batch_write(&pk,epoch,c->in_next,merged,c->acked,merged_end);
+  game_sock->write(pk.data,pk.packet_size()+pk.packet_prefix_size(),c->data_address);
+}
+
+void game_server::process_batch(net_packet *pk, player_client *c)
+{
+  batch_datagram d;
+  if (!d.parse(pk))
+  {
+    fprintf(stderr,"received malformed batch\n");
+    return ;
+  }
+  if (batch_fresh || d.epoch!=epoch)
+    return ;
+
+  int acked=0;
+  if (tick_before(c->acked,d.ack) && !tick_before(merged_end,d.ack))
+  {
+    c->acked=d.ack;
+    acked=1;
+  }
+
+  if (base->input_state!=INPUT_RELOAD)
+    for (int i=0; i<d.count; i++)
+    {
+      uint8_t t=d.first+i;
+      if (t==c->in_next && tick_before(t,merged_start+BATCH_RING))
+      {
+        // a full slot keeps in_next here, the client sends the entry
+        // again instead of it being acked and lost
+        if (!merged->append(t,d.entry[i],d.entry_size[i]))
+        {
+          fprintf(stderr,"batch for tick %d is full\n",t);
+          break;
+        }
+        c->in_next++;
+      }
+    }
+
+  // the ack did not move, so what we sent last time was probably lost
+  if (!acked && tick_before(c->acked,merged_end))
+    send_batch(c);
+
+  check_batch_complete();
+}
+
+void game_server::check_batch_complete()
+{
+  player_client *c;
+  for (c=player_list; c && !c->delete_me(); c=c->next) ;
+  if (c)
+  {
+    if (batch_fresh)
+      remove_deleted_clients(&base->packet);
+    else
+    {
+      net_packet pk;
+      pk.packet_reset();
+      remove_deleted_clients(&pk);
+      merged->append(merged_end,pk.packet_data(),pk.packet_size());
+    }
+  }
+  if (batch_fresh)
+    return ;
+
+  int progress=0;
+  while (tick_before(merged_end,own_end))
+  {
+    for (c=player_list; c; c=c->next)
+      if (c->has_joined() && !tick_before(merged_end,c->in_next))
+        break;
+    if (c)
+      break;
+    merged_end++;
+    progress=1;
+  }
+
+  if (progress)
+    for (c=player_list; c; c=c->next)
+      if (c->has_joined())
+        send_batch(c);
+
+  if (!waiting_server_input && base->input_state==INPUT_COLLECTING &&
+      tick_before(served,merged_end))
+  {
+    base->packet.packet_reset();
+    base->packet.set_tick_received(served);
+    base->packet.add_to_packet(merged->slot_data(served),merged->slot_size(served));
+    served++;
+    waiting_server_input=1;
+    base->input_state=INPUT_PROCESSING; // tell engine to start processing
+  }
+
+  // slots nobody needs any more can be reused
+  uint8_t start=served;
+  for (c=player_list; c; c=c->next)
+    if (c->has_joined() && tick_before(c->acked,start))
+      start=c->acked;
+  for (; tick_before(merged_start,start); merged_start++)
+    merged->clear(merged_start);
+}
+
 void game_server::add_engine_input()
 {
+  if (net_batch_delay)
+  {
+    uint8_t now=base->current_tick;
+    if (batch_fresh || own_end!=(uint8_t)(now+net_batch_delay))
+      batch_start(now);
+
+    // the server's input is delayed like everyone else's
+    merged->append(own_end,base->packet.packet_data(),base->packet.packet_size());
+    own_end++;
+    waiting_server_input=0;
+    base->input_state=INPUT_COLLECTING;
+    check_batch_complete();
+    return ;
+  }
+
   waiting_server_input=0;
   base->input_state=INPUT_COLLECTING;
   base->packet.set_tick_received(base->current_tick);
@@ -240,7 +389,8 @@ int game_server::process_net()
 {
   int ret=0;
   /**************************       Any game data waiting?       **************************/
-  if ((base->input_state==INPUT_COLLECTING ||
+  if ((net_batch_delay ||
+       base->input_state==INPUT_COLLECTING ||
        base->input_state==INPUT_RELOAD)
        && game_sock->ready_to_read())
   {
@@ -261,7 +411,9 @@ int game_server::process_net()
       for (; !found &&f; f=f->next)
       if (f->has_joined() && from->equal(f->data_address))
         found=f;
-      if (found)
+      if (found && net_batch_delay)
+        process_batch(use,found);
+      else if (found)
       {
         if (base->current_tick==use->tick_received())
         {
@@ -325,6 +477,12 @@ int game_server::process_net()
 
 int game_server::input_missing()
 {
+  if (net_batch_delay && !batch_fresh)
+  {
+    for (player_client *c=player_list; c; c=c->next)
+      if (c->has_joined() && tick_before(c->acked,merged_end))
+        send_batch(c);
+  }
 
   return 1;
 }
@@ -347,6 +505,7 @@ int game_server::end_reload(int disconnect)  // notify evryone you've reloaded t
   for (c=player_list; c; c=c->next)
     c->set_has_joined(1);
   reload_state=0;
+  batch_fresh=1;      // everyone starts again from the reloaded level's tick
 
   return 1;
 }
@@ -410,6 +569,15 @@ int game_server::add_client(int type, net_socket *sock, net_address *from)
 
         cport=lstl(cport);
 
+        // newer clients list their capabilities after the name
+        name[len] = 0;
+        int caps = len > strlen(name) + 1 ? name[strlen(name) + 1] : 0;
+        if( net_batch_delay && !( caps & NET_CAP_BATCH ) )
+        {
+            fprintf( stderr, "client %s cannot use -netdelay, refused\n", name );
+            return 0;
+        }
+
         int f = -1, i;
         for( i = 0; f == -1 && i < MAX_JOINERS; i++ )
         {
@@ -437,11 +605,19 @@ int game_server::add_client(int type, net_socket *sock, net_address *from)
         }
         client_id=f;
 
+        if( caps & NET_CAP_BATCH )
+        {
+            uint8_t mode[2] = { CLCMD_BATCH_MODE, (uint8_t)net_batch_delay };
+            if( sock->write( mode, 2 ) != 2 )
+                return 0;
+        }
+
         join_array[client_id].next = base->join_list;
         base->join_list = &join_array[client_id];
         join_array[client_id].client_id = client_id;
         strcpy( join_array[client_id].name, name );
         player_list = new player_client( f, sock, from, player_list );
+        player_list->set_sync64( caps & NET_CAP_SYNC64 );
 
         return 1;
     }
@@ -461,6 +637,14 @@ int game_server::kill_slackers()
   return 1;
 }
 
+int game_server::peers_support_sync64()
+{
+    for (player_client *c = player_list; c; c = c->next)
+        if (!c->delete_me() && !c->sync64())
+            return 0;
+    return 1;
+}
+
 int game_server::quit()
 {
   player_client *c=player_list;
@@ -478,5 +662,6 @@ int game_server::quit()
 game_server::~game_server()
 {
     quit();
+    delete merged;
 }
 
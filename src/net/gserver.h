@@ -5,6 +5,7 @@
 
 #include "sock.h"
 #include "ghandler.h"
+#include "gbatch.h"
 
 class game_server : public game_handler
 {
@@ -15,7 +16,8 @@ class game_server : public game_handler
        Wait_reload=2,
        Wait_input=4,
        Need_reload_start_ok=8,
-       Delete_me=16 };
+       Delete_me=16,
+       Sync64=32 };
     int get_flag(int flag)         { return flags&flag; }
     void set_flag(int flag, int x) { if (x) flags|=flag; else flags&=~flag; }
 
@@ -35,7 +37,11 @@ class game_server : public game_handler
     int need_reload_start_ok() { return get_flag(Need_reload_start_ok); }
     void set_need_reload_start_ok(int x) { set_flag(Need_reload_start_ok,x); }
 
+    int sync64() { return get_flag(Sync64); }
+    void set_sync64(int x) { set_flag(Sync64,x); }
+
     int client_id;
+    uint8_t in_next,acked;   // batched transport: next input tick we need, next merged tick they need
     net_socket *comm;
     net_address *data_address;
     player_client *next;
@@ -43,6 +49,7 @@ class game_server : public game_handler
       client_id(client_id), comm(comm), data_address(data_address), next(next)
       {
     flags=0;
+    in_next=acked=0;
     set_wait_input(1);
     comm->read_selectable();
       };
@@ -52,7 +59,21 @@ class game_server : public game_handler
   player_client *player_list;
   int waiting_server_input, reload_state;
 
+  // batched transport (-netdelay), see gbatch.h
+  tick_ring *merged;          // everyone's input by tick
+  uint8_t merged_start,       // oldest tick someone may still need
+          merged_end,         // ticks before this have input from everyone
+          own_end,            // next tick the server adds its input to
+          served,             // next tick the server's engine processes
+          epoch;
+  int batch_fresh;
+  void batch_start(uint8_t tick);
+  void send_batch(player_client *c);
+  void process_batch(net_packet *pk, player_client *c);
+  void check_batch_complete();
+
   void add_client_input(char *buf, int size, player_client *c);
+  void remove_deleted_clients(net_packet *pk);
   void check_collection_complete();
   void check_reload_wait();
   int process_client_command(player_client *c);
@@ -68,6 +89,8 @@ class game_server : public game_handler
   virtual int add_client(int type, net_socket *sock, net_address *from);
   virtual int kill_slackers();
   virtual int quit();
+  virtual int peers_support_sync64();
+  virtual int networked() { return 1; }
   game_server();
   ~game_server();
 } ;
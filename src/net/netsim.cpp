@@ -0,0 +1,124 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <string.h>
+
+#include "common.h"
+
+#include "netsim.h"
+#include "netface.h"
+#include "timing.h"
+
+int net_sim_loss=0,net_sim_lag=0;
+
+#define SIM_QUEUE 64
+
+class lossy_socket;
+static lossy_socket *sim=NULL;   // the game socket currently wrapped
+
+class lossy_socket : public net_socket
+{
+  struct delayed
+  {
+    uint8_t data[PACKET_MAX_SIZE];
+    int size;
+    net_address *addr;
+    time_marker sent;
+  } queue[SIM_QUEUE];
+  int queue_start,queue_total;
+  uint32_t seed;
+  net_socket *sock;
+
+  int chance(int percent)
+  {
+    // private generator, the game's random table must stay untouched
+    seed=seed*1103515245+12345;
+    return (int)((seed>>16)%100)<percent;
+  }
+
+  public :
+  lossy_socket(net_socket *sock) : sock(sock)
+  {
+    queue_start=queue_total=0;
+    seed=0x1234;
+  }
+
+  void flush()
+  {
+    time_marker now;
+    while (queue_total)
+    {
+      delayed *d=queue+queue_start;
+      if (now.diff_time(&d->sent)*1000.0<net_sim_lag)
+        break;
+      sock->write(d->data,d->size,d->addr);
+      delete d->addr;
+      queue_start=(queue_start+1)%SIM_QUEUE;
+      queue_total--;
+    }
+  }
+
+  virtual int error()                 { return sock->error(); }
+  virtual int ready_to_read()         { flush(); return sock->ready_to_read(); }
+  virtual int ready_to_write()        { return sock->ready_to_write(); }
+  virtual int read(void *buf, int size, net_address **addr=0) { return sock->read(buf,size,addr); }
+  virtual int get_fd()                { return sock->get_fd(); }
+  virtual void read_selectable()      { sock->read_selectable(); }
+  virtual void read_unselectable()    { sock->read_unselectable(); }
+  virtual void write_selectable()     { sock->write_selectable(); }
+  virtual void write_unselectable()   { sock->write_unselectable(); }
+
+  virtual int write(void const *buf, int size, net_address *addr=0)
+  {
+    flush();
+    if (chance(net_sim_loss))
+      return size;                         // lost on the way, the sender can't tell
+    if (!net_sim_lag || !addr || size>PACKET_MAX_SIZE || queue_total==SIM_QUEUE)
+      return sock->write(buf,size,addr);
+
+    delayed *d=queue+(queue_start+queue_total)%SIM_QUEUE;
+    memcpy(d->data,buf,size);
+    d->size=size;
+    d->addr=addr->copy();
+    d->sent.get_time();
+    queue_total++;
+    return size;
+  }
+
+  virtual ~lossy_socket()
+  {
+    if (sim==this)
+      sim=NULL;
+    for (; queue_total; queue_total--)
+    {
+      delete queue[queue_start].addr;
+      queue_start=(queue_start+1)%SIM_QUEUE;
+    }
+    delete sock;
+  }
+} ;
+
+net_socket *net_sim_wrap(net_socket *sock)
+{
+  if (!sock || (!net_sim_loss && !net_sim_lag))
+    return sock;
+  sim=new lossy_socket(sock);
+  return sim;
+}
+
+void net_sim_flush()
+{
+  if (sim)
+    sim->flush();
+}
@@ -0,0 +1,15 @@
+#ifndef __NETSIM_HPP_
+#define __NETSIM_HPP_
+
+#include "sock.h"
+
+// Loopback test harness: -netloss <percent> and -netlag <ms> make the game
+// data socket drop and delay outgoing datagrams, so stall behaviour can be
+// measured with a server and clients on the same machine.
+
+extern int net_sim_loss, net_sim_lag;
+
+net_socket *net_sim_wrap(net_socket *sock);   // returns sock if no simulation was asked for
+void net_sim_flush();                         // sends delayed datagrams that are due
+
+#endif
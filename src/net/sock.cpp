@@ -19,6 +19,8 @@
 const char notify_signature[] = "I wanna play ABUSE!";
 const char notify_response[] = "Yes!";
 
+int64_t net_bytes_in=0,net_bytes_out=0;
+
 net_protocol *net_protocol::first=0;
 
 // connect to an explictedly named address
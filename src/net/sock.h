@@ -1,9 +1,14 @@
 #ifndef __SOCK_HPP_
 #define __SOCK_HPP_
 
+#include <stdint.h>
+
 extern const char notify_signature[];
 extern const char notify_response[];
 
+// bytes moved by all sockets since startup, kept up to date by the drivers
+extern int64_t net_bytes_in,net_bytes_out;
+
 class net_address
 {
 public:
@@ -29,6 +34,8 @@ public:
   virtual int ready_to_read()                                      = 0;
   virtual int ready_to_write()                                     = 0;
   virtual int write(void const *buf, int size, net_address *addr=0)   = 0;
+  // writes what fits without waiting, 0 when the socket is full, -1 on error
+  virtual int write_some(void const *buf, int size) { return write(buf,size); }
   virtual int read(void *buf, int size, net_address **addr=0)      = 0;
   virtual int get_fd()                                             = 0;
   virtual ~net_socket()              { ; }
@@ -38,6 +45,7 @@ public:
   virtual void write_unselectable()  { ; }
   virtual int listen(int port)       { return 0; }
   virtual net_socket *accept(net_address *&from) { from=0; return 0; }
+  virtual void no_delay()            { ; }  // send small writes right away
 };
 
 class net_protocol
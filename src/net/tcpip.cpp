@@ -16,6 +16,7 @@
 #include <strings.h>
 #endif
 #include <ctype.h>
+#include <errno.h>
 
 #if (defined(__APPLE__) && !defined(__MACH__))
 #   include "GUSI.h"
@@ -72,6 +73,7 @@ int unix_fd::read(void *buf, int size, net_address **addr)
 
   net_log("tcpip.cpp: unix_fd::read:", (char *) buf, (long) size);
 
+  if (tr>0) net_bytes_in+=tr;
   if (addr) *addr=NULL;
   return tr;
 }
@@ -83,7 +85,23 @@ int unix_fd::write(void const *buf, int size, net_address *addr)
   net_log("tcpip.cpp: unix_fd::write:", (char *) buf, (long) size);
 
   if (addr) fprintf(stderr,"Cannot change address for this socket type\n");
-  return ::write(fd,(char*)buf,size);
+  // a peer that hung up makes the write fail instead of raising SIGPIPE
+  int tw=send(fd,(char const *)buf,size,MSG_NOSIGNAL);
+  if (tw>0) net_bytes_out+=tw;
+  return tw;
+}
+//}}}///////////////////////////////////
+
+int unix_fd::write_some(void const *buf, int size)
+//{{{
+{
+  net_log("tcpip.cpp: unix_fd::write_some:", (char *) buf, (long) size);
+
+  int tw=send(fd,(char const *)buf,size,MSG_NOSIGNAL|MSG_DONTWAIT);
+  if (tw<0 && (errno==EAGAIN || errno==EWOULDBLOCK))
+    return 0;
+  if (tw>0) net_bytes_out+=tw;
+  return tw;
 }
 //}}}///////////////////////////////////
 
@@ -29,6 +29,7 @@
 #   include <sys/ipc.h>
 #   include <sys/shm.h>
 #   include <sys/socket.h>
+#   include <netinet/tcp.h>
 #   include <unistd.h>
 #   ifdef HAVE_BSTRING_H
 #       include <bstring.h>
@@ -40,6 +41,13 @@
 #include "sock.h"
 #include "isllist.h"
 
+#if !defined MSG_NOSIGNAL
+#   define MSG_NOSIGNAL 0   // tcp_socket sets SO_NOSIGPIPE instead
+#endif
+#if !defined MSG_DONTWAIT
+#   define MSG_DONTWAIT 0   // write_some() then waits like write()
+#endif
+
 extern fd_set master_set, master_write_set, read_set, exception_set, write_set;
 
 class ip_address : public net_address
@@ -147,6 +155,7 @@ class unix_fd : public net_socket
     return FD_ISSET(fd,&write_check);
   }
   virtual int write(void const *buf, int size, net_address *addr=NULL);
+  virtual int write_some(void const *buf, int size);
   virtual int read(void *buf, int size, net_address **addr);
 
   virtual ~unix_fd()                            { read_unselectable();  write_unselectable(); close(fd); }
@@ -163,7 +172,19 @@ class tcp_socket : public unix_fd
 {
   int listening;
   public :
-  tcp_socket(int fd) : unix_fd(fd) { listening=0; };
+  tcp_socket(int fd) : unix_fd(fd)
+  {
+    listening=0;
+#if defined SO_NOSIGPIPE
+    int one=1;
+    setsockopt(fd,SOL_SOCKET,SO_NOSIGPIPE,(char *)&one,sizeof(one));
+#endif
+  };
+  virtual void no_delay()
+  {
+    int one=1;
+    setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,(char *)&one,sizeof(one));
+  }
   virtual int listen(int port)
   {
     sockaddr_in host;
@@ -217,14 +238,18 @@ class udp_socket : public unix_fd
       tr=recvfrom(fd,buf,size,0, (sockaddr *) &((ip_address *)(*addr))->addr,&addr_size);
     } else
       tr=recv(fd,buf,size,0);
+    if (tr>0) net_bytes_in+=tr;
     return tr;
   }
   virtual int write(void const *buf, int size, net_address *addr=NULL)
   {
+    int tw;
     if (addr)
-      return sendto(fd,buf,size,0,(sockaddr *)(&((ip_address *)addr)->addr),sizeof(((ip_address *)addr)->addr));
+      tw=sendto(fd,buf,size,0,(sockaddr *)(&((ip_address *)addr)->addr),sizeof(((ip_address *)addr)->addr));
     else
-      return ::write(fd,(char*)buf,size);
+      tw=::write(fd,(char*)buf,size);
+    if (tw>0) net_bytes_out+=tw;
+    return tw;
   }
   virtual int listen(int port)
   {
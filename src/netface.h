@@ -17,6 +17,8 @@
 
 #define PACKET_MAX_SIZE 1024    // this is a game data packet (udp/ipx)
 #define READ_PACKET_SIZE 1024   // this is a file service packet (tcp/spx)
+#define BULK_PACKET_SIZE 32768  // file service packet for clients opening with a 'B' mode
+#define BULK_MAX_FILE_SIZE (32*1024*1024)  // larger files are read on demand
 #define NET_CRC_FILENAME "#net_crc"
 #define NET_STARTFILE    "netstart.spe"
 
@@ -53,7 +55,8 @@ enum { CLCMD_JOIN_FAILED,
        CLCMD_RELOAD_START,           // will you please load netstart.spe
        CLCMD_RELOAD_END,            // netstart.spe has been loaded, please continue
        CLCMD_REQUEST_RESEND,        // input didn't arrive, please resend
-       CLCMD_UNJOIN                 // causes server to delete you (addes your delete command to next out packet)
+       CLCMD_UNJOIN,                // causes server to delete you (addes your delete command to next out packet)
+       CLCMD_BATCH_MODE             // server to NET_CAP_BATCH clients: uint8 input delay, 0 for lockstep
      } ;
 
 
@@ -94,9 +97,14 @@ enum {
        SCMD_EXT_KEYPRESS,
        SCMD_EXT_KEYRELEASE,
        SCMD_CHAT_KEYPRESS,
-       SCMD_SYNC
+       SCMD_SYNC,
+       SCMD_SYNC64             // only sent once every peer is known to support it
      };
 
+// capability flags a joining client appends after the NUL of its name
+#define NET_CAP_SYNC64 1
+#define NET_CAP_BATCH  2
+
 
 struct join_struct
 {
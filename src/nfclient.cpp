@@ -15,9 +15,11 @@
 #if (defined(__MACH__) || !defined(__APPLE__))
 #   include <sys/types.h>
 #endif
+#include <stdio.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <sys/stat.h>
 
 #include "common.h"
 
@@ -38,6 +40,111 @@ void remove_client(int client_number) { ; }
 CrcManager *net_crcs = NULL;
 extern net_protocol *prot;
 
+// Server files we have no matching copy of are downloaded once into
+// <save dir>netcache/, named after their CRC, size and name, so joining
+// again only downloads what changed. Needs a server that sends sizes
+// with its CRC list.
+static CrcManager netcache_verified;   // cached copies checked this session
+static int netcache_hits=0,netcache_fetches=0,netcache_matches=0;
+static long netcache_hit_bytes=0,netcache_fetch_bytes=0,netcache_match_bytes=0;
+
+static void netcache_path(char *buf, char const *name, uint32_t crc, int32_t size)
+{
+  char const *base=strrchr(name,'/');
+  base=base ? base+1 : name;
+  sprintf(buf,"%snetcache/%08x-%ld-",get_save_filename_prefix(),(unsigned int)crc,(long)size);
+  char *d=buf+strlen(buf);
+  for (; *base && d<buf+250; base++)
+    *d++=(isalnum(*base) || *base=='.' || *base=='-') ? *base : '_';
+  *d=0;
+}
+
+static int netcache_download(char const *filename, char const *path, uint32_t crc, int32_t size)
+{
+  char dir[300],tmp[310];
+  sprintf(dir,"%snetcache",get_save_filename_prefix());
+  mkdir(dir,S_IRWXU);
+  sprintf(tmp,"%s.tmp",path);
+
+  char nm[256];
+  strcpy(nm,filename);
+  int fd=NF_open_file(nm,"rb");
+  if (fd<0)
+    return 0;
+
+  FILE *out=fopen(tmp,"wb");
+  if (!out)
+  {
+    NF_close(fd);
+    return 0;
+  }
+  static uint8_t buf[0x8000];
+  long total=0,ret;
+  while ((ret=NF_read(fd,buf,sizeof(buf)))>0 && fwrite(buf,ret,1,out)==1)
+    total+=ret;
+  NF_close(fd);
+  int ok=!fclose(out) && total==size;
+
+  if (ok)
+  {
+    jFILE *fp=new jFILE(tmp,"rb");
+    ok=!fp->open_failure() && crc_file(fp)==crc;
+    delete fp;
+  }
+  if (!ok || rename(tmp,path))
+  {
+    dprintf("netcache : could not cache %s\n",filename);
+    unlink(tmp);
+    return 0;
+  }
+  netcache_fetches++;
+  netcache_fetch_bytes+=size;
+  return 1;
+}
+
+// returns the cached copy of a server file, downloading it if needed
+static jFILE *netcache_open(char const *filename, char const *local_filename,
+                            uint32_t crc, int32_t size)
+{
+  char path[300];
+  netcache_path(path,local_filename,crc,size);
+
+  int num=netcache_verified.get_filenumber(path),failed;
+  netcache_verified.get_crc(num,failed);
+  if (failed)
+  {
+    jFILE *fp=new jFILE(path,"rb");
+    int ok=!fp->open_failure() && fp->file_size()==size && crc_file(fp)==crc;
+    delete fp;
+    if (ok)
+    {
+      netcache_hits++;
+      netcache_hit_bytes+=size;
+    }
+    else if (!netcache_download(filename,path,crc,size))
+      return NULL;
+    netcache_verified.set_crc(num,crc);
+  }
+
+  jFILE *fp=new jFILE(path,"rb");
+  if (fp->open_failure())
+  {
+    delete fp;
+    return NULL;
+  }
+  return fp;
+}
+
+void netcache_report()
+{
+  if (netcache_matches || netcache_hits || netcache_fetches)
+    dprintf("Net files : %d installed (%ld KB), %d cached (%ld KB), %d downloaded (%ld KB)\n",
+            netcache_matches,netcache_match_bytes/1024,netcache_hits,netcache_hit_bytes/1024,
+            netcache_fetches,netcache_fetch_bytes/1024);
+  netcache_hits=netcache_fetches=netcache_matches=0;
+  netcache_hit_bytes=netcache_fetch_bytes=netcache_match_bytes=0;
+}
+
 class nfs_file : public bFILE
 {
   jFILE *local;
@@ -81,7 +188,7 @@ nfs_file::nfs_file(char const *filename, char const *mode)
 
   if (net_crcs && !local_only)
   {
-    int fail1,fail2,fail3=0;
+    int fail1,fail2,fail3=0,fresh=0;
     char const *local_filename = filename;
     if (filename[0]=='/' && filename[1]=='/')
     { local_filename+=2;
@@ -102,6 +209,7 @@ nfs_file::nfs_file(char const *filename, char const *mode)
     {
       local_crc=crc_file(fp);
       crc_manager.set_crc(local_file_num,local_crc);
+      fresh=1;
     } else fail3=1;
     delete fp;
       }
@@ -109,7 +217,22 @@ nfs_file::nfs_file(char const *filename, char const *mode)
       if (!fail3)
       {
     if (local_crc==remote_crc)
+        {
           local_only=1;
+          if (fresh)
+          {
+            netcache_matches++;
+            netcache_match_bytes+=Max(0,net_crcs->get_size(remote_file_num));
+          }
+        }
+      }
+
+      int32_t remote_size=net_crcs->get_size(remote_file_num);
+      if (!local_only && remote_size>=0 && mode[0]=='r')
+      {
+        local=netcache_open(filename,local_filename,remote_crc,remote_size);
+        if (local)
+          return;
       }
     }
   }
@@ -34,6 +34,7 @@ long NF_filelength(int fd);
 long NF_tell(int fd);
 long NF_seek(int fd, long offset);
 int NF_set_file_server(net_address *addr);
+void netcache_report();       // prints and resets what the last join downloaded
 
 int request_server_entry();
 int server_entry_continue();
@@ -52,6 +53,9 @@ int get_inputs_from_server(unsigned char *buf);     // return bytes read into bu
 
 
 int client_number();
+int net_sync64();             // should SCMD_SYNC64 be sent with our input?
+int sync64_hashing();         // does level::tick() hash the objects it runs?
+void nfs_benchmark(int argc, char **argv);
 extern net_address *net_server;
 extern base_memory_struct *base;   // points to shm_addr
 
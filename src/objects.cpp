@@ -28,6 +28,7 @@
 #include "clisp.h"
 #include "lisp_gc.h"
 #include "profile.h"
+#include "nativeai.h"
 
 char **object_names;
 int total_objects;
@@ -337,7 +338,7 @@ void game_object::next_sequence()
 
 game_object::~game_object()
 {
-  if (lvars) free(lvars);
+  pool_put_array(lvars);
   clean_up();
 }
 
@@ -371,7 +372,10 @@ int game_object::can_morph_into(int type)
 void game_object::morph_into(int type, void (*stat_fun)(int), int anneal, int frames)
 {
   set_morph_status(new morph_char(this,type,stat_fun,anneal,frames));
+  int old_type=otype;
   otype=type;
+  if (current_level)
+    current_level->active_type_changed(this,old_type);
   set_state(stopped);
 }
 
@@ -403,7 +407,8 @@ int game_object::push_range()
 
 int game_object::decide()
 {
-  if (figures[otype]->get_fun(OFUN_AI))
+  character_type *t=figures[otype];
+  if (t->get_fun(OFUN_AI))
   {
     int old_aistate;
     old_aistate=aistate();
@@ -415,7 +420,13 @@ int game_object::decide()
     if (profiling())
       prof1=new time_marker;
 
-    LObject *ret = ((LSymbol *)figures[otype]->get_fun(OFUN_AI))->EvalFunction(NULL);
+    LObject *ret;
+    if (t->native_ai && native_ai_check)
+      ret = native_check_ai(this);
+    else if (t->native_ai)
+      ret = (LObject *)t->native_ai();
+    else
+      ret = ((LSymbol *)t->get_fun(OFUN_AI))->EvalFunction(NULL);
     if (profiling())
     {
       time_marker now;
@@ -908,6 +919,27 @@ void *game_object::float_tick()  // returns 1 if you hit something, 0 otherwise
   return true_symbol;
 }
 
+static inline uint64_t sync_mix(uint64_t h, uint32_t x)
+{
+  h=(h^x)*0x9e3779b97f4a7c15ULL;
+  return h^(h>>29);
+}
+
+uint64_t game_object::sync_hash()
+{
+  uint64_t h=sync_mix(0,otype);
+  h=sync_mix(h,x);
+  h=sync_mix(h,y);
+  h=sync_mix(h,(fx()<<24)|(fy()<<16)|(fxvel()<<8)|fyvel());
+  h=sync_mix(h,xvel());
+  h=sync_mix(h,yvel());
+  h=sync_mix(h,(state<<16)|(uint16_t)current_frame);
+  h=sync_mix(h,(hp()<<16)|aistate());
+  for (int i=0; i<figures[otype]->tv; i++)
+    h=sync_mix(h,lvars[i]);
+  return h;
+}
+
 int game_object::tick()      // returns blocked status
 {
   int blocked=0;
@@ -1198,28 +1230,32 @@ int game_object::move(int cx, int cy, int button)
 {
   int ret=0;
 
-  if (figures[otype]->get_fun(OFUN_MOVER))      // is a lisp move function defined?
+  character_type *t=figures[otype];
+  if (t->get_fun(OFUN_MOVER))      // is a lisp move function defined?
   {
-    LList *lcx, *lcy, *lb;
+    LList *lcx = NULL, *lcy, *lb;
+    PtrRef r1(lcx);
 
     game_object *o=current_object;
     current_object=this;
 
     // make a list of the parameters, and call the lisp function
-    lcx = LList::Create();
-    PtrRef r1(lcx);
-    lcx->car = LNumber::Create(cx);
+    if (!t->native_mover || native_ai_check)
+    {
+      lcx = LList::Create();
+      lcx->car = LNumber::Create(cx);
 
-    lcy = LList::Create();
-    PtrRef r2(lcy);
-    lcy->car = LNumber::Create(cy);
+      lcy = LList::Create();
+      PtrRef r2(lcy);
+      lcy->car = LNumber::Create(cy);
 
-    lb = LList::Create();
-    PtrRef r3(lb);
-    lb->car = LNumber::Create(button);
+      lb = LList::Create();
+      PtrRef r3(lb);
+      lb->car = LNumber::Create(button);
 
-    lcx->cdr = lcy;
-    lcy->cdr = lb;
+      lcx->cdr = lcy;
+      lcy->cdr = lb;
+    }
 
     void *m = mark_heap(TMP_SPACE);
 
@@ -1227,7 +1263,13 @@ int game_object::move(int cx, int cy, int button)
     if (profiling())
       prof1=new time_marker;
 
-    LObject *r = ((LSymbol *)figures[otype]->get_fun(OFUN_MOVER))->EvalFunction(lcx);
+    LObject *r;
+    if (t->native_mover && native_ai_check)
+      r = native_check_mover(this, lcx, cx, cy, button);
+    else if (t->native_mover)
+      r = (LObject *)t->native_mover(cx, cy, button);
+    else
+      r = ((LSymbol *)t->get_fun(OFUN_MOVER))->EvalFunction(lcx);
     if (profiling())
     {
       time_marker now;
@@ -1549,7 +1591,7 @@ game_object::game_object(int Type, int load)
     int t = figures[Type]->tv;
     if (t)
     {
-      lvars = (int32_t *)malloc(t * sizeof(int32_t));
+      lvars = (int32_t *)pool_get_array(t * sizeof(int32_t));
       memset(lvars, 0, t * sizeof(int32_t));
     }
   }
@@ -1605,7 +1647,7 @@ void game_object::change_aitype(int new_type)
 
 void game_object::change_type(int new_type)
 {
-  free(lvars);     // free old variable
+  pool_put_array(lvars);     // free old variable
   lvars = NULL;
 
   if (otype<0xffff)
@@ -1613,12 +1655,15 @@ void game_object::change_type(int new_type)
     int t = figures[new_type]->tv;
     if (t)
     {
-      lvars = (int32_t *)malloc(t * sizeof(int32_t));
+      lvars = (int32_t *)pool_get_array(t * sizeof(int32_t));
       memset(lvars, 0, t * sizeof(int32_t));
     }
   }
   else return;
+  int old_type=otype;
   otype=new_type;
+  if (current_level)
+    current_level->active_type_changed(this,old_type);
 
   if (figures[new_type]->get_fun(OFUN_CONSTRUCTOR))
   {
@@ -1645,3 +1690,148 @@ void game_object::change_type(int new_type)
     current_object=o;
   }
 }
+
+// -movebench: runs the physics of game_object::tick() for synthetic movers
+// spread over the current level, first with the old bounding box scan of
+// the foreground and then with the tile walk, and compares where they end
+void mover_benchmark(int count, int ticks)
+{
+  if (!current_level || !total_objects)
+  {
+    printf("-movebench: no level loaded\n");
+    return ;
+  }
+
+  game_object *m=current_level->main_character();
+  int type=m ? m->otype : 0;
+  int32_t w=current_level->foreground_width()*the_game->ftile_width(),
+          h=current_level->foreground_height()*the_game->ftile_height();
+
+  game_object **o=(game_object **)malloc(count*sizeof(game_object *));
+  int32_t *start=(int32_t *)malloc(count*8*sizeof(int32_t)),*end=start+count*4;
+  for (int i=0; i<count; i++)
+  {
+    o[i]=create(type,0,0,1);
+    start[i*4]=jrand()%w;
+    start[i*4+1]=jrand()%h;
+    start[i*4+2]=(int32_t)(jrand()%17)-8;
+    start[i*4+3]=(int32_t)(jrand()%17)-8;
+  }
+
+  float ms[2];
+  int differ=0;
+  ray_stats before;
+  uint32_t old_tick=current_level->tick_counter();
+  for (int pass=0; pass<2; pass++)
+  {
+    for (int i=0; i<count; i++)
+    {
+      game_object *g=o[i];
+      g->x=g->last_x=start[i*4];
+      g->y=g->last_y=start[i*4+1];
+      g->set_xvel(start[i*4+2]);
+      g->set_yvel(start[i*4+3]);
+      g->set_fxvel(0); g->set_fyvel(0);
+      g->set_xacel(0); g->set_yacel(0);
+      g->set_fxacel(0); g->set_fyacel(0);
+      g->set_gravity(1);
+      g->set_state(stopped);
+    }
+
+    raycast_reference=!pass;
+    Timer t;
+    for (int j=0; j<ticks; j++)
+    {
+      // the ray memo only holds for one tick
+      current_level->set_tick_counter(old_tick+pass*ticks+j+1);
+      for (int i=0; i<count; i++)
+        o[i]->tick();
+    }
+    ms[pass]=t.GetMs();
+
+    for (int i=0; i<count; i++)
+    {
+      int32_t *e=end+i*4;
+      if (pass && (e[0]!=o[i]->x || e[1]!=o[i]->y ||
+                   e[2]!=o[i]->xvel() || e[3]!=o[i]->yvel()))
+        differ++;
+      e[0]=o[i]->x; e[1]=o[i]->y; e[2]=o[i]->xvel(); e[3]=o[i]->yvel();
+    }
+    if (!pass)
+      before=current_level->ray_counts();
+  }
+  raycast_reference=0;
+  current_level->set_tick_counter(old_tick);
+
+  ray_stats const &r=current_level->ray_counts();
+  printf("%d movers, %d ticks\n",count,ticks);
+  printf("  bounding box scan %8.2f ms  %9.0f ticks/s\n",ms[0],
+         count*ticks*1000.0/Max(ms[0],0.001f));
+  printf("  tile walk         %8.2f ms  %9.0f ticks/s\n",ms[1],
+         count*ticks*1000.0/Max(ms[1],0.001f));
+  printf("  tile walk: %d rays, %d from the memo, %d tiles tested\n",
+         r.calls-before.calls,r.memo_hits-before.memo_hits,
+         r.tiles-before.tiles);
+  printf("  %d movers ended in a different place\n",differ);
+
+  for (int i=0; i<count; i++)
+    delete o[i];
+  free(o);
+  free(start);
+}
+
+void tick_benchmark(int ticks)
+{
+  if (!current_level || !total_objects)
+  {
+    printf("-tickbench: no level loaded\n");
+    return ;
+  }
+
+  game_object *m=current_level->main_character();
+  int type=m ? m->otype : 0;
+  int32_t w=current_level->foreground_width()*the_game->ftile_width(),
+          h=current_level->foreground_height()*the_game->ftile_height();
+
+#if defined HAVE_SOA
+  printf("hot object state kept in arrays\n");
+#else
+  printf("hot object state kept in the objects\n");
+#endif
+
+  static int const counts[]={ 1000, 5000, 20000 };
+  for (int c=0; c<3; c++)
+  {
+    int count=counts[c];
+    game_object **o=(game_object **)malloc(count*sizeof(game_object *));
+    for (int i=0; i<count; i++)
+    {
+      o[i]=create(type,jrand()%w,jrand()%h,1);
+      o[i]->set_xvel((int32_t)(jrand()%17)-8);
+      o[i]->set_yvel((int32_t)(jrand()%17)-8);
+    }
+    // a level's active list is not in creation order after a while
+    for (int i=count-1; i>0; i--)
+    {
+      int j=jrand()%(i+1);
+      game_object *tmp=o[i]; o[i]=o[j]; o[j]=tmp;
+    }
+
+    uint32_t old_tick=current_level->tick_counter();
+    Timer t;
+    for (int j=0; j<ticks; j++)
+    {
+      current_level->set_tick_counter(old_tick+j+1);
+      for (int i=0; i<count; i++)
+        o[i]->tick();
+    }
+    float ms=t.GetMs();
+    current_level->set_tick_counter(old_tick);
+    printf("  %5d objects  %8.2f ms  %9.0f ticks/s\n",count,ms,
+           count*ticks*1000.0/Max(ms,0.001f));
+
+    for (int i=0; i<count; i++)
+      delete o[i];
+    free(o);
+  }
+}
@@ -17,6 +17,7 @@
 #include "loader2.h"
 #include "view.h"
 #include "extend.h"
+#include "objpool.h"
 
 class view;
 
@@ -56,6 +57,9 @@ class game_object : public simple_object
 {
   sequence *current_sequence() { return figures[otype]->get_sequence(state); }
 public :
+  static void *operator new(size_t size) { return pool_get_object(size); }
+  static void operator delete(void *p) { pool_put_object(p); }
+
   game_object *next,*next_active;
   int32_t *lvars;
 
@@ -93,6 +97,7 @@ public :
 
   void load(int type, bFILE *fp, unsigned char *state_remap);
   int tick();  // should be called from decide, does the physics on the people, returns blocked status
+  uint64_t sync_hash();  // position, velocity, state, hp and lvars, for desync checks
   void *float_tick();  // returns T or blocked structure =
                        // (block_flags 'tile tilex tiley)
                        // (block_flags 'object obj)
@@ -179,6 +184,8 @@ extern game_object *current_object;
 extern view *current_view;
 game_object *create(int type, int32_t x, int32_t y, int skip_constructor=0, int aitype=0);
 int base_size();
+void mover_benchmark(int count, int ticks);
+void tick_benchmark(int ticks);
 
 void delete_object_list(object_node *first);
 int          object_to_number_in_list(game_object *who, object_node *list);
@@ -0,0 +1,156 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+#include "objpool.h"
+
+#define SLAB_SIZE 0x10000
+#define ARRAY_CLASSES 6            // 16 to 512 bytes
+#define BIG_ARRAY 0xff
+
+// Every array starts with this, so it can be resized and freed without
+// being told its size
+struct array_header
+{
+    uint32_t size_class;
+    uint32_t capacity;
+};
+
+struct size_pool
+{
+    size_t size;
+    void *free_list;
+    uint8_t *slab, *slab_end;
+};
+
+static size_pool objects = { 0, NULL, NULL, NULL };
+static size_pool arrays[ARRAY_CLASSES];
+static pool_stats stats;
+
+static void *pool_get(size_pool *p)
+{
+    stats.blocks++;
+    if (p->free_list)
+    {
+        void *ret = p->free_list;
+        p->free_list = *(void **)ret;
+        return ret;
+    }
+    if (p->slab + p->size > p->slab_end)
+    {
+        // what is left of the last slab is lost, it is smaller than a block
+        p->slab = (uint8_t *)malloc(SLAB_SIZE);
+        p->slab_end = p->slab + SLAB_SIZE;
+        stats.mallocs++;
+    }
+    void *ret = p->slab;
+    p->slab += p->size;
+    return ret;
+}
+
+static inline void pool_put(size_pool *p, void *block)
+{
+    *(void **)block = p->free_list;
+    p->free_list = block;
+}
+
+void *pool_get_object(size_t size)
+{
+    if (!objects.size)
+        objects.size = (size + 15) & ~(size_t)15;
+    if (size > objects.size)
+    {
+        stats.blocks++;
+        stats.mallocs++;
+        return malloc(size);        // never happens, game_object has no children
+    }
+    if (++stats.live > stats.peak)
+        stats.peak = stats.live;
+    return pool_get(&objects);
+}
+
+void pool_put_object(void *p)
+{
+    if (!p)
+        return;
+    stats.live--;
+    pool_put(&objects, p);
+}
+
+void *pool_get_array(size_t size)
+{
+    size_t need = size + sizeof(array_header);
+    array_header *h;
+    uint32_t c = 0;
+    while (c < ARRAY_CLASSES && (size_t)(16 << c) < need)
+        c++;
+
+    if (c == ARRAY_CLASSES)
+    {
+        stats.blocks++;
+        stats.mallocs++;
+        h = (array_header *)malloc(need);
+        h->size_class = BIG_ARRAY;
+        h->capacity = size;
+    }
+    else
+    {
+        if (!arrays[c].size)
+            arrays[c].size = 16 << c;
+        h = (array_header *)pool_get(arrays + c);
+        h->size_class = c;
+        h->capacity = (16 << c) - sizeof(array_header);
+    }
+    return h + 1;
+}
+
+void pool_put_array(void *p)
+{
+    if (!p)
+        return;
+    array_header *h = (array_header *)p - 1;
+    if (h->size_class == BIG_ARRAY)
+        free(h);
+    else
+        pool_put(arrays + h->size_class, h);
+}
+
+void *pool_resize_array(void *p, size_t size)
+{
+    if (!size)
+    {
+        pool_put_array(p);
+        return NULL;
+    }
+    if (!p)
+        return pool_get_array(size);
+
+    array_header *h = (array_header *)p - 1;
+    if (size <= h->capacity)
+        return p;
+
+    void *ret = pool_get_array(size);
+    memcpy(ret, p, h->capacity);
+    pool_put_array(p);
+    return ret;
+}
+
+pool_stats const &pool_counts()
+{
+    return stats;
+}
@@ -0,0 +1,39 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __OBJPOOL_H__
+#define __OBJPOOL_H__
+
+// Free lists for the memory game objects are made of: the objects
+// themselves, their lvars and their objs and lights arrays. Blocks are cut
+// from slabs that are kept until the game exits, so scenes that keep
+// creating and deleting projectiles reuse the same memory instead of going
+// through malloc() and free() for every one of them.
+
+struct pool_stats
+{
+    int32_t live, peak;        // game objects
+    int32_t blocks;            // objects and arrays handed out
+    int32_t mallocs;           // slabs and arrays too large for a pool
+};
+
+void *pool_get_object(size_t size);
+void pool_put_object(void *p);
+
+// Arrays of any size, the larger ones come from malloc(). Resizing works
+// like realloc() but only moves the array when it outgrows its block, and
+// a size of 0 frees it and returns NULL.
+void *pool_get_array(size_t size);
+void *pool_resize_array(void *p, size_t size);
+void pool_put_array(void *p);
+
+pool_stats const &pool_counts();
+
+#endif // __OBJPOOL_H__
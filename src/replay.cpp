@@ -0,0 +1,261 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#if defined __linux__ || defined __APPLE__
+#   include <sys/types.h>
+#   include <sys/wait.h>
+#endif
+
+#include "common.h"
+
+#include "game.h"
+#include "demo.h"
+#include "replay.h"
+
+extern char req_name[100];
+
+static int batch_worker = 0;
+static int batch_fd = -1;            // where result lines are written
+static char **batch_files = NULL;    // demos this process is responsible for
+static int batch_total = 0;
+static int batch_synclog = 0;
+
+// sync values of the demo being played
+static uint16_t *sync_log = NULL;
+static int sync_total = 0, sync_size = 0;
+static int32_t first_desync = -1, first_desync64 = -1;
+static uint16_t desync_recorded, desync_computed;
+
+void replay_batch_start(int argc, char **argv)
+{
+    int jobs = 0;
+
+    batch_files = (char **)malloc(sizeof(char *) * argc);
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-demobatch"))
+        {
+            while (i + 1 < argc && argv[i + 1][0] != '-')
+                batch_files[batch_total++] = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-jobs") && i + 1 < argc)
+            jobs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-synclog"))
+            batch_synclog = 1;
+    }
+
+    if (!batch_total)
+    {
+        printf("-demobatch: no demo files given\n");
+        exit(1);
+    }
+
+#if !defined __CELLOS_LV2__
+    // Like a dedicated server, the workers never show anything; set it
+    // before the fork so every worker inherits it
+    setenv("SDL_VIDEODRIVER", "dummy", 1);
+#endif
+
+#if defined __linux__ || defined __APPLE__
+    if (jobs <= 0)
+        jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    jobs = Max(1, Min(jobs, batch_total));
+
+    pid_t *pids = (pid_t *)malloc(sizeof(pid_t) * jobs);
+    int *fds = (int *)malloc(sizeof(int) * jobs);
+
+    for (int j = 0; j < jobs; j++)
+    {
+        int fd[2];
+        if (pipe(fd) < 0)
+        {
+            perror("-demobatch: pipe");
+            exit(1);
+        }
+
+        fflush(stdout);
+        pids[j] = fork();
+        if (pids[j] < 0)
+        {
+            perror("-demobatch: fork");
+            exit(1);
+        }
+
+        if (pids[j] == 0)
+        {
+            // Worker j plays every jobs-th demo, starting with demo j
+            close(fd[0]);
+            for (int k = 0; k < j; k++)
+                close(fds[k]);
+            int n = 0;
+            for (int k = j; k < batch_total; k += jobs)
+                batch_files[n++] = batch_files[k];
+            batch_total = n;
+            batch_fd = fd[1];
+            batch_worker = 1;
+            free(pids);
+            free(fds);
+            return;
+        }
+
+        close(fd[1]);
+        fds[j] = fd[0];
+    }
+
+    Timer timer;
+    int failed = 0;
+    for (int j = 0; j < jobs; j++)
+    {
+        char buf[1024];
+        int n;
+        while ((n = read(fds[j], buf, sizeof(buf))) > 0)
+            fwrite(buf, 1, n, stdout);
+        close(fds[j]);
+
+        int status;
+        waitpid(pids[j], &status, 0);
+        if (!WIFEXITED(status))
+        {
+            printf("-demobatch: worker %d died\n", j);
+            failed++;
+        }
+        else
+            failed += WEXITSTATUS(status);
+    }
+
+    printf("%d demos, %d failed, %d workers, %.1f seconds\n",
+           batch_total, failed, jobs, timer.GetMs() / 1000.0f);
+    exit(failed ? 1 : 0);
+#else
+    // No fork() here, play everything in this process
+    batch_fd = 1;
+    batch_worker = 1;
+#endif
+}
+
+int replay_batch_active()
+{
+    return batch_worker;
+}
+
+void replay_note_sync(uint16_t recorded, uint16_t computed)
+{
+    if (!batch_worker)
+        return;
+
+    if (sync_total == sync_size)
+    {
+        sync_size = sync_size ? sync_size * 2 : 1024;
+        sync_log = (uint16_t *)realloc(sync_log, sizeof(uint16_t) * sync_size);
+    }
+    sync_log[sync_total++] = computed;
+
+    if (first_desync < 0 && recorded != computed)
+    {
+        // Packet n carries the sync value of tick n - 1
+        first_desync = demo_man.current_tick() - 1;
+        desync_recorded = recorded;
+        desync_computed = computed;
+    }
+}
+
+void replay_note_sync64(uint64_t recorded, uint64_t computed)
+{
+    if (batch_worker && first_desync64 < 0 && recorded != computed)
+        first_desync64 = demo_man.current_tick() - 1;
+}
+
+static void write_sync_log(char const *demo)
+{
+    char name[255];
+    snprintf(name, sizeof(name), "%s.sync", demo);
+    FILE *fp = fopen(name, "w");
+    if (!fp)
+        return;
+    for (int i = 0; i < sync_total; i++)
+        fprintf(fp, "%d %04x\n", i, sync_log[i]);
+    fclose(fp);
+}
+
+int replay_batch_run(Game *g)
+{
+    int failed = 0;
+
+    for (int i = 0; i < batch_total; i++)
+    {
+        char line[512];
+
+        sync_total = 0;
+        first_desync = first_desync64 = -1;
+
+        Timer timer;
+        if (!demo_man.set_state(demo_manager::PLAYING, batch_files[i]))
+        {
+            snprintf(line, sizeof(line), "%s: unable to play\n", batch_files[i]);
+            if (write(batch_fd, line, strlen(line)) < 0)
+                break;
+            failed++;
+            continue;
+        }
+
+        // Same as the main loop, minus input and drawing
+        while (demo_man.current_state() == demo_manager::PLAYING)
+        {
+            if (req_name[0])
+            {
+                g->load_level(req_name);
+                req_name[0] = 0;
+            }
+
+            demo_man.do_inputs();
+            if (demo_man.current_state() == demo_manager::PLAYING)
+                g->step();
+        }
+
+        float ms = Max(1.0f, timer.GetMs());
+        uint32_t ticks = demo_man.current_tick();
+
+        if (first_desync64 >= 0
+             && (first_desync < 0 || first_desync64 < first_desync))
+        {
+            snprintf(line, sizeof(line), "%s: %u ticks, %.0f ticks/sec, "
+                     "objects out of sync at tick %d\n", batch_files[i],
+                     ticks, ticks * 1000.0f / ms, first_desync64);
+            failed++;
+        }
+        else if (first_desync >= 0)
+        {
+            snprintf(line, sizeof(line), "%s: %u ticks, %.0f ticks/sec, "
+                     "out of sync at tick %d (recorded %04x, computed %04x)\n",
+                     batch_files[i], ticks, ticks * 1000.0f / ms,
+                     first_desync, desync_recorded, desync_computed);
+            failed++;
+        }
+        else
+            snprintf(line, sizeof(line), "%s: %u ticks, %.0f ticks/sec, in sync\n",
+                     batch_files[i], ticks, ticks * 1000.0f / ms);
+
+        if (write(batch_fd, line, strlen(line)) < 0)
+            break;
+
+        if (batch_synclog)
+            write_sync_log(batch_files[i]);
+    }
+
+    return failed;
+}
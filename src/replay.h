@@ -0,0 +1,36 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+
+#include <stdint.h>
+
+class Game;
+
+// Batch demo replay, used with:
+//   abuse -demobatch demo1.dat demo2.dat ... [-jobs N] [-synclog]
+// Demos are split between N worker processes which play them without
+// drawing and report the first tick where the recorded sync value does
+// not match make_sync(), along with the replay speed.
+
+// Called early in main(). Returns in the worker processes only, the
+// parent waits for the results and exits.
+void replay_batch_start(int argc, char **argv);
+int replay_batch_active();
+// Plays the demos assigned to this worker, returns the number of demos
+// which failed to load or went out of sync
+int replay_batch_run(Game *g);
+// Called for every SCMD_SYNC command seen during demo playback
+void replay_note_sync(uint16_t recorded, uint16_t computed);
+// Same for SCMD_SYNC64, in demos which have it
+void replay_note_sync64(uint64_t recorded, uint64_t computed);
+
+#endif // __REPLAY_H__
@@ -32,10 +32,26 @@
 #include "specs.h"
 #include "setup.h"
 
+// Number of mixer channels; each one plays a single voice
+#define SFX_CHANNELS 50
+// Voices quieter than this are culled instead of being mixed
+#define SFX_MIN_VOLUME 4
+// Maximum number of voices playing the same effect at once
+#define SFX_MAX_INSTANCES 4
+
 extern flags_struct flags;
 static int sound_enabled = 0;
 static SDL_AudioSpec audioObtained;
 
+// What each mixer channel was last asked to play
+static struct
+{
+    Mix_Chunk *chunk;
+    int volume;
+} voices[SFX_CHANNELS];
+
+static sound_stats stats;
+
 //
 // sound_init()
 // Initialise audio
@@ -71,7 +87,8 @@ int sound_init( int argc, char **argv )
         return 0;
     }
 
-    Mix_AllocateChannels(50);
+    Mix_AllocateChannels(SFX_CHANNELS);
+    memset(voices, 0, sizeof(voices));
 
     int tempChannels = 0;
     Mix_QuerySpec(&audioObtained.freq, &audioObtained.format, &tempChannels);
@@ -105,6 +122,8 @@ void sound_uninit()
 //
 sound_effect::sound_effect(char const *filename)
 {
+    m_chunk = NULL;
+
     if (!sound_enabled)
         return;
 
@@ -138,6 +157,9 @@ sound_effect::~sound_effect()
     Mix_FadeOutGroup(-1, 100);
     while (Mix_Playing(-1))
         SDL_Delay(10);
+    for (int i = 0; i < SFX_CHANNELS; i++)
+        if (voices[i].chunk == m_chunk)
+            voices[i].chunk = NULL;
     Mix_FreeChunk(m_chunk);
 }
 
@@ -150,19 +172,88 @@ sound_effect::~sound_effect()
 //   128 - Centered.
 //   255 - Completely to the left.
 //
+// Inaudible sounds are culled. When the effect already has too many
+// voices, or when all channels are busy, the quietest candidate voice
+// is stolen if it is quieter than the new one.
+//
 void sound_effect::play(int volume, int pitch, int panpot)
 {
-    if (!sound_enabled)
+    if (!sound_enabled || !m_chunk)
         return;
 
-    int channel = Mix_PlayChannel(-1, m_chunk, 0);
+    if (volume < SFX_MIN_VOLUME)
+    {
+        stats.culled++;
+        return;
+    }
+
+    int free_channel = -1, instances = 0;
+    int quietest = -1, quietest_instance = -1;
+
+    for (int i = 0; i < SFX_CHANNELS; i++)
+    {
+        if (!voices[i].chunk || !Mix_Playing(i))
+        {
+            voices[i].chunk = NULL;
+            if (free_channel < 0)
+                free_channel = i;
+            continue;
+        }
+
+        if (quietest < 0 || voices[i].volume < voices[quietest].volume)
+            quietest = i;
+
+        if (voices[i].chunk == m_chunk)
+        {
+            instances++;
+            if (quietest_instance < 0
+                 || voices[i].volume < voices[quietest_instance].volume)
+                quietest_instance = i;
+        }
+    }
+
+    int channel = free_channel;
+    if (instances >= SFX_MAX_INSTANCES)
+        channel = quietest_instance;
+    else if (channel < 0)
+        channel = quietest;
+
+    if (channel != free_channel)
+    {
+        if (channel < 0 || voices[channel].volume >= volume)
+        {
+            stats.culled++;
+            return;
+        }
+        stats.stolen++;
+    }
+
+    // Playing on a busy channel halts whatever was there
+    channel = Mix_PlayChannel(channel, m_chunk, 0);
     if (channel > -1)
     {
         Mix_Volume(channel, volume);
         Mix_SetPanning(channel, panpot, 255 - panpot);
+        voices[channel].chunk = m_chunk;
+        voices[channel].volume = volume;
+        stats.played++;
     }
 }
 
+//
+// sound_frame
+//
+// Reset the voice statistics at the start of a new frame.
+//
+void sound_frame()
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+sound_stats const &sound_get_stats()
+{
+    return stats;
+}
 
 // Play music using SDL_Mixer
 
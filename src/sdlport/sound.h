@@ -24,6 +24,17 @@ int sound_init(int argc, char **argv);
 void sound_uninit();
 void print_sound_options(); // print the options avaible for sound
 
+// Voice statistics, accumulated since the last call to sound_frame()
+struct sound_stats
+{
+    int played;  // voices started
+    int culled;  // requests dropped as inaudible or over the instance limit
+    int stolen;  // playing voices cut off to make room for louder ones
+};
+
+void sound_frame(); // start a new frame of voice statistics
+sound_stats const &sound_get_stats();
+
 class sound_effect
 {
 public:
@@ -33,6 +33,7 @@
 #include "sbar.h"
 #include "nfserver.h"
 #include "chat.h"
+#include "replay.h"
 
 #define SHIFT_DOWN_DEFAULT 15
 #define SHIFT_RIGHT_DEFAULT 0
@@ -335,6 +336,13 @@ uint16_t make_sync()
   return x;
 }
 
+// hash of every object run by the last tick, see level::add_tick_hash()
+uint64_t make_sync64()
+{
+  if (!current_level) return 0;
+  return (current_level->tick_hash()^rand_on)*0x100000001b3ULL;
+}
+
 
 
 void view::get_input()
@@ -1175,13 +1183,118 @@ void view::configure_for_area(area_controller *a)
 }
 
 
+int sync64_disabled=0;    // -nosync64
+int sync64_server_seen=0; // the last packet had a 64-bit sync from the server
+
+// When the 64-bit syncs of the peers differ, the objects run by the last
+// tick are bisected over the next packets to find the first one out of
+// sync. Every peer takes the same steps since they only depend on the
+// packets they all process.
+static int sync_searching=0,sync_mismatch=0,sync_lo,sync_hi;
+
+static uint32_t make_range_sync(int lo, int hi)
+{
+  uint32_t x=0x811c9dc5;
+  for (int i=lo; i<hi && i<current_level->tick_hash_total(); i++)
+  {
+    uint64_t h=current_level->tick_hash_of(i);
+    x=(x^(uint32_t)(h^(h>>32)))*0x01000193;
+  }
+  return x;
+}
+
+void write_sync64(net_packet *pk, int player_num)
+{
+  uint64_t x=make_sync64();
+  uint32_t range=0;
+  if (sync_searching && current_level)
+    range=make_range_sync(sync_lo,(sync_lo+sync_hi)/2);
+
+  pk->write_uint8(SCMD_SYNC64);
+  pk->write_uint8(player_num);
+  pk->write_uint32((uint32_t)x);
+  pk->write_uint32((uint32_t)(x>>32));
+  pk->write_uint16(current_level ? current_level->tick_hash_total() : 0);
+  pk->write_uint32(range);
+}
+
+// writes the objects run by the last tick, or only object number 'which'
+static void sync_dump(int which)
+{
+  char name[255];
+  sprintf(name,"%ssyncdump-%d.txt",get_save_filename_prefix(),client_number());
+  FILE *fp=fopen(name,which<0 ? "w" : "a");
+  if (!fp) return ;
+
+  int i=which<0 ? 0 : which;
+  int end=which<0 ? current_level->tick_hash_total() : which+1;
+  fprintf(fp,"tick %d, sync %016llx\n",current_level->tick_counter(),
+          (unsigned long long)make_sync64());
+  for (; i<end && i<current_level->tick_hash_total(); i++)
+  {
+    game_object *o=current_level->ticked_object(i);
+    if (!o)
+    {
+      fprintf(fp,"%d: deleted\n",i);
+      continue;
+    }
+    fprintf(fp,"%d: %s x=%d y=%d xvel=%d yvel=%d state=%d hp=%d hash=%016llx lvars",
+            i,object_names[o->otype],(int)o->x,(int)o->y,(int)o->xvel(),(int)o->yvel(),
+            (int)o->state,o->hp(),(unsigned long long)current_level->tick_hash_of(i));
+    for (int j=0; j<figures[o->otype]->tv; j++)
+      fprintf(fp," %d",(int)o->lvars[j]);
+    fprintf(fp,"\n");
+  }
+  fclose(fp);
+  dprintf("sync: objects written to %s\n",name);
+}
+
+static void check_sync64(int mismatch, int range_mismatch, int count)
+{
+  if (!sync_searching)
+  {
+    if (mismatch && !sync_mismatch)
+    {
+      dprintf("64-bit sync mismatch at tick %d, looking for the first object\n",
+              current_level->tick_counter());
+      sync_dump(-1);
+      sync_searching=1;
+      sync_lo=0;
+      sync_hi=Max(count,1);
+    }
+    sync_mismatch=mismatch;  // don't search again until the peers agree
+    return ;
+  }
+
+  // the range syncs in this packet were made for [sync_lo, mid)
+  int mid=(sync_lo+sync_hi)/2;
+  if (range_mismatch)
+    sync_hi=mid;
+  else
+    sync_lo=mid;
+
+  if (sync_hi-sync_lo<=1)
+  {
+    game_object *o=sync_lo<current_level->tick_hash_total() ?
+                   current_level->ticked_object(sync_lo) : NULL;
+    dprintf("first object out of sync: #%d %s\n",sync_lo,
+            o ? object_names[o->otype] : "(none)");
+    sync_dump(sync_lo);
+    sync_searching=0;
+  }
+}
+
 void process_packet_commands(uint8_t *pk, int size)
 {
 #if !defined __CELLOS_LV2__
   int32_t sync_uint16=-1;
+  int sync64_total=0,sync64_mismatch=0,sync64_range_mismatch=0,sync64_count=0;
+  uint64_t sync64_first=0;
+  uint32_t sync64_first_range=0;
 
   if (!size) return ;
   pk[size]=SCMD_END_OF_PACKET;
+  sync64_server_seen=0;
 
   uint8_t cmd;
   int already_reloaded=0;
@@ -1231,7 +1344,10 @@ void process_packet_commands(uint8_t *pk, int size)
     memcpy(&x,pk,2);  pk+=2;
     x=lstl(x);
     if (demo_man.current_state()==demo_manager::PLAYING)
-    sync_uint16=make_sync();
+    {
+      sync_uint16=make_sync();
+      replay_note_sync(x,sync_uint16);
+    }
 
     if (sync_uint16==-1)
     sync_uint16=x;
@@ -1241,6 +1357,51 @@ void process_packet_commands(uint8_t *pk, int size)
       if (demo_man.current_state()==demo_manager::NORMAL)
         net_reload();
       already_reloaded=1;
+    }
+      } break;
+      case SCMD_SYNC64 :
+      {
+    uint8_t player_num=*(pk++);
+    uint32_t lo,hi,range;
+    uint16_t count;
+    memcpy(&lo,pk,4);
+    memcpy(&hi,pk+4,4);
+    memcpy(&count,pk+8,2);
+    memcpy(&range,pk+10,4);
+    pk+=14;
+    uint64_t x=((uint64_t)lltl(hi)<<32)|lltl(lo);
+    count=lstl(count);
+    range=lltl(range);
+
+    if (player_num==0)
+      sync64_server_seen=1;
+
+    if (demo_man.current_state()==demo_manager::PLAYING)
+    {
+      if (!sync64_hashing())     // only -demobatch runs the hashes
+        break;
+      uint64_t calced=make_sync64();
+      replay_note_sync64(x,calced);
+      if (x!=calced && !sync_mismatch)
+      {
+        dprintf("64-bit sync mismatch at tick %d\n",current_level->tick_counter());
+        sync_dump(-1);
+      }
+      sync_mismatch=(x!=calced);
+    }
+    else if (!sync64_total++)
+    {
+      sync64_first=x;
+      sync64_first_range=range;
+      sync64_count=count;
+    }
+    else
+    {
+      if (x!=sync64_first)
+        sync64_mismatch=1;
+      if (range!=sync64_first_range)
+        sync64_range_mismatch=1;
+      sync64_count=Max(sync64_count,(int)count);
     }
       } break;
       case SCMD_DELETE_CLIENT :
@@ -1277,6 +1438,9 @@ void process_packet_commands(uint8_t *pk, int size)
 
     }
   } while (cmd!=SCMD_END_OF_PACKET);
+
+  if (sync64_total>1 && current_level)
+    check_sync64(sync64_mismatch,sync64_range_mismatch,sync64_count);
 #endif
 }
 
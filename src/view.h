@@ -18,6 +18,7 @@
 class object_node;
 class game_object;
 class area_controller;
+class net_packet;
 
 struct suggest_struct
 {
@@ -138,6 +139,10 @@ object_node *make_player_onodes(int player_num=-1);
 int total_view_vars();
 char const *get_view_var_name(int num);
 uint16_t make_sync();
+uint64_t make_sync64();
+void write_sync64(net_packet *pk, int player_num);
+
+extern int sync64_disabled, sync64_server_seen;
 
 #endif
 